@@ -0,0 +1,132 @@
+#include "assetloader.h"
+
+#include <chrono>
+#include <iostream>
+
+namespace moar
+{
+
+AssetLoader::AssetLoader()
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+    shutdown();
+}
+
+void AssetLoader::init(unsigned int numThreads)
+{
+    shutdown();
+    running = true;
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        threads.emplace_back(&AssetLoader::loaderLoop, this);
+    }
+    std::cout << "Asset loader started with " << numThreads << " threads\n";
+}
+
+void AssetLoader::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            return;
+        }
+        running = false;
+        jobs.clear();
+    }
+    jobCondition.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    completions.clear();
+}
+
+void AssetLoader::load(const Job& job)
+{
+    if (threads.empty()) {
+        Completion completion = job();
+        if (completion && !completion()) {
+            completions.push_back(std::move(completion));
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+    }
+    jobCondition.notify_one();
+}
+
+void AssetLoader::update(double budget)
+{
+    auto start = std::chrono::steady_clock::now();
+    while (true) {
+        Completion completion;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (completions.empty()) {
+                return;
+            }
+            completion = std::move(completions.front());
+            completions.pop_front();
+        }
+        // Completions may queue more jobs, so they run without the lock
+        if (!completion()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            completions.push_front(std::move(completion));
+            return;
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() >= budget) {
+            return;
+        }
+    }
+}
+
+void AssetLoader::clear()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    jobs.clear();
+    idleCondition.wait(lock, [this] { return numRunning == 0; });
+    completions.clear();
+}
+
+bool AssetLoader::isIdle() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return jobs.empty() && completions.empty() && numRunning == 0;
+}
+
+void AssetLoader::loaderLoop()
+{
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobCondition.wait(lock, [this] { return !running || !jobs.empty(); });
+            if (!running) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            ++numRunning;
+        }
+
+        Completion completion = job();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (completion) {
+                completions.push_back(std::move(completion));
+            }
+            --numRunning;
+        }
+        idleCondition.notify_all();
+    }
+}
+
+} // moar
@@ -0,0 +1,57 @@
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace moar
+{
+
+// Background threads for decoding assets. Jobs run on the loader threads and return a completion
+// that creates the GL resources on the render thread. The threads are separate from the job
+// system, so a long import never delays the per frame tasks that the render thread waits for.
+// A completion that returns false is kept and run again on the next update.
+class AssetLoader
+{
+public:
+    using Completion = std::function<bool()>;
+    using Job = std::function<Completion()>;
+
+    explicit AssetLoader();
+    ~AssetLoader();
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader(AssetLoader&&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+    AssetLoader& operator=(AssetLoader&&) = delete;
+
+    void init(unsigned int numThreads);
+    void shutdown();
+
+    // Without threads the job and its completion run right away, a deferred completion is queued
+    void load(const Job& job);
+    // Runs completions until the budget in seconds is used, at least one per call
+    void update(double budget);
+    // Drops the queued jobs and the completions, waits for the jobs already running
+    void clear();
+    bool isIdle() const;
+
+private:
+    void loaderLoop();
+
+    std::vector<std::thread> threads;
+    mutable std::mutex mutex;
+    std::condition_variable jobCondition;
+    std::condition_variable idleCondition;
+    std::deque<Job> jobs;
+    std::deque<Completion> completions;
+    unsigned int numRunning = 0;
+    bool running = false;
+};
+
+} // moar
+
+#endif // ASSETLOADER_H
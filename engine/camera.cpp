@@ -16,7 +16,7 @@ Camera::Camera(float fov, float ratio, float nearClip, float farClip) :
     ratio(ratio),
     nearClipDistance(nearClip),
     farClipDistance(farClip),
-    viewMatrix(new glm::mat4(glm::lookAt(position, forward, up))),
+    viewMatrix(new glm::mat4(glm::lookAt(getPosition(), forward, up))),
     projectionMatrix(new glm::mat4(glm::perspective(FOV, ratio, nearClipDistance, farClipDistance)))
 {
     calculateFrustum();
@@ -27,23 +27,18 @@ Camera::~Camera()
 }
 
 void Camera::rotate(const glm::vec3& axis, float amount) {
-    Object::rotate(axis, amount);
-    if (rotation.x > ROTATION_LIMIT) {
-        rotation.x = ROTATION_LIMIT;
-    }
-    if (rotation.x < -ROTATION_LIMIT) {
-        rotation.x = -ROTATION_LIMIT;
-    }
+    setRotation(getRotation() + axis * amount);
 }
 
 void Camera::setRotation(const glm::vec3& rotation) {
-    Object::setRotation(rotation);
-    if (this->rotation.x > ROTATION_LIMIT) {
-        this->rotation.x = ROTATION_LIMIT;
+    glm::vec3 limitedRotation = rotation;
+    if (limitedRotation.x > ROTATION_LIMIT) {
+        limitedRotation.x = ROTATION_LIMIT;
     }
-    if (this->rotation.x < -ROTATION_LIMIT) {
-        this->rotation.x = -ROTATION_LIMIT;
+    if (limitedRotation.x < -ROTATION_LIMIT) {
+        limitedRotation.x = -ROTATION_LIMIT;
     }
+    Object::setRotation(limitedRotation);
 }
 
 const glm::mat4* Camera::getViewMatrixPointer() const
@@ -56,6 +51,11 @@ const glm::mat4* Camera::getProjectionMatrixPointer() const
     return projectionMatrix.get();
 }
 
+float Camera::getNearClipDistance() const
+{
+    return nearClipDistance;
+}
+
 float Camera::getFarClipDistance() const
 {
     return farClipDistance;
@@ -164,6 +164,7 @@ void Camera::setFXAAEnabled(bool status)
 
 void Camera::updateViewMatrix()
 {
+    glm::vec3 position = getPosition();
     *viewMatrix = glm::mat4(glm::lookAt(position, position + getForward(), up));
 }
 
@@ -33,6 +33,7 @@ public:
 
     const glm::mat4* getViewMatrixPointer() const;
     const glm::mat4* getProjectionMatrixPointer() const;
+    float getNearClipDistance() const;
     float getFarClipDistance() const;
 
     bool sphereInsideFrustum(const glm::vec3& point, float radius) const;
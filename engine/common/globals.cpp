@@ -12,6 +12,8 @@ const std::string DIFFUSE_DEFINE = "#define DIFFUSE\n";
 const std::string SPECULAR_DEFINE = "#define SPECULAR\n";
 const std::string NORMAL_DEFINE = "#define NORMAL\n";
 const std::string BUMP_DEFINE = "#define BUMP\n";
+const std::string BINDLESS_DEFINE = "#extension GL_ARB_bindless_texture : require\n#define BINDLESS\n";
+const std::string PARAMETERS_DEFINE = "#define PARAMETERS\n";
 
 const std::string FORWARD_LIGHT_SHADER = "forward_light";
 const std::string DEFERRED_LIGHT_SHADER = "deferred_light";
@@ -20,15 +22,22 @@ const std::string GBUFFER_SHADER = "gbuffer";
 const int TRANSFORMATION_BINDING_POINT = 1;
 const int LIGHT_BINDING_POINT = 2;
 const int LIGHT_PROJECTION_BINDING_POINT = 3;
+const int MATERIAL_BINDING_POINT = 8; // Shader storage, above the ones of the culling shaders
+const int PARAMETER_BINDING_POINT = 4;
 
 const std::string TRANSFORMATION_BLOCK_NAME = "TransformationBlock";
 const std::string LIGHT_BLOCK_NAME = "LightBlock";
 const std::string LIGHT_PROJECTION_BLOCK_NAME = "LightProjectionBlock";
+const std::string PARAMETER_BLOCK_NAME = "ParameterBlock";
 
 const GLuint VERTEX_LOCATION = 1;
 const GLuint TEX_LOCATION = 2;
 const GLuint NORMAL_LOCATION = 3;
 const GLuint TANGENT_LOCATION = 4;
+const GLuint POSITION_OFFSET_LOCATION = 5;
+const GLuint POSITION_SCALE_LOCATION = 6;
+const GLuint INSTANCE_MODEL_LOCATION = 7; // mat4, uses locations 7-10
+const GLuint INSTANCE_NORMAL_LOCATION = 11; // mat4, uses locations 11-14
 
 const GLuint AMBIENT_LOCATION = 10;
 const GLuint CAMERA_POS_LOCATION = 12;
@@ -50,7 +59,6 @@ const GLuint RENDERED_TEX_LOCATION2 = 32;
 const GLuint RENDERED_TEX_LOCATION3 = 33;
 const GLuint RENDERED_TEX_LOCATION4 = 34;
 
-const GLuint TIME_LOCATION = 40;
 const GLuint SCREEN_SIZE_LOCATION = 41;
 const GLuint ENABLE_SHADOW_LOCATION = 42;
 const GLuint FAR_CLIP_DISTANCE_LOCATION = 43;
@@ -66,7 +74,16 @@ const GLuint ENABLE_SHADOWS_LOCATION = 70;
 const GLuint SSAO_KERNEL_LOCATION = 80;
 // Reserve locations for kernels
 
+const GLuint CULL_NUM_INSTANCES_LOCATION = 150;
+const GLuint CULL_PHASE_LOCATION = 151;
+const GLuint CULL_NUM_COMMANDS_LOCATION = 152;
+const GLuint DEPTH_PYRAMID_SIZE_LOCATION = 153;
+const GLuint DEPTH_PYRAMID_LEVEL_LOCATION = 154;
+const GLuint CULL_VIEW_PROJECTION_LOCATION = 160; // mat4, uses locations 160-163
+const GLuint CULL_FRUSTUM_PLANES_LOCATION = 164; // vec4[6], uses locations 164-169
+
 unsigned int G_DRAW_COUNT = 0;
 bool G_COMPONENT_CHANGED = false;
+GLuint G_BOUND_VERTEX_ARRAY = 0;
 
 } // moar
@@ -17,6 +17,8 @@ extern const std::string DIFFUSE_DEFINE;
 extern const std::string SPECULAR_DEFINE;
 extern const std::string NORMAL_DEFINE;
 extern const std::string BUMP_DEFINE;
+extern const std::string BINDLESS_DEFINE;
+extern const std::string PARAMETERS_DEFINE;
 
 extern const std::string FORWARD_LIGHT_SHADER;
 extern const std::string DEFERRED_LIGHT_SHADER;
@@ -25,15 +27,22 @@ extern const std::string GBUFFER_SHADER;
 extern const int TRANSFORMATION_BINDING_POINT;
 extern const int LIGHT_BINDING_POINT;
 extern const int LIGHT_PROJECTION_BINDING_POINT;
+extern const int MATERIAL_BINDING_POINT;
+extern const int PARAMETER_BINDING_POINT;
 
 extern const std::string TRANSFORMATION_BLOCK_NAME;
 extern const std::string LIGHT_BLOCK_NAME;
 extern const std::string LIGHT_PROJECTION_BLOCK_NAME;
+extern const std::string PARAMETER_BLOCK_NAME;
 
 extern const GLuint VERTEX_LOCATION;
 extern const GLuint TEX_LOCATION;
 extern const GLuint NORMAL_LOCATION;
 extern const GLuint TANGENT_LOCATION;
+extern const GLuint POSITION_OFFSET_LOCATION;
+extern const GLuint POSITION_SCALE_LOCATION;
+extern const GLuint INSTANCE_MODEL_LOCATION;
+extern const GLuint INSTANCE_NORMAL_LOCATION;
 
 extern const GLuint AMBIENT_LOCATION;
 extern const GLuint CAMERA_POS_LOCATION;
@@ -53,7 +62,6 @@ extern const GLuint RENDERED_TEX_LOCATION1;
 extern const GLuint RENDERED_TEX_LOCATION2;
 extern const GLuint RENDERED_TEX_LOCATION3;
 
-extern const GLuint TIME_LOCATION;
 extern const GLuint SCREEN_SIZE_LOCATION;
 extern const GLuint ENABLE_SHADOW_LOCATION;
 extern const GLuint FAR_CLIP_DISTANCE_LOCATION;
@@ -69,12 +77,21 @@ const int MAX_NUM_SHADOWMAPS = 2; // Ensure there are enough uniform locations
 extern const GLuint SSAO_KERNEL_LOCATION;
 const int SSAO_KERNEL_SIZE = 64; // Ensure there are enough uniform locations
 
+extern const GLuint CULL_NUM_INSTANCES_LOCATION;
+extern const GLuint CULL_PHASE_LOCATION;
+extern const GLuint CULL_NUM_COMMANDS_LOCATION;
+extern const GLuint DEPTH_PYRAMID_SIZE_LOCATION;
+extern const GLuint DEPTH_PYRAMID_LEVEL_LOCATION;
+extern const GLuint CULL_VIEW_PROJECTION_LOCATION;
+extern const GLuint CULL_FRUSTUM_PLANES_LOCATION;
+
 const GLint MAX_UNIFORM_LOCATION = 256;
 
 const int MAX_NUM_LIGHTS_PER_TYPE = 16;
 
 extern unsigned int G_DRAW_COUNT;
 extern bool G_COMPONENT_CHANGED;
+extern GLuint G_BOUND_VERTEX_ARRAY; // Only tracks binds made through the engine, reset each frame
 
 } // moar
 
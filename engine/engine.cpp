@@ -14,6 +14,8 @@
 #include <utility>
 #include <fstream>
 #include <algorithm>
+#include <thread>
+#include <unordered_set>
 
 #ifdef NVPERFKIT
 // Note: Consider using other tools such as Nvidia Nsight
@@ -246,6 +248,35 @@ bool Engine::init(const std::string& settingsFile)
         std::cerr << e.what() << "\n";
     }
 
+    unsigned int numWorkers = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+    try {
+        int workerThreads = pt.get<int>("Engine.workerThreads");
+        if (workerThreads > 0) {
+            numWorkers = static_cast<unsigned int>(workerThreads);
+        }
+    } catch (boost::property_tree::ptree_error& e) {
+        std::cerr << "WARNING: Could not load worker thread count from the .ini-file\n";
+        std::cerr << e.what() << "\n";
+    }
+    jobSystem.init(numWorkers);
+
+    try {
+        manager.initLoader(pt.get<unsigned int>("Engine.loaderThreads"));
+        manager.initUploader(pt.get<size_t>("Engine.uploadBufferMB") * 1024 * 1024);
+        manager.setTextureBudget(pt.get<size_t>("Engine.textureBudgetMB") * 1024 * 1024);
+        loadBudget = pt.get<double>("Engine.loadBudgetMs") / 1000.0;
+    } catch (boost::property_tree::ptree_error& e) {
+        std::cerr << "WARNING: Could not load asset loader settings from the .ini-file\n";
+        std::cerr << e.what() << "\n";
+    }
+
+    try {
+        GeometryBuffer::setPositionQuantization(pt.get<bool>("Engine.quantizePositions"));
+    } catch (boost::property_tree::ptree_error& e) {
+        std::cerr << "WARNING: Could not load position quantization setting from the .ini-file\n";
+        std::cerr << e.what() << "\n";
+    }
+
     if (!gui.init(window)) {
         std::cerr << "ERROR: Failed to initialize AntTweakBar\n";
         return false;
@@ -266,6 +297,19 @@ bool Engine::init(const std::string& settingsFile)
         return false;
     }
 
+    try {
+        manager.setMeshOptimization(pt.get<bool>("Engine.optimizeMeshes"));
+        manager.setLodGeneration(pt.get<bool>("Engine.generateLods"));
+        manager.setMeshClustering(pt.get<bool>("Engine.clusterMeshes"));
+        staticBatcher.setMeshClustering(pt.get<bool>("Engine.clusterMeshes"));
+        manager.setMeshCachePath(pt.get<std::string>("Engine.meshCachePath"));
+        manager.setTextureCachePath(pt.get<std::string>("Engine.textureCachePath"));
+        manager.setProgramCachePath(pt.get<std::string>("Engine.programCachePath"));
+    } catch (boost::property_tree::ptree_error& e) {
+        std::cerr << "WARNING: Could not load mesh processing settings from the .ini-file\n";
+        std::cerr << e.what() << "\n";
+    }
+
     if (!manager.loadShaderFiles(shaderInfoFile)) {
         return false;
     }
@@ -278,7 +322,7 @@ bool Engine::init(const std::string& settingsFile)
         std::cerr << "WARNING: Failed to load render settings\n";
     }
 
-    if (!renderer.init(&renderSettings, &manager)) {
+    if (!renderer.init(&renderSettings, &manager, &jobSystem)) {
         std::cerr << "ERROR: Failed to initialize renderer\n";
         return false;
     }
@@ -326,6 +370,7 @@ void Engine::execute()
         input.reset();
         app->update();
 
+        updateLoading();
         updateObjects();
 
         G_DRAW_COUNT = 0;
@@ -367,6 +412,11 @@ Time*Engine::getTime()
     return &time;
 }
 
+JobSystem* Engine::getJobSystem()
+{
+    return &jobSystem;
+}
+
 Object* Engine::getObjectByName(const std::string& name) const
 {
     for (const auto& obj : objects) {
@@ -414,8 +464,17 @@ bool Engine::loadLevel(const std::string& level)
                 renderSettings.ambientColor = glm::vec3(x, y, z);
                 ifs >> word;
                 Material* material = manager.createMaterial();
-                material->setTexture(manager.getTexture(word), Material::TextureType::DIFFUSE, GL_TEXTURE_2D);
-                material->setShaderType(Shader::DIFFUSE);
+                material->setTexture(manager.requestTexture(word, Material::DIFFUSE), Material::TextureType::DIFFUSE, GL_TEXTURE_2D);
+                material->setShaderType(Shader::DIFFUSE | Shader::PARAMETERS);
+                if (!renderSettings.bindlessTextures) {
+                    // The forward and the gbuffer programs of the material share the block layout
+                    const Shader* shader = manager.getGBufferShader(material->getShaderType());
+                    ParameterBlock* parameters = shader ? material->createParameters(shader->getProgram()) : nullptr;
+                    if (parameters) {
+                        parameters->set("diffuseTint", glm::vec4(1.0f));
+                        parameters->set("specularScale", 1.0f);
+                    }
+                }
                 Object::setMeshDefaultMaterial(material);
                 word.clear();
             } else if (word == "skybox") {
@@ -439,6 +498,29 @@ bool Engine::loadLevel(const std::string& level)
                 ifs >> a;
                 obj->setShadowCaster(a);
                 word.clear();
+            } else if (word == "parent") {
+                if (!obj) {
+                    throw std::runtime_error("Parent without an object");
+                }
+                ifs >> word;
+                Object* parentObject = getObjectByName(word);
+                if (!parentObject) {
+                    throw std::runtime_error("Unknown parent object: " + word);
+                }
+                obj->setParent(parentObject);
+                word.clear();
+            } else if (word == "static") {
+                if (!obj) {
+                    throw std::runtime_error("Static without an object");
+                }
+                obj->setStatic(true);
+                word.clear();
+            } else if (word == "occluder") {
+                if (!obj) {
+                    throw std::runtime_error("Occluder without an object");
+                }
+                obj->setOccluder(true);
+                word.clear();
             } else if (word == "component") {
                 if (!obj) {
                     throw std::runtime_error("Component without an object");
@@ -446,7 +528,7 @@ bool Engine::loadLevel(const std::string& level)
                 ifs >> word;
                 if (word == "model") {
                     ifs >> word;
-                    Model* modelComponent = manager.getModel(word);
+                    Model* modelComponent = manager.requestModel(word);
                     obj->addComponent<Model>(modelComponent);
                     word.clear();
                 } else if (word == "light") {
@@ -475,6 +557,8 @@ bool Engine::loadLevel(const std::string& level)
         std::cerr << "WARNING: Could not parse level: " << level << " - " << e.what() << "\n";
         return false;
     }
+    // Batches are built from the meshes, so they wait for the models that are still loading
+    staticBatchesPending = true;
     G_COMPONENT_CHANGED = true;
     app->levelLoaded();
     return true;
@@ -486,6 +570,7 @@ void Engine::setDeferredRendering(bool enabled)
         std::cerr << "ERROR: Failed to initialize renderer framebuffers\n";
         return;
     }
+    renderer.prewarmPipelines();
 }
 
 const Engine::PerformanceData& Engine::getPerformanceData() const
@@ -495,22 +580,95 @@ const Engine::PerformanceData& Engine::getPerformanceData() const
 
 void Engine::resetLevel()
 {
+    staticBatchesPending = false;
+    pipelinesPending = false;
     renderer.clear();
     objects.clear();
+    staticBatcher.clear();
     manager.clear();
     skybox.reset();
 }
 
+void Engine::updateLoading()
+{
+    std::vector<Model*> loadedModels;
+    manager.update(loadBudget, loadedModels);
+    if (!loadedModels.empty()) {
+        // Objects copied the meshes of the model when it was still empty
+        for (const auto& obj : objects) {
+            Model* model = obj->getComponent<Model>();
+            if (model && std::find(loadedModels.begin(), loadedModels.end(), model) != loadedModels.end()) {
+                obj->addComponent<Model>(model);
+            }
+        }
+    }
+
+    if (staticBatchesPending && !manager.isLoading()) {
+        staticBatchesPending = false;
+        buildStaticBatches();
+        releaseMeshData();
+        G_COMPONENT_CHANGED = true;
+        // All the materials of the level exist now
+        if (!manager.prewarmShaders()) {
+            std::cerr << "WARNING: Failed to prewarm shaders\n";
+        }
+        pipelinesPending = true;
+    }
+
+    manager.updateShaders();
+    if (pipelinesPending && !manager.isCompilingShaders()) {
+        pipelinesPending = false;
+        renderer.prewarmPipelines();
+    }
+}
+
 void Engine::updateObjects()
 {
     camera->updateViewMatrix();
     Object::updateViewProjectionMatrix();
-    for (auto& obj : objects) {
-        obj->updateModelMatrix();
-    }
     if (skybox) {
         skybox->setPosition(camera->getPosition());
-        skybox->updateModelMatrix();
+    }
+    Object::updateTransforms(&jobSystem);
+}
+
+void Engine::buildStaticBatches()
+{
+    std::vector<Object*> staticObjects;
+    for (const auto& obj : objects) {
+        if (obj->isStatic() && !obj->getMeshObjects().empty()) {
+            staticObjects.push_back(obj.get());
+        }
+    }
+    if (staticObjects.empty()) {
+        return;
+    }
+
+    updateObjects();
+    for (const auto& batch : staticBatcher.build(staticObjects)) {
+        Object* batchObject = createObject("static_batch");
+        batchObject->setShadowCaster(batch.shadowCaster);
+        batchObject->setOccluder(batch.occluder);
+        batchObject->addComponent<Model>(batch.model.get());
+    }
+    for (Object* obj : staticObjects) {
+        obj->meshObjects.clear();
+    }
+}
+
+void Engine::releaseMeshData()
+{
+    std::unordered_set<const Mesh*> occluderMeshes;
+    for (const auto& obj : objects) {
+        if (obj->isOccluder()) {
+            for (const auto& meshObject : obj->getMeshObjects()) {
+                occluderMeshes.insert(meshObject.mesh);
+            }
+        }
+    }
+    manager.releaseMeshData(occluderMeshes);
+    for (const auto& batch : staticBatcher.getBatches()) {
+        batch.model->releaseMeshData(occluderMeshes);
     }
 }
 
@@ -541,7 +699,7 @@ bool Engine::createSkybox()
 	GLuint texture = manager.getCubeTexture(renderSettings.skyboxTextures);
 	material->setTexture(texture, Material::TextureType::DIFFUSE, GL_TEXTURE_CUBE_MAP);
 	for (auto& meshObject : skybox->getMeshObjects()) {
-		meshObject.material = material;
+		meshObject.material = material->getHandle();
 	}
 
 	skybox->setShadowCaster(false);
@@ -10,6 +10,8 @@
 #include "camera.h"
 #include "object.h"
 #include "renderer.h"
+#include "jobsystem.h"
+#include "staticbatcher.h"
 
 #include <GLFW/glfw3.h>
 
@@ -46,6 +48,7 @@ public:
     Input* getInput();
     RenderSettings* getRenderSettings();
     Time* getTime();
+    JobSystem* getJobSystem();
     Object* getObjectByName(const std::string& name) const;
 
     Object* createObject(const std::string& name = "");
@@ -56,7 +59,11 @@ public:
 
 private:
     void resetLevel();
+    void updateLoading();
     void updateObjects();
+    void buildStaticBatches();
+    // The meshes only keep the CPU geometry that rendering reads
+    void releaseMeshData();
 	void updatePerformanceData();
 	bool createSkybox();
     void printInfo(int windowWidth, int windowHeight);    
@@ -64,12 +71,17 @@ private:
     std::shared_ptr<Application> app;
 
     GLFWwindow* window = nullptr;
+    JobSystem jobSystem;
     ResourceManager manager;
     GUI gui;
     Input input;
     RenderSettings renderSettings;
     Renderer renderer;
     Time time;
+    StaticBatcher staticBatcher;
+    bool staticBatchesPending = false;
+    bool pipelinesPending = false;  // Prewarmed once the shaders of the level have linked
+    double loadBudget = 0.004;
 
     std::vector<std::unique_ptr<Object>> objects;
     std::unique_ptr<Camera> camera;
@@ -48,10 +48,13 @@ bool GBuffer::init()
     GLuint attachments[4] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3};
     glDrawBuffers(4, attachments);
 
-    glGenRenderbuffers(1, &depthRenderbuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+    // A texture instead of a renderbuffer so that the depth pyramid can be built from it
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
 
     return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
 }
@@ -63,7 +66,7 @@ void GBuffer::deinit()
     glDeleteTextures(1, &normalTexture);
     glDeleteTextures(1, &colorTexture);
     glDeleteTextures(1, &viewSpacePositionTexture);
-    glDeleteRenderbuffers(1, &depthRenderbuffer);
+    glDeleteTextures(1, &depthTexture);
 }
 
 std::vector<GLuint> GBuffer::getDeferredTextures() const
@@ -76,5 +79,10 @@ GLuint GBuffer::getViewSpacePositionTexture() const
     return viewSpacePositionTexture;
 }
 
+GLuint GBuffer::getDepthTexture() const
+{
+    return depthTexture;
+}
+
 } // moar
 
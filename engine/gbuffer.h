@@ -25,13 +25,14 @@ public:
 
     std::vector<GLuint> getDeferredTextures() const;
     GLuint getViewSpacePositionTexture() const;
+    GLuint getDepthTexture() const;
 
 private:
     GLuint positionTexture = 0;
     GLuint normalTexture = 0;
     GLuint colorTexture = 0;
     GLuint viewSpacePositionTexture = 0;
-    GLuint depthRenderbuffer = 0;
+    GLuint depthTexture = 0;
 };
 
 } // moar
@@ -0,0 +1,515 @@
+#include "geometrybuffer.h"
+#include "common/globals.h"
+#include "instancebuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+namespace moar
+{
+
+namespace
+{
+
+struct FloatVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 tangent;
+    glm::vec2 texCoord;
+};
+
+struct PackedVertex
+{
+    glm::vec3 position;
+    GLuint normal;
+    GLuint tangent;
+    GLuint texCoord;
+};
+
+struct QuantizedVertex
+{
+    GLushort position[4];
+    GLuint normal;
+    GLuint tangent;
+    GLuint texCoord;
+};
+
+const GLuint INITIAL_VERTEX_CAPACITY = 1 << 18;
+const GLuint INITIAL_INDEX_CAPACITY = 1 << 21; // 16 bit units
+const size_t MAX_SHORT_INDEX_VERTICES = 1 << 16;
+const GLuint VERTEX_BUFFER_BINDING = 0;
+const GLuint INSTANCE_BUFFER_BINDING = 1;
+const float MAX_HALF_TEXCOORD = 4.0f; // Half float spacing is 1/512 at 4.0
+
+GLuint packSnorm1010102(const glm::vec3& v)
+{
+    auto pack = [] (float value) {
+        float clamped = std::max(-1.0f, std::min(1.0f, value));
+        return static_cast<GLuint>(static_cast<GLint>(std::round(clamped * 511.0f)) & 0x3FF);
+    };
+    return pack(v.x) | (pack(v.y) << 10) | (pack(v.z) << 20);
+}
+
+GLushort quantizeUnorm16(float value, float offset, float extent)
+{
+    if (extent <= 0.0f) {
+        return 0;
+    }
+    float normalized = std::max(0.0f, std::min(1.0f, (value - offset) / extent));
+    return static_cast<GLushort>(std::round(normalized * 65535.0f));
+}
+
+} // anonymous
+
+bool GeometryBuffer::quantizePositions = true;
+GLuint GeometryBuffer::instanceBuffer = 0;
+
+void GeometryBuffer::setPositionQuantization(bool enabled)
+{
+    quantizePositions = enabled;
+}
+
+GeometryBuffer::VertexFormat GeometryBuffer::selectFormat(const MeshData& data)
+{
+    for (const glm::vec2& texCoord : data.texCoords) {
+        if (std::abs(texCoord.x) > MAX_HALF_TEXCOORD || std::abs(texCoord.y) > MAX_HALF_TEXCOORD) {
+            return FLOAT;
+        }
+    }
+    return quantizePositions ? QUANTIZED : PACKED;
+}
+
+void GeometryBuffer::resetBindingCache()
+{
+    G_BOUND_VERTEX_ARRAY = 0;
+}
+
+void GeometryBuffer::setInstanceBuffer(GLuint buffer)
+{
+    instanceBuffer = buffer;
+}
+
+void GeometryBuffer::RangeAllocator::reset(GLuint capacity)
+{
+    freeRanges.clear();
+    if (capacity > 0) {
+        freeRanges.push_back(Range{0, capacity});
+    }
+}
+
+void GeometryBuffer::RangeAllocator::grow(GLuint oldCapacity, GLuint newCapacity)
+{
+    if (!freeRanges.empty() && freeRanges.back().offset + freeRanges.back().size == oldCapacity) {
+        freeRanges.back().size += newCapacity - oldCapacity;
+    } else {
+        freeRanges.push_back(Range{oldCapacity, newCapacity - oldCapacity});
+    }
+}
+
+bool GeometryBuffer::RangeAllocator::allocate(GLuint size, GLuint& offset)
+{
+    for (auto iter = freeRanges.begin(); iter != freeRanges.end(); ++iter) {
+        if (iter->size >= size) {
+            offset = iter->offset;
+            iter->offset += size;
+            iter->size -= size;
+            if (iter->size == 0) {
+                freeRanges.erase(iter);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void GeometryBuffer::RangeAllocator::free(GLuint offset, GLuint size)
+{
+    auto byOffset = [] (const Range& range, GLuint value) { return range.offset < value; };
+    auto iter = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset, byOffset);
+    iter = freeRanges.insert(iter, Range{offset, size});
+
+    auto next = iter + 1;
+    if (next != freeRanges.end() && iter->offset + iter->size == next->offset) {
+        iter->size += next->size;
+        freeRanges.erase(next);
+    }
+    if (iter != freeRanges.begin()) {
+        auto previous = iter - 1;
+        if (previous->offset + previous->size == iter->offset) {
+            previous->size += iter->size;
+            freeRanges.erase(iter);
+        }
+    }
+}
+
+GeometryBuffer::GeometryBuffer()
+{
+}
+
+GeometryBuffer::~GeometryBuffer()
+{
+    if (VAO != 0) {
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+        glDeleteVertexArrays(1, &VAO);
+    }
+}
+
+void GeometryBuffer::setFormat(VertexFormat format)
+{
+    if (VAO != 0) {
+        std::cerr << "WARNING: Can not change the format of an initialized geometry buffer\n";
+        return;
+    }
+    this->format = format;
+}
+
+GeometryBuffer::VertexFormat GeometryBuffer::getFormat() const
+{
+    return format;
+}
+
+const GeometryBuffer::Allocation* GeometryBuffer::allocate(const MeshData& data)
+{
+    if (data.vertices.empty() || data.indices.empty()) {
+        std::cerr << "WARNING: Can not allocate empty geometry\n";
+        return nullptr;
+    }
+    if (VAO == 0) {
+        init();
+    }
+
+    std::unique_ptr<Allocation> allocation(new Allocation());
+    std::vector<unsigned char> vertices;
+    encodeVertices(data, *allocation, vertices);
+
+    std::vector<GLuint> indices(data.indices);
+    allocation->lods.push_back(Lod{0, static_cast<GLsizei>(data.indices.size())});
+    for (const MeshLod& lod : data.lods) {
+        allocation->lods.push_back(Lod{static_cast<GLuint>(indices.size()), static_cast<GLsizei>(lod.indices.size())});
+        indices.insert(indices.end(), lod.indices.begin(), lod.indices.end());
+    }
+
+    GLuint numVertices = static_cast<GLuint>(data.vertices.size());
+    GLuint numIndices = static_cast<GLuint>(indices.size());
+    bool shortIndices = data.vertices.size() <= MAX_SHORT_INDEX_VERTICES;
+    GLuint numUnits = shortIndices ? numIndices + (numIndices & 1) : numIndices * 2;
+    GLuint vertexOffset = 0;
+    GLuint indexOffset = 0;
+    if (!vertexRanges.allocate(numVertices, vertexOffset)) {
+        growVertexBuffer(numVertices);
+        vertexRanges.allocate(numVertices, vertexOffset);
+    }
+    if (!indexRanges.allocate(numUnits, indexOffset)) {
+        growIndexBuffer(numUnits);
+        indexRanges.allocate(numUnits, indexOffset);
+    }
+
+    // Copy targets leave the element array binding of whatever VAO is bound untouched
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * stride, numVertices * stride, &vertices[0]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+    if (shortIndices) {
+        std::vector<GLushort> shorts(indices.begin(), indices.end());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset * sizeof(GLushort), numIndices * sizeof(GLushort), &shorts[0]);
+    } else {
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset * sizeof(GLushort), numIndices * sizeof(GLuint), &indices[0]);
+    }
+
+    allocation->baseVertex = static_cast<GLint>(vertexOffset);
+    allocation->numVertices = numVertices;
+    allocation->indexOffset = indexOffset;
+    allocation->indexUnits = numUnits;
+    allocation->indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    allocation->slot = allocations.size();
+    allocations.push_back(std::move(allocation));
+    return allocations.back().get();
+}
+
+void GeometryBuffer::free(const Allocation* allocation)
+{
+    if (!allocation || allocation->slot >= allocations.size() || allocations[allocation->slot].get() != allocation) {
+        std::cerr << "WARNING: Tried to free an unknown geometry allocation\n";
+        return;
+    }
+
+    vertexRanges.free(static_cast<GLuint>(allocation->baseVertex), allocation->numVertices);
+    indexRanges.free(allocation->indexOffset, allocation->indexUnits);
+
+    size_t slot = allocation->slot;
+    if (slot + 1 != allocations.size()) {
+        std::swap(allocations[slot], allocations.back());
+        allocations[slot]->slot = slot;
+    }
+    allocations.pop_back();
+}
+
+void GeometryBuffer::compact()
+{
+    if (VAO == 0) {
+        return;
+    }
+
+    std::vector<Allocation*> live;
+    for (const auto& allocation : allocations) {
+        live.push_back(allocation.get());
+    }
+    std::sort(live.begin(), live.end(), [] (const Allocation* a, const Allocation* b) {
+        return a->baseVertex < b->baseVertex;
+    });
+
+    // Copy into fresh buffers since glCopyBufferSubData does not allow overlapping ranges
+    GLuint newVertexBuffer = resizeBuffer(0, 0, static_cast<GLsizeiptr>(vertexCapacity) * stride);
+    glBindBuffer(GL_COPY_READ_BUFFER, vertexBuffer);
+    GLuint numVertices = 0;
+    for (Allocation* allocation : live) {
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->baseVertex * stride,
+                            numVertices * stride, allocation->numVertices * stride);
+        allocation->baseVertex = static_cast<GLint>(numVertices);
+        numVertices += allocation->numVertices;
+    }
+
+    GLuint newIndexBuffer = resizeBuffer(0, 0, static_cast<GLsizeiptr>(indexCapacity) * sizeof(GLushort));
+    glBindBuffer(GL_COPY_READ_BUFFER, indexBuffer);
+    GLuint numUnits = 0;
+    for (Allocation* allocation : live) {
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->indexOffset * sizeof(GLushort),
+                            numUnits * sizeof(GLushort), allocation->indexUnits * sizeof(GLushort));
+        allocation->indexOffset = numUnits;
+        numUnits += allocation->indexUnits;
+    }
+
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+    vertexBuffer = newVertexBuffer;
+    indexBuffer = newIndexBuffer;
+    attachBuffers();
+
+    GLuint offset = 0;
+    vertexRanges.reset(vertexCapacity);
+    vertexRanges.allocate(numVertices, offset);
+    indexRanges.reset(indexCapacity);
+    indexRanges.allocate(numUnits, offset);
+    std::cout << "Compacted geometry buffer to " << numVertices << " vertices and " << numUnits * sizeof(GLushort) << " index bytes\n";
+}
+
+void GeometryBuffer::bind() const
+{
+    if (G_BOUND_VERTEX_ARRAY != VAO) {
+        glBindVertexArray(VAO);
+        G_BOUND_VERTEX_ARRAY = VAO;
+    }
+    // The instance source is VAO state, so each VAO picks up a changed source when it is next used
+    if (boundInstanceBuffer != instanceBuffer) {
+        glBindVertexBuffer(INSTANCE_BUFFER_BINDING, instanceBuffer, 0, sizeof(InstanceBuffer::Instance));
+        boundInstanceBuffer = instanceBuffer;
+    }
+}
+
+void GeometryBuffer::draw(const Allocation& allocation, size_t lod, GLuint firstInstance, GLsizei numInstances) const
+{
+    bind();
+    const Lod& range = allocation.lods[std::min(lod, allocation.lods.size() - 1)];
+    size_t indexSize = allocation.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    size_t byteOffset = static_cast<size_t>(allocation.indexOffset) * sizeof(GLushort) + range.firstIndex * indexSize;
+    glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.numIndices, allocation.indexType,
+                                                  reinterpret_cast<GLvoid*>(byteOffset), numInstances,
+                                                  allocation.baseVertex, firstInstance);
+}
+
+GeometryBuffer::DrawCommand GeometryBuffer::getDrawCommand(const Allocation& allocation, size_t lod,
+                                                           GLuint firstInstance, GLuint numInstances) const
+{
+    const Lod& range = allocation.lods[std::min(lod, allocation.lods.size() - 1)];
+    // Indirect commands count the first index in elements of the index type
+    GLuint firstIndex = allocation.indexType == GL_UNSIGNED_SHORT ? allocation.indexOffset : allocation.indexOffset / 2;
+    DrawCommand command;
+    command.count = static_cast<GLuint>(range.numIndices);
+    command.instanceCount = numInstances;
+    command.firstIndex = firstIndex + range.firstIndex;
+    command.baseVertex = allocation.baseVertex;
+    command.baseInstance = firstInstance;
+    return command;
+}
+
+void GeometryBuffer::drawIndirect(GLenum indexType, GLuint firstCommand, GLsizei numCommands) const
+{
+    bind();
+    const GLvoid* offset = reinterpret_cast<const GLvoid*>(firstCommand * sizeof(DrawCommand));
+    glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, offset, numCommands, 0);
+}
+
+GLuint GeometryBuffer::getVertexBuffer() const
+{
+    return vertexBuffer;
+}
+
+GLuint GeometryBuffer::getIndexBuffer() const
+{
+    return indexBuffer;
+}
+
+void GeometryBuffer::init()
+{
+    glGenVertexArrays(1, &VAO);
+    bind();
+
+    auto setAttribute = [] (GLuint location, GLint size, GLenum type, GLboolean normalized, GLuint offset) {
+        glVertexAttribFormat(location, size, type, normalized, offset);
+        glVertexAttribBinding(location, VERTEX_BUFFER_BINDING);
+        glEnableVertexAttribArray(location);
+    };
+
+    auto setInstanceAttribute = [] (GLuint location, GLuint offset) {
+        glVertexAttribFormat(location, 4, GL_FLOAT, GL_FALSE, offset);
+        glVertexAttribBinding(location, INSTANCE_BUFFER_BINDING);
+        glEnableVertexAttribArray(location);
+    };
+
+    // Matrices take one location per column
+    for (GLuint column = 0; column < 4; ++column) {
+        GLuint columnOffset = column * sizeof(glm::vec4);
+        setInstanceAttribute(INSTANCE_MODEL_LOCATION + column, offsetof(InstanceBuffer::Instance, model) + columnOffset);
+        setInstanceAttribute(INSTANCE_NORMAL_LOCATION + column, offsetof(InstanceBuffer::Instance, normal) + columnOffset);
+    }
+    setInstanceAttribute(POSITION_OFFSET_LOCATION, offsetof(InstanceBuffer::Instance, positionOffset));
+    setInstanceAttribute(POSITION_SCALE_LOCATION, offsetof(InstanceBuffer::Instance, positionScale));
+    glVertexBindingDivisor(INSTANCE_BUFFER_BINDING, 1);
+    if (instanceBuffer == 0) {
+        std::cerr << "WARNING: Geometry buffer initialized before the instance buffer\n";
+    }
+    glBindVertexBuffer(INSTANCE_BUFFER_BINDING, instanceBuffer, 0, sizeof(InstanceBuffer::Instance));
+    boundInstanceBuffer = instanceBuffer;
+
+    switch (format) {
+    case FLOAT:
+        stride = sizeof(FloatVertex);
+        setAttribute(VERTEX_LOCATION, 3, GL_FLOAT, GL_FALSE, offsetof(FloatVertex, position));
+        setAttribute(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, offsetof(FloatVertex, normal));
+        setAttribute(TANGENT_LOCATION, 3, GL_FLOAT, GL_FALSE, offsetof(FloatVertex, tangent));
+        setAttribute(TEX_LOCATION, 2, GL_FLOAT, GL_FALSE, offsetof(FloatVertex, texCoord));
+        break;
+    case PACKED:
+        stride = sizeof(PackedVertex);
+        setAttribute(VERTEX_LOCATION, 3, GL_FLOAT, GL_FALSE, offsetof(PackedVertex, position));
+        setAttribute(NORMAL_LOCATION, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, normal));
+        setAttribute(TANGENT_LOCATION, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, tangent));
+        setAttribute(TEX_LOCATION, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, texCoord));
+        break;
+    case QUANTIZED:
+    default:
+        stride = sizeof(QuantizedVertex);
+        setAttribute(VERTEX_LOCATION, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(QuantizedVertex, position));
+        setAttribute(NORMAL_LOCATION, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(QuantizedVertex, normal));
+        setAttribute(TANGENT_LOCATION, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(QuantizedVertex, tangent));
+        setAttribute(TEX_LOCATION, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(QuantizedVertex, texCoord));
+        break;
+    }
+
+    vertexCapacity = INITIAL_VERTEX_CAPACITY;
+    indexCapacity = INITIAL_INDEX_CAPACITY;
+    vertexBuffer = resizeBuffer(0, 0, static_cast<GLsizeiptr>(vertexCapacity) * stride);
+    indexBuffer = resizeBuffer(0, 0, static_cast<GLsizeiptr>(indexCapacity) * sizeof(GLushort));
+    vertexRanges.reset(vertexCapacity);
+    indexRanges.reset(indexCapacity);
+    attachBuffers();
+}
+
+void GeometryBuffer::encodeVertices(const MeshData& data, Allocation& allocation,
+                                    std::vector<unsigned char>& encoded) const
+{
+    size_t numVertices = data.vertices.size();
+    encoded.resize(numVertices * stride);
+    allocation.positionOffset = glm::vec3(0.0f);
+    allocation.positionScale = glm::vec3(1.0f);
+
+    auto normal = [&data] (size_t i) { return i < data.normals.size() ? data.normals[i] : glm::vec3(0.0f); };
+    auto tangent = [&data] (size_t i) { return i < data.tangents.size() ? data.tangents[i] : glm::vec3(0.0f); };
+    auto texCoord = [&data] (size_t i) { return i < data.texCoords.size() ? data.texCoords[i] : glm::vec2(0.0f); };
+
+    if (format == FLOAT) {
+        FloatVertex* vertices = reinterpret_cast<FloatVertex*>(&encoded[0]);
+        for (size_t i = 0; i < numVertices; ++i) {
+            vertices[i].position = data.vertices[i];
+            vertices[i].normal = normal(i);
+            vertices[i].tangent = tangent(i);
+            vertices[i].texCoord = texCoord(i);
+        }
+    } else if (format == PACKED) {
+        PackedVertex* vertices = reinterpret_cast<PackedVertex*>(&encoded[0]);
+        for (size_t i = 0; i < numVertices; ++i) {
+            vertices[i].position = data.vertices[i];
+            vertices[i].normal = packSnorm1010102(normal(i));
+            vertices[i].tangent = packSnorm1010102(tangent(i));
+            vertices[i].texCoord = glm::packHalf2x16(texCoord(i));
+        }
+    } else {
+        glm::vec3 boundsMin = data.vertices.front();
+        glm::vec3 boundsMax = data.vertices.front();
+        for (const glm::vec3& position : data.vertices) {
+            boundsMin = glm::min(boundsMin, position);
+            boundsMax = glm::max(boundsMax, position);
+        }
+        glm::vec3 extent = boundsMax - boundsMin;
+        allocation.positionOffset = boundsMin;
+        allocation.positionScale = extent;
+
+        QuantizedVertex* vertices = reinterpret_cast<QuantizedVertex*>(&encoded[0]);
+        for (size_t i = 0; i < numVertices; ++i) {
+            const glm::vec3& position = data.vertices[i];
+            vertices[i].position[0] = quantizeUnorm16(position.x, boundsMin.x, extent.x);
+            vertices[i].position[1] = quantizeUnorm16(position.y, boundsMin.y, extent.y);
+            vertices[i].position[2] = quantizeUnorm16(position.z, boundsMin.z, extent.z);
+            vertices[i].position[3] = 0;
+            vertices[i].normal = packSnorm1010102(normal(i));
+            vertices[i].tangent = packSnorm1010102(tangent(i));
+            vertices[i].texCoord = glm::packHalf2x16(texCoord(i));
+        }
+    }
+}
+
+void GeometryBuffer::growVertexBuffer(GLuint numVertices)
+{
+    GLuint newCapacity = std::max(vertexCapacity * 2, vertexCapacity + numVertices);
+    vertexBuffer = resizeBuffer(vertexBuffer, static_cast<GLsizeiptr>(vertexCapacity) * stride,
+                                static_cast<GLsizeiptr>(newCapacity) * stride);
+    vertexRanges.grow(vertexCapacity, newCapacity);
+    vertexCapacity = newCapacity;
+    attachBuffers();
+}
+
+void GeometryBuffer::growIndexBuffer(GLuint numUnits)
+{
+    GLuint newCapacity = std::max(indexCapacity * 2, indexCapacity + numUnits);
+    indexBuffer = resizeBuffer(indexBuffer, static_cast<GLsizeiptr>(indexCapacity) * sizeof(GLushort),
+                               static_cast<GLsizeiptr>(newCapacity) * sizeof(GLushort));
+    indexRanges.grow(indexCapacity, newCapacity);
+    indexCapacity = newCapacity;
+    attachBuffers();
+}
+
+GLuint GeometryBuffer::resizeBuffer(GLuint buffer, GLsizeiptr oldSize, GLsizeiptr newSize) const
+{
+    GLuint newBuffer = 0;
+    glGenBuffers(1, &newBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+    if (buffer != 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+        glDeleteBuffers(1, &buffer);
+    }
+    return newBuffer;
+}
+
+void GeometryBuffer::attachBuffers()
+{
+    bind();
+    glBindVertexBuffer(VERTEX_BUFFER_BINDING, vertexBuffer, 0, stride);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+}
+
+} // moar
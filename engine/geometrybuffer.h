@@ -0,0 +1,161 @@
+#ifndef GEOMETRYBUFFER_H
+#define GEOMETRYBUFFER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <memory>
+
+namespace moar
+{
+
+// Coarser level of detail that shares the vertices of the full mesh
+struct MeshLod
+{
+    std::vector<unsigned int> indices;
+    float error; // Object space distance from the full mesh
+};
+
+// Contiguous range of the full mesh indices with bounds for culling parts of the mesh
+struct MeshCluster
+{
+    GLuint firstIndex;
+    GLuint numIndices;
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneAxis;     // Average normal of the triangles
+    float coneCutoff;       // Sine of the cone half angle, 1.0 when the cone can not be culled
+};
+
+struct MeshData
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec3> tangents;
+    std::vector<glm::vec2> texCoords;
+    std::vector<unsigned int> indices;
+    std::vector<MeshLod> lods;
+    std::vector<MeshCluster> clusters;
+};
+
+// Shared vertex and index storage for all meshes of one vertex format. Meshes are suballocated
+// from the buffers and drawn with a base vertex so that the single VAO never has to change.
+// Meshes with up to 65536 vertices get 16 bit indices, the index buffer is managed in 16 bit
+// units and every range is an even number of units long to keep 32 bit indices aligned.
+class GeometryBuffer
+{
+public:
+    enum VertexFormat
+    {
+        FLOAT = 0,      // 44 bytes, full precision for texture coordinates that do not fit half floats
+        PACKED = 1,     // 24 bytes, float positions, 10_10_10_2 normals and tangents, half float UVs
+        QUANTIZED = 2,  // 20 bytes, as packed but with 16 bit positions relative to the mesh bounds
+        NUM_FORMATS = 3
+    };
+
+    struct Lod
+    {
+        GLuint firstIndex;      // Relative to the index range of the allocation
+        GLsizei numIndices;
+    };
+
+    // Indices of all the levels of detail are stored in one range, level 0 is the full mesh
+    struct Allocation
+    {
+        GLint baseVertex;
+        GLuint numVertices;
+        GLuint indexOffset;     // In 16 bit index units
+        GLuint indexUnits;
+        GLenum indexType;
+        std::vector<Lod> lods;
+        glm::vec3 positionOffset;
+        glm::vec3 positionScale;
+        size_t slot;
+    };
+
+    // Layout of glMultiDrawElementsIndirect commands
+    struct DrawCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    static void setPositionQuantization(bool enabled);
+    static VertexFormat selectFormat(const MeshData& data);
+    static void resetBindingCache();
+    // Source of the per instance attributes, can be switched between draws
+    static void setInstanceBuffer(GLuint buffer);
+
+    explicit GeometryBuffer();
+    ~GeometryBuffer();
+    GeometryBuffer(const GeometryBuffer&) = delete;
+    GeometryBuffer(GeometryBuffer&&) = delete;
+    GeometryBuffer& operator=(const GeometryBuffer&) = delete;
+    GeometryBuffer& operator=(GeometryBuffer&&) = delete;
+
+    void setFormat(VertexFormat format);
+    VertexFormat getFormat() const;
+
+    const Allocation* allocate(const MeshData& data);
+    void free(const Allocation* allocation);
+    void compact();
+
+    void bind() const;
+    void draw(const Allocation& allocation, size_t lod, GLuint firstInstance, GLsizei numInstances) const;
+    DrawCommand getDrawCommand(const Allocation& allocation, size_t lod, GLuint firstInstance, GLuint numInstances) const;
+    // Commands are read from the bound GL_DRAW_INDIRECT_BUFFER
+    void drawIndirect(GLenum indexType, GLuint firstCommand, GLsizei numCommands) const;
+
+    GLuint getVertexBuffer() const;
+    GLuint getIndexBuffer() const;
+
+private:
+    struct Range
+    {
+        GLuint offset;
+        GLuint size;
+    };
+
+    // First fit allocator over element offsets, free ranges are kept sorted and merged
+    class RangeAllocator
+    {
+    public:
+        void reset(GLuint capacity);
+        void grow(GLuint oldCapacity, GLuint newCapacity);
+        bool allocate(GLuint size, GLuint& offset);
+        void free(GLuint offset, GLuint size);
+
+    private:
+        std::vector<Range> freeRanges;
+    };
+
+    static bool quantizePositions;
+    static GLuint instanceBuffer;
+
+    void init();
+    void encodeVertices(const MeshData& data, Allocation& allocation, std::vector<unsigned char>& encoded) const;
+    void growVertexBuffer(GLuint numVertices);
+    void growIndexBuffer(GLuint numUnits);
+    GLuint resizeBuffer(GLuint buffer, GLsizeiptr oldSize, GLsizeiptr newSize) const;
+    void attachBuffers();
+
+    VertexFormat format = FLOAT;
+    GLsizei stride = 0;
+    GLuint VAO = 0;
+    mutable GLuint boundInstanceBuffer = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLuint vertexCapacity = 0;
+    GLuint indexCapacity = 0;
+    RangeAllocator vertexRanges;
+    RangeAllocator indexRanges;
+    std::vector<std::unique_ptr<Allocation>> allocations;
+};
+
+} // moar
+
+#endif // GEOMETRYBUFFER_H
@@ -0,0 +1,321 @@
+#include "gpuculler.h"
+#include "instancebuffer.h"
+#include "common/globals.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+namespace moar
+{
+
+namespace
+{
+
+const GLuint CULL_GROUP_SIZE = 64;
+const GLuint PYRAMID_GROUP_SIZE = 8;
+const GLuint NO_COMMAND = 0xFFFFFFFF;
+
+const GLuint INSTANCE_BINDING = 0;
+const GLuint INSTANCE_INFO_BINDING = 1;
+const GLuint COMMAND_INFO_BINDING = 2;
+const GLuint COMMAND_BINDING = 3;
+const GLuint VISIBLE_INSTANCE_BINDING = 4;
+const GLuint VISIBILITY_BINDING = 5;
+const GLuint COMPACTED_COMMAND_BINDING = 6;
+const GLuint DRAW_COUNT_BINDING = 7;
+
+} // anonymous
+
+GpuCuller::GpuCuller()
+{
+}
+
+GpuCuller::~GpuCuller()
+{
+    deinit();
+}
+
+bool GpuCuller::init(GLuint cullProgram, GLuint compactProgram, GLuint depthPyramidProgram)
+{
+    if (cullProgram == 0 || compactProgram == 0 || depthPyramidProgram == 0) {
+        std::cerr << "ERROR: GPU culling shaders are missing\n";
+        return false;
+    }
+    this->cullProgram = cullProgram;
+    this->compactProgram = compactProgram;
+    this->depthPyramidProgram = depthPyramidProgram;
+
+    // Without ARB_indirect_parameters every command of a group is submitted, empty ones included
+    countSupported = GLEW_ARB_indirect_parameters != 0;
+    if (!countSupported) {
+        std::cerr << "WARNING: ARB_indirect_parameters not supported, culled draws are not compacted\n";
+    }
+
+    if (instanceInfoBuffer.name == 0) {
+        glGenBuffers(1, &instanceInfoBuffer.name);
+        glGenBuffers(1, &commandInfoBuffer.name);
+        glGenBuffers(1, &visibilityBuffer.name);
+        for (PhaseBuffers& buffers : phaseBuffers) {
+            glGenBuffers(1, &buffers.commands.name);
+            glGenBuffers(1, &buffers.compactedCommands.name);
+            glGenBuffers(1, &buffers.drawCounts.name);
+            glGenBuffers(1, &buffers.visibleInstances.name);
+        }
+    }
+    return true;
+}
+
+void GpuCuller::setDepthSize(int width, int height)
+{
+    if (depthPyramid != 0) {
+        glDeleteTextures(1, &depthPyramid);
+    }
+    pyramidWidth = std::max(width, 1);
+    pyramidHeight = std::max(height, 1);
+    pyramidLevels = 1;
+    while ((pyramidWidth >> pyramidLevels) > 0 || (pyramidHeight >> pyramidLevels) > 0) {
+        ++pyramidLevels;
+    }
+
+    glGenTextures(1, &depthPyramid);
+    glBindTexture(GL_TEXTURE_2D, depthPyramid);
+    glTexStorage2D(GL_TEXTURE_2D, pyramidLevels, GL_R32F, pyramidWidth, pyramidHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void GpuCuller::clear()
+{
+    groups.clear();
+    commands.clear();
+    commandInfos.clear();
+    instanceInfos.clear();
+}
+
+GLuint GpuCuller::addGroup(const GeometryBuffer* geometryBuffer, GLenum indexType)
+{
+    GLuint firstCommand = static_cast<GLuint>(commands.size());
+    groups.push_back(Group{geometryBuffer, indexType, firstCommand, 0});
+    return static_cast<GLuint>(groups.size() - 1);
+}
+
+void GpuCuller::addCommand(const GeometryBuffer::DrawCommand& command, const glm::vec3& center, float radius)
+{
+    if (groups.empty()) {
+        std::cerr << "WARNING: Culled draw command added without a group\n";
+        return;
+    }
+    Group& group = groups.back();
+    ++group.numCommands;
+    GLuint commandIndex = static_cast<GLuint>(commands.size());
+
+    GLuint endInstance = command.baseInstance + command.instanceCount;
+    if (instanceInfos.size() < endInstance) {
+        instanceInfos.resize(endInstance, glm::uvec2(NO_COMMAND, 0));
+    }
+    for (GLuint instance = command.baseInstance; instance < endInstance; ++instance) {
+        instanceInfos[instance].x = commandIndex;
+    }
+
+    // The instance counts are filled in by the cull shader
+    commands.push_back(command);
+    commands.back().instanceCount = 0;
+    CommandInfo info;
+    info.bounds = glm::vec4(center, radius);
+    info.group = static_cast<GLuint>(groups.size() - 1);
+    info.groupFirst = group.firstCommand;
+    info.padding[0] = 0;
+    info.padding[1] = 0;
+    commandInfos.push_back(info);
+}
+
+void GpuCuller::upload(const std::vector<GLuint>& instanceHistory, size_t numHistory)
+{
+    numInstances = instanceHistory.size();
+    instanceInfos.resize(numInstances, glm::uvec2(NO_COMMAND, 0));
+    for (size_t i = 0; i < numInstances; ++i) {
+        instanceInfos[i].y = instanceHistory[i];
+    }
+    if (numInstances > 0) {
+        writeBuffer(instanceInfoBuffer, numInstances * sizeof(glm::uvec2), &instanceInfos[0]);
+    }
+    if (!commands.empty()) {
+        writeBuffer(commandInfoBuffer, commandInfos.size() * sizeof(CommandInfo), &commandInfos[0]);
+    }
+
+    // Everything counts as visible when the set of objects changes, the second phase corrects it
+    if (numHistory != this->numHistory) {
+        this->numHistory = numHistory;
+        std::vector<GLuint> visibility(std::max(numHistory, size_t(1)), 1);
+        writeBuffer(visibilityBuffer, visibility.size() * sizeof(GLuint), &visibility[0]);
+    }
+
+    std::vector<GLuint> zeroCounts(std::max(groups.size(), size_t(1)), 0);
+    for (PhaseBuffers& buffers : phaseBuffers) {
+        if (!commands.empty()) {
+            writeBuffer(buffers.commands, commands.size() * sizeof(GeometryBuffer::DrawCommand), &commands[0]);
+            writeBuffer(buffers.compactedCommands, commands.size() * sizeof(GeometryBuffer::DrawCommand), nullptr);
+        }
+        writeBuffer(buffers.drawCounts, zeroCounts.size() * sizeof(GLuint), &zeroCounts[0]);
+        writeBuffer(buffers.visibleInstances, std::max(numInstances, size_t(1)) * sizeof(InstanceBuffer::Instance), nullptr);
+    }
+}
+
+void GpuCuller::cull(Phase phase, const glm::mat4& viewProjection, GLuint instanceBuffer)
+{
+    if (commands.empty() || numInstances == 0) {
+        return;
+    }
+    const PhaseBuffers& buffers = phaseBuffers[phase];
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_INFO_BINDING, instanceInfoBuffer.name);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_INFO_BINDING, commandInfoBuffer.name);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, buffers.commands.name);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_INSTANCE_BINDING, buffers.visibleInstances.name);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBILITY_BINDING, visibilityBuffer.name);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMPACTED_COMMAND_BINDING, buffers.compactedCommands.name);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_COUNT_BINDING, buffers.drawCounts.name);
+
+    std::array<glm::vec4, 6> planes;
+    extractFrustumPlanes(viewProjection, planes);
+    glUseProgram(cullProgram);
+    glUniform1ui(CULL_NUM_INSTANCES_LOCATION, static_cast<GLuint>(numInstances));
+    glUniform1i(CULL_PHASE_LOCATION, phase);
+    glUniform2i(DEPTH_PYRAMID_SIZE_LOCATION, pyramidWidth, pyramidHeight);
+    glUniformMatrix4fv(CULL_VIEW_PROJECTION_LOCATION, 1, GL_FALSE, glm::value_ptr(viewProjection));
+    glUniform4fv(CULL_FRUSTUM_PLANES_LOCATION, 6, glm::value_ptr(planes[0]));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depthPyramid);
+    glDispatchCompute((static_cast<GLuint>(numInstances) + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    if (countSupported) {
+        GLuint numCommands = static_cast<GLuint>(commands.size());
+        glUseProgram(compactProgram);
+        glUniform1ui(CULL_NUM_COMMANDS_LOCATION, numCommands);
+        glDispatchCompute((numCommands + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+    }
+}
+
+void GpuCuller::buildDepthPyramid(GLuint depthTexture)
+{
+    if (depthPyramid == 0) {
+        return;
+    }
+    glUseProgram(depthPyramidProgram);
+    glActiveTexture(GL_TEXTURE0);
+
+    int width = pyramidWidth;
+    int height = pyramidHeight;
+    int sourceWidth = pyramidWidth;
+    int sourceHeight = pyramidHeight;
+    for (int level = 0; level < pyramidLevels; ++level) {
+        if (level == 0) {
+            glBindTexture(GL_TEXTURE_2D, depthTexture);
+            glUniform1i(DEPTH_PYRAMID_LEVEL_LOCATION, -1);
+        } else {
+            glBindTexture(GL_TEXTURE_2D, depthPyramid);
+            glUniform1i(DEPTH_PYRAMID_LEVEL_LOCATION, level - 1);
+        }
+        glUniform2i(DEPTH_PYRAMID_SIZE_LOCATION, sourceWidth, sourceHeight);
+        glBindImageTexture(0, depthPyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+                          (height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        sourceWidth = width;
+        sourceHeight = height;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+}
+
+GLuint GpuCuller::getVisibleInstanceBuffer(Phase phase) const
+{
+    return phaseBuffers[phase].visibleInstances.name;
+}
+
+void GpuCuller::draw(Phase phase, GLuint firstGroup, GLuint numGroups) const
+{
+    const PhaseBuffers& buffers = phaseBuffers[phase];
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, countSupported ? buffers.compactedCommands.name : buffers.commands.name);
+    if (countSupported) {
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, buffers.drawCounts.name);
+    }
+
+    for (GLuint i = firstGroup; i < firstGroup + numGroups && i < groups.size(); ++i) {
+        const Group& group = groups[i];
+        if (group.numCommands == 0) {
+            continue;
+        }
+        group.geometryBuffer->bind();
+        const GLvoid* offset = reinterpret_cast<const GLvoid*>(group.firstCommand * sizeof(GeometryBuffer::DrawCommand));
+        if (countSupported) {
+            glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, group.indexType, offset, i * sizeof(GLuint),
+                                                group.numCommands, 0);
+        } else {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, group.indexType, offset, group.numCommands, 0);
+        }
+        ++G_DRAW_COUNT;
+    }
+}
+
+void GpuCuller::deinit()
+{
+    if (instanceInfoBuffer.name != 0) {
+        glDeleteBuffers(1, &instanceInfoBuffer.name);
+        glDeleteBuffers(1, &commandInfoBuffer.name);
+        glDeleteBuffers(1, &visibilityBuffer.name);
+        for (PhaseBuffers& buffers : phaseBuffers) {
+            glDeleteBuffers(1, &buffers.commands.name);
+            glDeleteBuffers(1, &buffers.compactedCommands.name);
+            glDeleteBuffers(1, &buffers.drawCounts.name);
+            glDeleteBuffers(1, &buffers.visibleInstances.name);
+        }
+        instanceInfoBuffer = Buffer();
+        commandInfoBuffer = Buffer();
+        visibilityBuffer = Buffer();
+        phaseBuffers.fill(PhaseBuffers());
+    }
+    if (depthPyramid != 0) {
+        glDeleteTextures(1, &depthPyramid);
+        depthPyramid = 0;
+    }
+}
+
+void GpuCuller::writeBuffer(Buffer& buffer, GLsizeiptr size, const void* data)
+{
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.name);
+    if (size > buffer.capacity) {
+        // Half again as large so that a slowly growing scene does not reallocate every frame
+        buffer.capacity = std::max(size, buffer.capacity + buffer.capacity / 2);
+        glBufferData(GL_COPY_WRITE_BUFFER, buffer.capacity, nullptr, GL_DYNAMIC_DRAW);
+    }
+    if (data) {
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, data);
+    }
+}
+
+void GpuCuller::extractFrustumPlanes(const glm::mat4& viewProjection, std::array<glm::vec4, 6>& planes) const
+{
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; ++i) {
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    }
+    planes[0] = rows[3] + rows[0];
+    planes[1] = rows[3] - rows[0];
+    planes[2] = rows[3] + rows[1];
+    planes[3] = rows[3] - rows[1];
+    planes[4] = rows[3] + rows[2];
+    planes[5] = rows[3] - rows[2];
+    for (glm::vec4& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+} // moar
@@ -0,0 +1,115 @@
+#ifndef GPUCULLER_H
+#define GPUCULLER_H
+
+#include "geometrybuffer.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <array>
+#include <cstddef>
+
+namespace moar
+{
+
+// Frustum and occlusion culling of the instances on the GPU. The visible instances are copied
+// into per phase buffers and counted into indirect draw commands, so the CPU never reads back.
+// Objects visible in the previous frame are drawn in the first phase, the depth pyramid is
+// built from the result and the remaining objects are tested against it in the second phase.
+class GpuCuller
+{
+public:
+    enum Phase
+    {
+        PREVIOUSLY_VISIBLE = 0,
+        NEWLY_VISIBLE = 1,
+        NUM_PHASES = 2
+    };
+
+    // Commands drawn with one multi draw call, they share the material, vertex format and index type
+    struct Group
+    {
+        const GeometryBuffer* geometryBuffer;
+        GLenum indexType;
+        GLuint firstCommand;
+        GLsizei numCommands;
+    };
+
+    explicit GpuCuller();
+    ~GpuCuller();
+    GpuCuller(const GpuCuller&) = delete;
+    GpuCuller(GpuCuller&&) = delete;
+    GpuCuller& operator=(const GpuCuller&) = delete;
+    GpuCuller& operator=(GpuCuller&&) = delete;
+
+    bool init(GLuint cullProgram, GLuint compactProgram, GLuint depthPyramidProgram);
+    void setDepthSize(int width, int height);
+
+    void clear();
+    GLuint addGroup(const GeometryBuffer* geometryBuffer, GLenum indexType);
+    // The instances of the command are expected to be consecutive in the instance buffer
+    void addCommand(const GeometryBuffer::DrawCommand& command, const glm::vec3& center, float radius);
+    // History indices identify the objects across frames, numHistory is the number of objects
+    void upload(const std::vector<GLuint>& instanceHistory, size_t numHistory);
+
+    void cull(Phase phase, const glm::mat4& viewProjection, GLuint instanceBuffer);
+    void buildDepthPyramid(GLuint depthTexture);
+    GLuint getVisibleInstanceBuffer(Phase phase) const;
+    void draw(Phase phase, GLuint firstGroup, GLuint numGroups) const;
+
+private:
+    struct CommandInfo
+    {
+        glm::vec4 bounds;
+        GLuint group;
+        GLuint groupFirst;
+        GLuint padding[2];
+    };
+
+    // Storage only grows, later frames write into the existing allocation
+    struct Buffer
+    {
+        GLuint name = 0;
+        GLsizeiptr capacity = 0;
+    };
+
+    struct PhaseBuffers
+    {
+        Buffer commands;
+        Buffer compactedCommands;
+        Buffer drawCounts;
+        Buffer visibleInstances;   // Every instance may pass, so this is sized for all of them
+    };
+
+    void deinit();
+    // Without data the buffer is only grown to the size
+    void writeBuffer(Buffer& buffer, GLsizeiptr size, const void* data);
+    void extractFrustumPlanes(const glm::mat4& viewProjection, std::array<glm::vec4, 6>& planes) const;
+
+    GLuint cullProgram = 0;
+    GLuint compactProgram = 0;
+    GLuint depthPyramidProgram = 0;
+    bool countSupported = false;
+
+    Buffer instanceInfoBuffer;
+    Buffer commandInfoBuffer;
+    Buffer visibilityBuffer;
+    std::array<PhaseBuffers, NUM_PHASES> phaseBuffers;
+    size_t numHistory = 0;
+    size_t numInstances = 0;
+
+    GLuint depthPyramid = 0;
+    int pyramidWidth = 0;
+    int pyramidHeight = 0;
+    int pyramidLevels = 0;
+
+    std::vector<Group> groups;
+    std::vector<GeometryBuffer::DrawCommand> commands;
+    std::vector<CommandInfo> commandInfos;
+    std::vector<glm::uvec2> instanceInfos;
+};
+
+} // moar
+
+#endif // GPUCULLER_H
@@ -0,0 +1,127 @@
+#ifndef HANDLEPOOL_H
+#define HANDLEPOOL_H
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+namespace moar
+{
+
+// Index of a slot and the generation of the slot when the resource was added. Freeing a slot
+// increments its generation, so a handle that outlives its resource no longer resolves.
+template<typename T>
+struct Handle
+{
+    static const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+    uint32_t index = INVALID_INDEX;
+    uint32_t generation = 0;
+
+    bool isValid() const { return index != INVALID_INDEX; }
+    bool operator==(const Handle& rhs) const { return index == rhs.index && generation == rhs.generation; }
+    bool operator!=(const Handle& rhs) const { return !(*this == rhs); }
+    bool operator<(const Handle& rhs) const
+    {
+        return index != rhs.index ? index < rhs.index : generation < rhs.generation;
+    }
+};
+
+// Owns resources in dense slots addressed by handles. Freed slots are reused by later resources.
+template<typename T>
+class HandlePool
+{
+public:
+    explicit HandlePool() {}
+    ~HandlePool() {}
+    HandlePool(const HandlePool&) = delete;
+    HandlePool(HandlePool&&) = delete;
+    HandlePool& operator=(const HandlePool&) = delete;
+    HandlePool& operator=(HandlePool&&) = delete;
+
+    Handle<T> add(std::unique_ptr<T> resource);
+    // Returns nullptr for a stale or invalid handle
+    T* get(Handle<T> handle) const;
+    bool remove(Handle<T> handle);
+    // Frees all the resources at once, every handle given out so far becomes stale
+    void clear();
+
+    template<typename F>
+    void forEach(F function) const;
+
+private:
+    struct Slot
+    {
+        std::unique_ptr<T> resource;
+        uint32_t generation;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+};
+
+template<typename T>
+Handle<T> HandlePool<T>::add(std::unique_ptr<T> resource)
+{
+    Handle<T> handle;
+    if (freeSlots.empty()) {
+        handle.index = static_cast<uint32_t>(slots.size());
+        slots.push_back(Slot{std::move(resource), 1});
+    } else {
+        handle.index = freeSlots.back();
+        freeSlots.pop_back();
+        slots[handle.index].resource = std::move(resource);
+    }
+    handle.generation = slots[handle.index].generation;
+    return handle;
+}
+
+template<typename T>
+T* HandlePool<T>::get(Handle<T> handle) const
+{
+    if (handle.index >= slots.size() || slots[handle.index].generation != handle.generation) {
+        return nullptr;
+    }
+    return slots[handle.index].resource.get();
+}
+
+template<typename T>
+bool HandlePool<T>::remove(Handle<T> handle)
+{
+    if (!get(handle)) {
+        return false;
+    }
+    Slot& slot = slots[handle.index];
+    slot.resource.reset();
+    ++slot.generation;
+    freeSlots.push_back(handle.index);
+    return true;
+}
+
+template<typename T>
+void HandlePool<T>::clear()
+{
+    freeSlots.clear();
+    for (uint32_t i = 0; i < slots.size(); ++i) {
+        if (slots[i].resource) {
+            slots[i].resource.reset();
+            ++slots[i].generation;
+        }
+        freeSlots.push_back(i);
+    }
+}
+
+template<typename T>
+template<typename F>
+void HandlePool<T>::forEach(F function) const
+{
+    for (const Slot& slot : slots) {
+        if (slot.resource) {
+            function(slot.resource.get());
+        }
+    }
+}
+
+} // moar
+
+#endif // HANDLEPOOL_H
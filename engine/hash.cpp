@@ -0,0 +1,23 @@
+#include "hash.h"
+
+namespace moar
+{
+
+namespace
+{
+
+const uint64_t FNV_PRIME = 1099511628211ull;
+
+} // anonymous
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+} // moar
@@ -0,0 +1,17 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace moar
+{
+
+const uint64_t HASH_SEED = 14695981039346656037ull;
+
+// FNV-1a, chain calls by passing the previous result as the seed
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = HASH_SEED);
+
+} // moar
+
+#endif // HASH_H
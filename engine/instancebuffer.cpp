@@ -0,0 +1,82 @@
+#include "instancebuffer.h"
+
+#include <algorithm>
+
+namespace moar
+{
+
+namespace
+{
+
+const size_t INITIAL_INSTANCE_CAPACITY = 4096;
+
+} // anonymous
+
+InstanceBuffer::InstanceBuffer()
+{
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+    if (buffer != 0) {
+        glDeleteBuffers(1, &buffer);
+    }
+}
+
+void InstanceBuffer::init()
+{
+    if (buffer != 0) {
+        return;
+    }
+    glGenBuffers(1, &buffer);
+    capacity = INITIAL_INSTANCE_CAPACITY;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity * sizeof(Instance), nullptr, GL_STREAM_DRAW);
+}
+
+GLuint InstanceBuffer::getBuffer() const
+{
+    return buffer;
+}
+
+void InstanceBuffer::clear()
+{
+    instances.clear();
+    numUploaded = 0;
+}
+
+GLuint InstanceBuffer::add(const Instance& instance)
+{
+    instances.push_back(instance);
+    return static_cast<GLuint>(instances.size() - 1);
+}
+
+void InstanceBuffer::upload()
+{
+    // Respecifying the storage orphans the data of the previous frame instead of waiting for it.
+    // The buffer name stays the same, so the vertex arrays do not need to be rebound.
+    capacity = std::max(capacity, instances.size());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity * sizeof(Instance), nullptr, GL_STREAM_DRAW);
+    if (!instances.empty()) {
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, instances.size() * sizeof(Instance), &instances[0]);
+    }
+    numUploaded = instances.size();
+}
+
+GLuint InstanceBuffer::addImmediate(const Instance& instance)
+{
+    GLuint index = add(instance);
+    if (instances.size() > capacity) {
+        capacity = std::max(capacity * 2, instances.size());
+        upload();
+    } else {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, numUploaded * sizeof(Instance),
+                        (instances.size() - numUploaded) * sizeof(Instance), &instances[numUploaded]);
+        numUploaded = instances.size();
+    }
+    return index;
+}
+
+} // moar
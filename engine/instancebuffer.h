@@ -0,0 +1,53 @@
+#ifndef INSTANCEBUFFER_H
+#define INSTANCEBUFFER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+
+namespace moar
+{
+
+// Per instance transforms of one frame. Every mesh draw reads its transforms from here
+// through instanced vertex attributes, so single objects are drawn as one instance.
+class InstanceBuffer
+{
+public:
+    // Matches the std430 layout used by the culling compute shader
+    struct Instance
+    {
+        glm::mat4 model;
+        glm::mat4 normal;
+        glm::vec4 positionOffset;   // Dequantization of the mesh positions, w is the bindless material index
+        glm::vec4 positionScale;
+    };
+
+    explicit InstanceBuffer();
+    ~InstanceBuffer();
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer(InstanceBuffer&&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(InstanceBuffer&&) = delete;
+
+    void init();
+    GLuint getBuffer() const;
+
+    void clear();
+    GLuint add(const Instance& instance);
+    // Uploads all the instances added since the last clear in one go
+    void upload();
+    // For objects whose transform changes between draws within the frame
+    GLuint addImmediate(const Instance& instance);
+
+private:
+    GLuint buffer = 0;
+    size_t capacity = 0;
+    size_t numUploaded = 0;
+    std::vector<Instance> instances;
+};
+
+} // moar
+
+#endif // INSTANCEBUFFER_H
@@ -0,0 +1,248 @@
+#include "jobsystem.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace moar
+{
+
+namespace
+{
+
+thread_local unsigned int currentQueueIndex = 0;
+
+} // anonymous
+
+JobSystem::TaskGraph::TaskGraph()
+{
+}
+
+JobSystem::TaskGraph::~TaskGraph()
+{
+}
+
+JobSystem::TaskGraph::TaskId JobSystem::TaskGraph::addTask(const Job& job)
+{
+    std::unique_ptr<Node> node(new Node());
+    node->job = job;
+    node->numDependencies = 0;
+    node->pending = 0;
+    nodes.push_back(std::move(node));
+    return static_cast<TaskId>(nodes.size() - 1);
+}
+
+void JobSystem::TaskGraph::addDependency(TaskId task, TaskId dependency)
+{
+    if (task >= nodes.size() || dependency >= nodes.size() || task == dependency) {
+        std::cerr << "WARNING: Invalid task graph dependency " << task << " -> " << dependency << "\n";
+        return;
+    }
+    nodes[dependency]->successors.push_back(task);
+    ++nodes[task]->numDependencies;
+}
+
+void JobSystem::TaskGraph::clear()
+{
+    nodes.clear();
+}
+
+JobSystem::JobSystem() :
+    numQueuedTasks(0),
+    running(false)
+{
+    queues.emplace_back(new WorkQueue());
+}
+
+JobSystem::~JobSystem()
+{
+    shutdown();
+}
+
+void JobSystem::init(unsigned int numWorkers)
+{
+    shutdown();
+
+    currentQueueIndex = 0;
+    running = true;
+    for (unsigned int i = 0; i < numWorkers; ++i) {
+        queues.emplace_back(new WorkQueue());
+    }
+    for (unsigned int i = 1; i <= numWorkers; ++i) {
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+    std::cout << "Job system started with " << numWorkers << " worker threads\n";
+}
+
+void JobSystem::shutdown()
+{
+    if (!running) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running = false;
+    }
+    sleepCondition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+
+    // Finish whatever is left on the calling thread so that no counter is left hanging
+    while (executeNextTask(currentQueueIndex)) {
+    }
+    queues.resize(1);
+}
+
+void JobSystem::run(const Job& job, Counter* counter)
+{
+    if (counter) {
+        counter->fetch_add(1);
+    }
+
+    WorkQueue& queue = *queues[std::min<size_t>(currentQueueIndex, queues.size() - 1)];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(Task{job, counter});
+    }
+    ++numQueuedTasks;
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    sleepCondition.notify_one();
+}
+
+void JobSystem::wait(const Counter& counter)
+{
+    while (counter.load() > 0) {
+        if (!executeNextTask(currentQueueIndex)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::parallelFor(unsigned int begin, unsigned int end, unsigned int grainSize, const RangeJob& job)
+{
+    if (end <= begin) {
+        return;
+    }
+
+    grainSize = std::max(grainSize, 1u);
+    if (workers.empty() || end - begin <= grainSize) {
+        job(begin, end);
+        return;
+    }
+
+    Counter counter(0);
+    unsigned int chunkBegin = begin;
+    while (end - chunkBegin > grainSize) {
+        unsigned int chunkEnd = chunkBegin + grainSize;
+        run([&job, chunkBegin, chunkEnd] { job(chunkBegin, chunkEnd); }, &counter);
+        chunkBegin = chunkEnd;
+    }
+    job(chunkBegin, end);
+    wait(counter);
+}
+
+void JobSystem::execute(TaskGraph& graph)
+{
+    std::vector<TaskGraph::TaskId> roots;
+    for (TaskGraph::TaskId id = 0; id < graph.nodes.size(); ++id) {
+        TaskGraph::Node& node = *graph.nodes[id];
+        node.pending = node.numDependencies;
+        if (node.numDependencies == 0) {
+            roots.push_back(id);
+        }
+    }
+
+    if (roots.empty() && !graph.nodes.empty()) {
+        std::cerr << "ERROR: Task graph has no root tasks, can not execute\n";
+        return;
+    }
+
+    Counter counter(0);
+    for (TaskGraph::TaskId id : roots) {
+        runGraphNode(graph, id, &counter);
+    }
+    wait(counter);
+}
+
+unsigned int JobSystem::getNumWorkers() const
+{
+    return static_cast<unsigned int>(workers.size());
+}
+
+void JobSystem::workerLoop(unsigned int queueIndex)
+{
+    currentQueueIndex = queueIndex;
+    while (running) {
+        if (executeNextTask(queueIndex)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepCondition.wait(lock, [this] { return !running || numQueuedTasks > 0; });
+    }
+}
+
+bool JobSystem::popTask(unsigned int queueIndex, Task& task)
+{
+    WorkQueue& queue = *queues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool JobSystem::stealTask(unsigned int queueIndex, Task& task)
+{
+    size_t numQueues = queues.size();
+    for (size_t i = 1; i < numQueues; ++i) {
+        WorkQueue& queue = *queues[(queueIndex + i) % numQueues];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobSystem::executeNextTask(unsigned int queueIndex)
+{
+    if (numQueuedTasks.load() <= 0) {
+        return false;
+    }
+
+    Task task;
+    if (!popTask(queueIndex, task) && !stealTask(queueIndex, task)) {
+        return false;
+    }
+    --numQueuedTasks;
+
+    task.job();
+    if (task.counter) {
+        task.counter->fetch_sub(1);
+    }
+    return true;
+}
+
+void JobSystem::runGraphNode(TaskGraph& graph, TaskGraph::TaskId id, Counter* counter)
+{
+    run([this, &graph, id, counter] {
+        TaskGraph::Node& node = *graph.nodes[id];
+        node.job();
+        for (TaskGraph::TaskId successor : node.successors) {
+            if (graph.nodes[successor]->pending.fetch_sub(1) == 1) {
+                runGraphNode(graph, successor, counter);
+            }
+        }
+    }, counter);
+}
+
+} // moar
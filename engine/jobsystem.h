@@ -0,0 +1,100 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace moar
+{
+
+class JobSystem
+{
+public:
+    using Job = std::function<void()>;
+    using RangeJob = std::function<void(unsigned int, unsigned int)>;
+    using Counter = std::atomic<int>;
+
+    class TaskGraph
+    {
+        friend class JobSystem;
+
+    public:
+        using TaskId = unsigned int;
+
+        explicit TaskGraph();
+        ~TaskGraph();
+        TaskGraph(const TaskGraph&) = delete;
+        TaskGraph(TaskGraph&&) = delete;
+        TaskGraph& operator=(const TaskGraph&) = delete;
+        TaskGraph& operator=(TaskGraph&&) = delete;
+
+        TaskId addTask(const Job& job);
+        void addDependency(TaskId task, TaskId dependency);
+        void clear();
+
+    private:
+        struct Node
+        {
+            Job job;
+            std::vector<TaskId> successors;
+            int numDependencies;
+            std::atomic<int> pending;
+        };
+
+        std::vector<std::unique_ptr<Node>> nodes;
+    };
+
+    explicit JobSystem();
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem(JobSystem&&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+    JobSystem& operator=(JobSystem&&) = delete;
+
+    void init(unsigned int numWorkers);
+    void shutdown();
+
+    void run(const Job& job, Counter* counter = nullptr);
+    void wait(const Counter& counter);
+    void parallelFor(unsigned int begin, unsigned int end, unsigned int grainSize, const RangeJob& job);
+    void execute(TaskGraph& graph);
+
+    unsigned int getNumWorkers() const;
+
+private:
+    struct Task
+    {
+        Job job;
+        Counter* counter;
+    };
+
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(unsigned int queueIndex);
+    bool popTask(unsigned int queueIndex, Task& task);
+    bool stealTask(unsigned int queueIndex, Task& task);
+    bool executeNextTask(unsigned int queueIndex);
+    void runGraphNode(TaskGraph& graph, TaskGraph::TaskId id, Counter* counter);
+
+    // Queue 0 belongs to the thread that calls init(), the rest to the workers
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<int> numQueuedTasks;
+    std::atomic<bool> running;
+};
+
+} // moar
+
+#endif // JOBSYSTEM_H
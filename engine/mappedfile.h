@@ -0,0 +1,39 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+namespace moar
+{
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+public:
+    explicit MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    const unsigned char* getData() const;
+    size_t getSize() const;
+
+private:
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#else
+    int descriptor = -1;
+#endif
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+} // moar
+
+#endif // MAPPEDFILE_H
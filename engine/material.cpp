@@ -7,7 +7,7 @@
 namespace moar
 {
 
-int Material::idCounter = 0;
+const HandlePool<Material>* Material::pool = nullptr;
 
 const Material::TextureInfo Material::textureInfos[] =
 {
@@ -17,9 +17,13 @@ const Material::TextureInfo Material::textureInfos[] =
     {Material::TextureType::BUMP, "bumpTex", GL_TEXTURE4, 4, BUMP_TEX_LOCATION},
 };
 
+Material* Material::get(Handle<Material> handle)
+{
+    return pool ? pool->get(handle) : nullptr;
+}
+
 Material::Material()
 {
-    id = ++idCounter;
 }
 
 Material::~Material()
@@ -34,6 +38,7 @@ void Material::setShaderType(int shaderType)
 
 void Material::setTexture(GLuint texture, TextureType type, GLenum target)
 {    
+    textureHandles[type] = 0;
     for (unsigned int i = 0; i < textures.size(); ++i) {
         if (textures[i].info->type == type) {
             textures[i].glId = texture;
@@ -46,12 +51,29 @@ void Material::setTexture(GLuint texture, TextureType type, GLenum target)
     textures.push_back(materialTex);
 }
 
-void Material::setCustomUniform(const std::string& name, std::function<void ()> func, GLuint location)
+void Material::replaceTexture(GLuint oldTexture, GLuint newTexture)
+{
+    for (auto& texture : textures) {
+        if (texture.glId == oldTexture) {
+            texture.glId = newTexture;
+            textureHandles[texture.info->type] = 0;
+        }
+    }
+}
+
+ParameterBlock* Material::createParameters(GLuint program)
+{
+    parameters.reset(new ParameterBlock());
+    if (!parameters->init(program)) {
+        std::cerr << "WARNING: Program has no parameter block for material " << handle.index << "\n";
+        parameters.reset();
+    }
+    return parameters.get();
+}
+
+ParameterBlock* Material::getParameters() const
 {
-    CustomUniform uniform;
-    uniform.func = func;
-    uniform.location = location;
-    customUniforms[name] = uniform;
+    return parameters.get();
 }
 
 int Material::getShaderType() const
@@ -59,9 +81,14 @@ int Material::getShaderType() const
     return shaderType;
 }
 
-int Material::getId() const
+void Material::setHandle(Handle<Material> handle)
+{
+    this->handle = handle;
+}
+
+Handle<Material> Material::getHandle() const
 {
-    return id;
+    return handle;
 }
 
 unsigned int Material::getNumTextures() const
@@ -77,7 +104,7 @@ void Material::checkMissingTextures() const
                 return;
             }
         }
-        std::cerr << "WARNING: Texture type " << textureType << " missing from material with id " << id << "\n";
+        std::cerr << "WARNING: Texture type " << textureType << " missing from material " << handle.index << "\n";
     };
 
     for (const auto& tm : TEXTURE_TYPE_MAPPINGS) {
@@ -97,11 +124,24 @@ void Material::setUniforms(const Shader* shader)
         }
     }
 
-    for (auto iter = customUniforms.begin(); iter != customUniforms.end(); ++iter) {
-        if (shader->hasUniform(iter->second.location)) {
-            iter->second.func();
+    if (parameters) {
+        parameters->bind();
+    }
+}
+
+const std::array<GLuint64, Material::NUM_TEXTURE_TYPES>& Material::getTextureHandles()
+{
+    for (const auto& texture : textures) {
+        GLuint64& handle = textureHandles[texture.info->type];
+        if (handle == 0 && texture.glId != 0 && texture.target == GL_TEXTURE_2D) {
+            // Textures are shared between materials, the handle of a texture is always the same
+            handle = glGetTextureHandleARB(texture.glId);
+            if (!glIsTextureHandleResidentARB(handle)) {
+                glMakeTextureHandleResidentARB(handle);
+            }
         }
     }
+    return textureHandles;
 }
 
 const Material::TextureInfo* Material::getTextureInfo(TextureType type)
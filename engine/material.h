@@ -2,13 +2,15 @@
 #define MATERIAL_H
 
 #include "shader.h"
+#include "parameterblock.h"
+#include "handlepool.h"
 
 #include <GL/glew.h>
 
 #include <string>
 #include <vector>
-#include <functional>
-#include <unordered_map>
+#include <array>
+#include <memory>
 
 namespace moar
 {
@@ -16,6 +18,7 @@ namespace moar
 class Material
 {
     friend class Renderer;
+    friend class ResourceManager;
 
 public:
     enum TextureType
@@ -23,7 +26,8 @@ public:
         DIFFUSE,
         SPECULAR,
         NORMAL,
-        BUMP
+        BUMP,
+        NUM_TEXTURE_TYPES
     };
 
     explicit Material();
@@ -35,21 +39,22 @@ public:
 
     void setShaderType(int shaderType);
     void setTexture(GLuint texture, TextureType type, GLenum target);
-    void setCustomUniform(const std::string& name, std::function<void()> func, GLuint location);
+    // For textures whose storage was reallocated under a new name
+    void replaceTexture(GLuint oldTexture, GLuint newTexture);
+    // Parameters are laid out by the ParameterBlock of the program, nullptr if it has none
+    ParameterBlock* createParameters(GLuint program);
+    ParameterBlock* getParameters() const;
+
+    // Returns nullptr once the material has been freed
+    static Material* get(Handle<Material> handle);
 
     int getShaderType() const;
-    int getId() const;
+    Handle<Material> getHandle() const;
     unsigned int getNumTextures() const;
 
     void checkMissingTextures() const;
 
 private:
-    struct CustomUniform
-    {
-        GLuint location;
-        std::function<void()> func;
-    };
-
     struct TextureInfo
     {
         TextureType type;
@@ -67,16 +72,20 @@ private:
     };
 
     static const TextureInfo textureInfos[];
-    static int idCounter;
+    static const HandlePool<Material>* pool;   // Set by the resource manager that owns it
 
+    void setHandle(Handle<Material> handle);
     void setUniforms(const Shader* shader);
+    // Bindless handles of the 2D textures by type, made resident when first asked for
+    const std::array<GLuint64, NUM_TEXTURE_TYPES>& getTextureHandles();
     const TextureInfo* getTextureInfo(TextureType type);
 
     int shaderType = Shader::UNDEFINED;
     std::vector<MaterialTexture> textures;
-    std::unordered_map<std::string, CustomUniform> customUniforms;
+    std::unique_ptr<ParameterBlock> parameters;
+    std::array<GLuint64, NUM_TEXTURE_TYPES> textureHandles = {};
 
-    int id;
+    Handle<Material> handle;
 };
 
 } // moar
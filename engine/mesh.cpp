@@ -2,30 +2,35 @@
 #include "common/globals.h"
 
 #include <algorithm>
+#include <utility>
+#include <cmath>
 
 namespace moar
 {
 
+namespace
+{
+
+const float OCCLUDER_MAX_ERROR = 0.01f; // Relative to the bounding radius
+
+} // anonymous
+
 unsigned int Mesh::idCounter = 0;
+Mesh::GeometryBuffers* Mesh::geometryBuffers = nullptr;
 
 Mesh::Mesh() :
     id(++idCounter)
 {
-    glGenVertexArrays(1, &VAO);    
-    glBindVertexArray(VAO);
 }
 
 Mesh::~Mesh()
 {
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &indexBuffer);
-    glDeleteBuffers(1, &normalBuffer);
-    glDeleteBuffers(1, &tangentBuffer);
-    glDeleteBuffers(1, &texBuffer);
-    glDeleteVertexArrays(1, &VAO);
+    if (allocation) {
+        geometryBuffer->free(allocation);
+    }
 }
 
-Material* Mesh::getMaterial() const
+Handle<Material> Mesh::getMaterial() const
 {
     return material;
 }
@@ -45,63 +50,152 @@ float Mesh::getBoundingRadius() const
     return boundingRadius;
 }
 
-void Mesh::setIndices(const std::vector<unsigned int>& indices)
+size_t Mesh::getLodCount() const
 {
-    numIndices = indices.size();
-    glGenBuffers(1, &indexBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * numIndices, &indices[0], GL_STATIC_DRAW);
+    return allocation ? allocation->lods.size() : 1;
 }
 
-void Mesh::setVertices(const std::vector<glm::vec3>& vertices)
+float Mesh::getLodError(size_t lod) const
 {
-    setBufferData<glm::vec3>(vertexBuffer, vertices, VERTEX_LOCATION, 3);
+    return lod == 0 || lod > lodErrors.size() ? 0.0f : lodErrors[lod - 1];
 }
 
-void Mesh::setTextureCoordinates(const std::vector<glm::vec2>& coords)
+float Mesh::getUvDensity() const
 {
-    setBufferData<glm::vec2>(texBuffer, coords, TEX_LOCATION, 2);
+    return uvDensity;
 }
 
-void Mesh::setNormals(const std::vector<glm::vec3>& normals)
+void Mesh::setData(MeshData&& meshData, GeometryBuffer::VertexFormat format)
+{
+    data = std::move(meshData);
+    dataReleased = false;
+    lodErrors.clear();
+    for (const MeshLod& lod : data.lods) {
+        lodErrors.push_back(lod.error);
+    }
+    if (allocation) {
+        geometryBuffer->free(allocation);
+    }
+    geometryBuffer = &(*geometryBuffers)[format];
+    allocation = geometryBuffer->allocate(data);
+
+    calculateBounds();
+    calculateUvDensity();
+}
+
+const MeshData& Mesh::getData() const
 {
-    setBufferData<glm::vec3>(normalBuffer, normals, NORMAL_LOCATION, 3);
+    return data;
+}
+
+void Mesh::releaseData(bool keepOccluder)
+{
+    if (dataReleased) {
+        return;
+    }
+    // Without levels the occluder indices are the proxy itself
+    std::vector<unsigned int> occluderIndices;
+    if (keepOccluder) {
+        occluderIndices = getOccluderIndices();
+    } else {
+        std::vector<glm::vec3>().swap(data.vertices);
+    }
+    data.indices.swap(occluderIndices);
+    std::vector<glm::vec3>().swap(data.normals);
+    std::vector<glm::vec3>().swap(data.tangents);
+    std::vector<glm::vec2>().swap(data.texCoords);
+    std::vector<MeshLod>().swap(data.lods);
+    dataReleased = true;
 }
 
-void Mesh::setTangents(const std::vector<glm::vec3>& tangents)
+bool Mesh::hasData() const
 {
-    setBufferData<glm::vec3>(tangentBuffer, tangents, TANGENT_LOCATION, 3);
+    return !dataReleased;
 }
 
-void Mesh::setMaterial(Material* material)
+const std::vector<unsigned int>& Mesh::getOccluderIndices() const
+{
+    // The coarsest level that stays close to the surface, a proxy bulging out would hide visible objects
+    const std::vector<unsigned int>* indices = &data.indices;
+    for (const MeshLod& lod : data.lods) {
+        if (lod.error > boundingRadius * OCCLUDER_MAX_ERROR) {
+            break;
+        }
+        indices = &lod.indices;
+    }
+    return *indices;
+}
+
+void Mesh::setMaterial(Handle<Material> material)
 {
     this->material = material;
 }
 
-void Mesh::render() const
+void Mesh::render(size_t lod, GLuint firstInstance, GLsizei numInstances) const
 {
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, 0);
+    if (!allocation) {
+        return;
+    }
+    geometryBuffer->draw(*allocation, lod, firstInstance, numInstances);
     ++G_DRAW_COUNT;
 }
 
-void Mesh::checkBoundingBoxLimits(const glm::vec3& vert)
+void Mesh::renderIndirect(GLuint firstCommand, GLsizei numCommands) const
 {
-    boundingBoxMax.x = std::max(vert.x, boundingBoxMax.x);
-    boundingBoxMax.y = std::max(vert.y, boundingBoxMax.y);
-    boundingBoxMax.z = std::max(vert.z, boundingBoxMax.z);
-
-    boundingBoxMin.x = std::min(vert.x, boundingBoxMin.x);
-    boundingBoxMin.y = std::min(vert.y, boundingBoxMin.y);
-    boundingBoxMin.z = std::min(vert.z, boundingBoxMin.z);
+    if (!allocation) {
+        return;
+    }
+    geometryBuffer->drawIndirect(allocation->indexType, firstCommand, numCommands);
+    ++G_DRAW_COUNT;
 }
 
-void Mesh::calculateCenterPointAndRadius()
+void Mesh::calculateBounds()
 {
+    if (data.vertices.empty()) {
+        return;
+    }
+
+    // Start from the first vertex so that meshes away from the origin get a tight box
+    boundingBoxMax = data.vertices.front();
+    boundingBoxMin = data.vertices.front();
+    for (const glm::vec3& vert : data.vertices) {
+        boundingBoxMax.x = std::max(vert.x, boundingBoxMax.x);
+        boundingBoxMax.y = std::max(vert.y, boundingBoxMax.y);
+        boundingBoxMax.z = std::max(vert.z, boundingBoxMax.z);
+
+        boundingBoxMin.x = std::min(vert.x, boundingBoxMin.x);
+        boundingBoxMin.y = std::min(vert.y, boundingBoxMin.y);
+        boundingBoxMin.z = std::min(vert.z, boundingBoxMin.z);
+    }
+
     centerPoint.x = (boundingBoxMax.x + boundingBoxMin.x) / 2.0f;
     centerPoint.y = (boundingBoxMax.y + boundingBoxMin.y) / 2.0f;
     centerPoint.z = (boundingBoxMax.z + boundingBoxMin.z) / 2.0f;
-    boundingRadius = std::max(glm::distance(centerPoint, boundingBoxMax), glm::distance(centerPoint, boundingBoxMax));
+    boundingRadius = std::max(glm::distance(centerPoint, boundingBoxMax), glm::distance(centerPoint, boundingBoxMin));
+}
+
+void Mesh::calculateUvDensity()
+{
+    uvDensity = 0.0f;
+    if (data.texCoords.size() != data.vertices.size()) {
+        return;
+    }
+
+    // Ratio of the areas covered in texture and world space, mirrored and tiled UVs count fully
+    float worldArea = 0.0f;
+    float uvArea = 0.0f;
+    for (size_t i = 0; i + 2 < data.indices.size(); i += 3) {
+        unsigned int i0 = data.indices[i];
+        unsigned int i1 = data.indices[i + 1];
+        unsigned int i2 = data.indices[i + 2];
+        worldArea += glm::length(glm::cross(data.vertices[i1] - data.vertices[i0], data.vertices[i2] - data.vertices[i0]));
+        glm::vec2 uv1 = data.texCoords[i1] - data.texCoords[i0];
+        glm::vec2 uv2 = data.texCoords[i2] - data.texCoords[i0];
+        uvArea += std::abs(uv1.x * uv2.y - uv1.y * uv2.x);
+    }
+    if (worldArea > 0.0f) {
+        uvDensity = std::sqrt(uvArea / worldArea);
+    }
 }
 
 } // moar
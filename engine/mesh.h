@@ -2,11 +2,13 @@
 #define MESH_H
 
 #include "material.h"
+#include "geometrybuffer.h"
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
 #include <vector>
+#include <array>
 
 namespace moar
 {
@@ -15,6 +17,8 @@ class Mesh
 {
     friend class ResourceManager;
     friend class Renderer;
+    friend class StaticBatcher;
+    friend class Model;
 
 public:
     explicit Mesh();
@@ -24,56 +28,52 @@ public:
     Mesh& operator=(const Mesh&) = delete;
     Mesh& operator=(Mesh&&) = delete;
 
-    Material* getMaterial() const;
+    Handle<Material> getMaterial() const;
     unsigned int getId() const;
     glm::vec3 getCenterPoint() const;
     float getBoundingRadius() const;
+    size_t getLodCount() const;
+    float getLodError(size_t lod) const;
+    // Texture coordinate units per world unit on average, zero without texture coordinates
+    float getUvDensity() const;
 
 private:
     static unsigned int idCounter;
-
-    void setIndices(const std::vector<unsigned int>& indices);
-    void setVertices(const std::vector<glm::vec3>& vertices);
-    void setTextureCoordinates(const std::vector<glm::vec2>& coords);
-    void setNormals(const std::vector<glm::vec3>& normals);
-    void setTangents(const std::vector<glm::vec3>& tangents);
-    void setMaterial(Material* material);
-
-    void render() const;
-
-    void checkBoundingBoxLimits(const glm::vec3& vert);
-    void calculateCenterPointAndRadius();
-
-    template<typename T>
-    void setBufferData(GLuint buffer, const std::vector<T>& data, int position, int size);
-
-    GLuint VAO = 0;
-    GLuint vertexBuffer = 0;
-    GLuint indexBuffer = 0;
-    GLuint normalBuffer = 0;
-    GLuint tangentBuffer = 0;
-    GLuint texBuffer = 0;
-    unsigned int numIndices = 0;
-
-    Material* material = nullptr;
+    using GeometryBuffers = std::array<GeometryBuffer, GeometryBuffer::NUM_FORMATS>;
+    static GeometryBuffers* geometryBuffers; // Set by the resource manager that owns them
+
+    void setData(MeshData&& meshData, GeometryBuffer::VertexFormat format);
+    const MeshData& getData() const;
+    // Frees the CPU copy once the load time processing is done, occluders keep their positions
+    // and proxy indices for the software rasterizer and the clusters are always kept
+    void releaseData(bool keepOccluder);
+    bool hasData() const;
+    const std::vector<unsigned int>& getOccluderIndices() const;
+    void setMaterial(Handle<Material> material);
+
+    void render(size_t lod, GLuint firstInstance, GLsizei numInstances) const;
+    void renderIndirect(GLuint firstCommand, GLsizei numCommands) const;
+
+    void calculateBounds();
+    void calculateUvDensity();
+
+    GeometryBuffer* geometryBuffer = nullptr;
+    const GeometryBuffer::Allocation* allocation = nullptr;
+
+    // CPU copy of the geometry for load time processing such as static batching
+    MeshData data;
+    bool dataReleased = false;
+    std::vector<float> lodErrors;
+    Handle<Material> material;
     unsigned int id;
 
     glm::vec3 boundingBoxMax;
     glm::vec3 boundingBoxMin;
     glm::vec3 centerPoint;
     float boundingRadius = 0.0f;
+    float uvDensity = 0.0f;
 };
 
-template<typename T>
-void Mesh::setBufferData(GLuint buffer, const std::vector<T>& data, int position, int size)
-{
-    glGenBuffers(1, &buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(T) * data.size(), &data[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(position, size, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(position);
-}
-
 } // moar
 
 #endif // MESH_H
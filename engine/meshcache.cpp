@@ -0,0 +1,308 @@
+#include "meshcache.h"
+#include "mappedfile.h"
+#include "hash.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdio>
+
+namespace moar
+{
+
+namespace
+{
+
+const char CACHE_MAGIC[8] = {'M', 'O', 'A', 'R', 'M', 'E', 'S', 'H'};
+// Increment when the layout of the file or of the cached structures changes
+const uint32_t CACHE_VERSION = 1;
+const char* CACHE_EXTENSION = ".mesh";
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t numMeshes;
+    uint64_t key;
+};
+
+struct MeshHeader
+{
+    uint32_t numVertices;
+    uint32_t numNormals;
+    uint32_t numTangents;
+    uint32_t numTexCoords;
+    uint32_t numIndices;
+    uint32_t numLods;
+    uint32_t numClusters;
+    uint32_t numTexturePaths;
+    uint32_t hasMaterial;
+};
+
+class Reader
+{
+public:
+    Reader(const unsigned char* data, size_t size) :
+        current(data),
+        end(data + size)
+    {
+    }
+
+    template<typename T>
+    bool read(T& value)
+    {
+        if (static_cast<size_t>(end - current) < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, current, sizeof(T));
+        current += sizeof(T);
+        return true;
+    }
+
+    template<typename T>
+    bool readArray(std::vector<T>& values, uint32_t count)
+    {
+        if (static_cast<size_t>(end - current) / sizeof(T) < count) {
+            return false;
+        }
+        values.resize(count);
+        if (count > 0) {
+            std::memcpy(&values[0], current, count * sizeof(T));
+            current += count * sizeof(T);
+        }
+        return true;
+    }
+
+    bool readString(std::string& value)
+    {
+        uint32_t length;
+        std::vector<char> chars;
+        if (!read(length) || !readArray(chars, length)) {
+            return false;
+        }
+        value.assign(chars.begin(), chars.end());
+        return true;
+    }
+
+private:
+    const unsigned char* current;
+    const unsigned char* end;
+};
+
+template<typename T>
+void write(std::ofstream& out, const T& value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+void writeArray(std::ofstream& out, const std::vector<T>& values)
+{
+    if (!values.empty()) {
+        out.write(reinterpret_cast<const char*>(&values[0]), values.size() * sizeof(T));
+    }
+}
+
+// Files named on the mtllib lines of an .obj, the names are separated by spaces
+std::vector<std::string> findMaterialLibraries(const MappedFile& source)
+{
+    std::vector<std::string> libraries;
+    const char* data = reinterpret_cast<const char*>(source.getData());
+    size_t size = source.getSize();
+    size_t lineStart = 0;
+    while (lineStart < size) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(data + lineStart, '\n', size - lineStart));
+        size_t end = lineEnd ? static_cast<size_t>(lineEnd - data) : size;
+        size_t begin = lineStart;
+        lineStart = end + 1;
+        if (end - begin < 7 || std::memcmp(data + begin, "mtllib ", 7) != 0) {
+            continue;
+        }
+        std::istringstream names(std::string(data + begin + 7, end - begin - 7));
+        std::string name;
+        while (names >> name) {
+            libraries.push_back(name);
+        }
+    }
+    return libraries;
+}
+
+bool isObjFile(const std::string& file)
+{
+    if (file.size() < 4) {
+        return false;
+    }
+    std::string extension = file.substr(file.size() - 4);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".obj";
+}
+
+} // anonymous
+
+MeshCache::MeshCache()
+{
+}
+
+MeshCache::~MeshCache()
+{
+}
+
+void MeshCache::setPath(const std::string& cachePath)
+{
+    path = cachePath;
+}
+
+bool MeshCache::isEnabled() const
+{
+    return !path.empty();
+}
+
+bool MeshCache::computeKey(const std::string& sourceFile, uint32_t options, uint64_t& key) const
+{
+    MappedFile source;
+    if (!source.open(sourceFile)) {
+        return false;
+    }
+    key = hashBytes(source.getData(), source.getSize());
+    key = hashBytes(&options, sizeof(options), key);
+
+    // The materials of an .obj are in separate files that the cached texture paths come from
+    if (isObjFile(sourceFile)) {
+        size_t separator = sourceFile.find_last_of("/\\");
+        std::string directory = separator == std::string::npos ? "" : sourceFile.substr(0, separator + 1);
+        for (const std::string& library : findMaterialLibraries(source)) {
+            key = hashBytes(library.data(), library.size(), key);
+            MappedFile libraryFile;
+            if (libraryFile.open(directory + library)) {
+                key = hashBytes(libraryFile.getData(), libraryFile.getSize(), key);
+            }
+        }
+    }
+    return true;
+}
+
+bool MeshCache::load(const std::string& modelName, uint64_t key, std::vector<CachedMesh>& meshes) const
+{
+    MappedFile file;
+    if (!file.open(getCacheFile(modelName))) {
+        return false;
+    }
+
+    Reader reader(file.getData(), file.getSize());
+    FileHeader header;
+    if (!reader.read(header) || std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header.version != CACHE_VERSION || header.key != key) {
+        return false;
+    }
+
+    meshes.clear();
+    meshes.resize(header.numMeshes);
+    for (CachedMesh& mesh : meshes) {
+        MeshHeader meshHeader;
+        MeshData& data = mesh.data;
+        bool valid = reader.read(meshHeader) &&
+                reader.readArray(data.vertices, meshHeader.numVertices) &&
+                reader.readArray(data.normals, meshHeader.numNormals) &&
+                reader.readArray(data.tangents, meshHeader.numTangents) &&
+                reader.readArray(data.texCoords, meshHeader.numTexCoords) &&
+                reader.readArray(data.indices, meshHeader.numIndices) &&
+                reader.readArray(data.clusters, meshHeader.numClusters);
+        if (!valid) {
+            std::cerr << "WARNING: Truncated mesh cache file for " << modelName << "\n";
+            return false;
+        }
+
+        data.lods.resize(meshHeader.numLods);
+        for (MeshLod& lod : data.lods) {
+            uint32_t numIndices;
+            if (!reader.read(lod.error) || !reader.read(numIndices) || !reader.readArray(lod.indices, numIndices)) {
+                std::cerr << "WARNING: Truncated mesh cache file for " << modelName << "\n";
+                return false;
+            }
+        }
+
+        mesh.hasMaterial = meshHeader.hasMaterial != 0;
+        mesh.texturePaths.resize(meshHeader.numTexturePaths);
+        for (std::string& texturePath : mesh.texturePaths) {
+            if (!reader.readString(texturePath)) {
+                std::cerr << "WARNING: Truncated mesh cache file for " << modelName << "\n";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool MeshCache::store(const std::string& modelName, uint64_t key, const std::vector<CachedMesh>& meshes) const
+{
+    // Written next to the final file and renamed so that an interrupted write is never read
+    std::string cacheFile = getCacheFile(modelName);
+    std::string temporaryFile = cacheFile + ".tmp";
+    std::ofstream out(temporaryFile, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.numMeshes = static_cast<uint32_t>(meshes.size());
+    header.key = key;
+    write(out, header);
+
+    for (const CachedMesh& mesh : meshes) {
+        const MeshData& data = mesh.data;
+        MeshHeader meshHeader;
+        meshHeader.numVertices = static_cast<uint32_t>(data.vertices.size());
+        meshHeader.numNormals = static_cast<uint32_t>(data.normals.size());
+        meshHeader.numTangents = static_cast<uint32_t>(data.tangents.size());
+        meshHeader.numTexCoords = static_cast<uint32_t>(data.texCoords.size());
+        meshHeader.numIndices = static_cast<uint32_t>(data.indices.size());
+        meshHeader.numLods = static_cast<uint32_t>(data.lods.size());
+        meshHeader.numClusters = static_cast<uint32_t>(data.clusters.size());
+        meshHeader.numTexturePaths = static_cast<uint32_t>(mesh.texturePaths.size());
+        meshHeader.hasMaterial = mesh.hasMaterial ? 1 : 0;
+        write(out, meshHeader);
+        writeArray(out, data.vertices);
+        writeArray(out, data.normals);
+        writeArray(out, data.tangents);
+        writeArray(out, data.texCoords);
+        writeArray(out, data.indices);
+        writeArray(out, data.clusters);
+
+        for (const MeshLod& lod : data.lods) {
+            write(out, lod.error);
+            write(out, static_cast<uint32_t>(lod.indices.size()));
+            writeArray(out, lod.indices);
+        }
+        for (const std::string& texturePath : mesh.texturePaths) {
+            write(out, static_cast<uint32_t>(texturePath.size()));
+            out.write(texturePath.data(), texturePath.size());
+        }
+    }
+
+    out.close();
+    if (!out) {
+        std::remove(temporaryFile.c_str());
+        return false;
+    }
+    std::remove(cacheFile.c_str());
+    return std::rename(temporaryFile.c_str(), cacheFile.c_str()) == 0;
+}
+
+std::string MeshCache::getCacheFile(const std::string& modelName) const
+{
+    // Models in subdirectories are flattened into the cache directory
+    std::string name = modelName;
+    for (char& c : name) {
+        if (c == '/' || c == '\\' || c == ':') {
+            c = '_';
+        }
+    }
+    return path + name + CACHE_EXTENSION;
+}
+
+} // moar
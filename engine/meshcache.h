@@ -0,0 +1,50 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include "geometrybuffer.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace moar
+{
+
+// Binary copies of imported and processed models. A cache file is valid for one version of the
+// source file and one set of import and processing options, a stale file is simply rewritten.
+class MeshCache
+{
+public:
+    struct CachedMesh
+    {
+        MeshData data;
+        bool hasMaterial = false;
+        std::vector<std::string> texturePaths;  // By TEXTURE_TYPE_MAPPINGS, empty when not used
+    };
+
+    explicit MeshCache();
+    ~MeshCache();
+    MeshCache(const MeshCache&) = delete;
+    MeshCache(MeshCache&&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+    MeshCache& operator=(MeshCache&&) = delete;
+
+    // Caching is disabled with an empty path
+    void setPath(const std::string& path);
+    bool isEnabled() const;
+
+    // Hash of the source file contents, the material libraries an .obj references and the options
+    // that the cached data depends on
+    bool computeKey(const std::string& sourceFile, uint32_t options, uint64_t& key) const;
+    bool load(const std::string& modelName, uint64_t key, std::vector<CachedMesh>& meshes) const;
+    bool store(const std::string& modelName, uint64_t key, const std::vector<CachedMesh>& meshes) const;
+
+private:
+    std::string getCacheFile(const std::string& modelName) const;
+
+    std::string path;
+};
+
+} // moar
+
+#endif // MESHCACHE_H
@@ -0,0 +1,117 @@
+#include "meshclusterer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace moar
+{
+
+namespace
+{
+
+const unsigned int NO_CLUSTER = std::numeric_limits<unsigned int>::max();
+const float MIN_AXIS_LENGTH = 1e-3f;
+
+} // anonymous
+
+MeshClusterer::MeshClusterer()
+{
+}
+
+MeshClusterer::~MeshClusterer()
+{
+}
+
+size_t MeshClusterer::cluster(MeshData& data) const
+{
+    data.clusters.clear();
+    size_t numTriangles = data.indices.size() / 3;
+    if (numTriangles < MIN_MESH_TRIANGLES) {
+        return 0;
+    }
+
+    // Cluster of the last triangle that referenced each vertex, counts the unique vertices of a cluster
+    std::vector<unsigned int> vertexCluster(data.vertices.size(), NO_CLUSTER);
+    MeshCluster current = MeshCluster();
+    size_t numVertices = 0;
+    for (size_t triangle = 0; triangle < numTriangles; ++triangle) {
+        const unsigned int* indices = &data.indices[triangle * 3];
+        unsigned int clusterId = static_cast<unsigned int>(data.clusters.size());
+        size_t newVertices = 0;
+        for (size_t i = 0; i < 3; ++i) {
+            bool duplicate = (i > 0 && indices[i] == indices[0]) || (i > 1 && indices[i] == indices[1]);
+            if (vertexCluster[indices[i]] != clusterId && !duplicate) {
+                ++newVertices;
+            }
+        }
+
+        if (numVertices + newVertices > MAX_CLUSTER_VERTICES || current.numIndices / 3 == MAX_CLUSTER_TRIANGLES) {
+            calculateBounds(data, current);
+            data.clusters.push_back(current);
+            current = MeshCluster();
+            current.firstIndex = static_cast<GLuint>(triangle * 3);
+            numVertices = 0;
+            ++clusterId;
+        }
+
+        for (size_t i = 0; i < 3; ++i) {
+            if (vertexCluster[indices[i]] != clusterId) {
+                vertexCluster[indices[i]] = clusterId;
+                ++numVertices;
+            }
+        }
+        current.numIndices += 3;
+    }
+    calculateBounds(data, current);
+    data.clusters.push_back(current);
+    return data.clusters.size();
+}
+
+void MeshClusterer::calculateBounds(const MeshData& data, MeshCluster& cluster) const
+{
+    glm::vec3 boxMin(std::numeric_limits<float>::max());
+    glm::vec3 boxMax(std::numeric_limits<float>::lowest());
+    for (GLuint i = cluster.firstIndex; i < cluster.firstIndex + cluster.numIndices; ++i) {
+        boxMin = glm::min(boxMin, data.vertices[data.indices[i]]);
+        boxMax = glm::max(boxMax, data.vertices[data.indices[i]]);
+    }
+    cluster.center = (boxMin + boxMax) * 0.5f;
+    cluster.radius = 0.0f;
+    for (GLuint i = cluster.firstIndex; i < cluster.firstIndex + cluster.numIndices; ++i) {
+        cluster.radius = std::max(cluster.radius, glm::length(data.vertices[data.indices[i]] - cluster.center));
+    }
+
+    std::vector<glm::vec3> normals;
+    glm::vec3 normalSum(0.0f);
+    for (GLuint i = cluster.firstIndex; i + 2 < cluster.firstIndex + cluster.numIndices; i += 3) {
+        const glm::vec3& v0 = data.vertices[data.indices[i]];
+        const glm::vec3& v1 = data.vertices[data.indices[i + 1]];
+        const glm::vec3& v2 = data.vertices[data.indices[i + 2]];
+        glm::vec3 normal = glm::cross(v1 - v0, v2 - v0);
+        float length = glm::length(normal);
+        if (length > 0.0f) {
+            normals.push_back(normal / length);
+            normalSum += normals.back();
+        }
+    }
+
+    // A cluster is back facing when the view direction to every point of it is within 90 degrees
+    // minus the cone half angle of the axis. Wide cones would never pass, they are left uncullable.
+    cluster.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    cluster.coneCutoff = 1.0f;
+    float axisLength = glm::length(normalSum);
+    if (normals.empty() || axisLength < MIN_AXIS_LENGTH) {
+        return;
+    }
+    cluster.coneAxis = normalSum / axisLength;
+    float minDot = 1.0f;
+    for (const glm::vec3& normal : normals) {
+        minDot = std::min(minDot, glm::dot(normal, cluster.coneAxis));
+    }
+    if (minDot > 0.0f) {
+        cluster.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+}
+
+} // moar
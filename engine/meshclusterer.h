@@ -0,0 +1,41 @@
+#ifndef MESHCLUSTERER_H
+#define MESHCLUSTERER_H
+
+#include "geometrybuffer.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+
+namespace moar
+{
+
+// Splits the full mesh into clusters of consecutive triangles, so the index order is kept and
+// a cluster is drawn as a plain index range. Should run after the vertex cache optimization,
+// which keeps neighbouring triangles close to each other in the index order.
+class MeshClusterer
+{
+public:
+    static const size_t MAX_CLUSTER_VERTICES = 64;
+    static const size_t MAX_CLUSTER_TRIANGLES = 124;
+    // Smaller meshes are cheaper to draw whole than to cull in parts
+    static const size_t MIN_MESH_TRIANGLES = 512;
+
+    explicit MeshClusterer();
+    ~MeshClusterer();
+    MeshClusterer(const MeshClusterer&) = delete;
+    MeshClusterer(MeshClusterer&&) = delete;
+    MeshClusterer& operator=(const MeshClusterer&) = delete;
+    MeshClusterer& operator=(MeshClusterer&&) = delete;
+
+    // Replaces the clusters of the mesh, returns the number of clusters
+    size_t cluster(MeshData& data) const;
+
+private:
+    void calculateBounds(const MeshData& data, MeshCluster& cluster) const;
+};
+
+} // moar
+
+#endif // MESHCLUSTERER_H
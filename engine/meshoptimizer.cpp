@@ -0,0 +1,362 @@
+#include "meshoptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace moar
+{
+
+namespace
+{
+
+// Forsyth's linear speed vertex cache optimization, scored against an LRU cache
+const int FORSYTH_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+// Statistics and overdraw clustering use a FIFO cache like most hardware
+const size_t FIFO_CACHE_SIZE = 16;
+// Clusters may be split as long as the cache miss ratio stays within this factor
+const float OVERDRAW_THRESHOLD = 1.05f;
+
+const unsigned int UNUSED_VERTEX = std::numeric_limits<unsigned int>::max();
+const size_t NO_TRIANGLE = std::numeric_limits<size_t>::max();
+
+float vertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+    if (remainingTriangles == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+    return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+}
+
+template<typename T>
+void reorderAttribute(std::vector<T>& attribute, const std::vector<unsigned int>& remap, unsigned int numUsed)
+{
+    if (attribute.size() != remap.size()) {
+        return;
+    }
+    std::vector<T> reordered(numUsed);
+    for (size_t i = 0; i < remap.size(); ++i) {
+        if (remap[i] != UNUSED_VERTEX) {
+            reordered[remap[i]] = attribute[i];
+        }
+    }
+    attribute.swap(reordered);
+}
+
+} // anonymous
+
+float MeshOptimizer::Statistics::getACMR(size_t transformed) const
+{
+    return numTriangles > 0 ? static_cast<float>(transformed) / numTriangles : 0.0f;
+}
+
+float MeshOptimizer::Statistics::getATVR(size_t transformed, size_t numVertices) const
+{
+    return numVertices > 0 ? static_cast<float>(transformed) / numVertices : 0.0f;
+}
+
+void MeshOptimizer::Statistics::add(const Statistics& other)
+{
+    verticesBefore += other.verticesBefore;
+    verticesAfter += other.verticesAfter;
+    numTriangles += other.numTriangles;
+    transformedBefore += other.transformedBefore;
+    transformedAfter += other.transformedAfter;
+}
+
+MeshOptimizer::MeshOptimizer()
+{
+}
+
+MeshOptimizer::~MeshOptimizer()
+{
+}
+
+MeshOptimizer::Statistics MeshOptimizer::optimize(MeshData& data) const
+{
+    Statistics statistics;
+    statistics.verticesBefore = data.vertices.size();
+    statistics.numTriangles = data.indices.size() / 3;
+    statistics.transformedBefore = simulateVertexCache(data.indices, data.vertices.size());
+
+    if (statistics.numTriangles > 0) {
+        data.indices.resize(statistics.numTriangles * 3);
+        optimizeVertexCache(data.indices, data.vertices.size());
+        optimizeOverdraw(data.indices, data.vertices);
+        for (MeshLod& lod : data.lods) {
+            optimizeVertexCache(lod.indices, data.vertices.size());
+        }
+        optimizeVertexFetch(data);
+    }
+
+    statistics.verticesAfter = data.vertices.size();
+    statistics.transformedAfter = simulateVertexCache(data.indices, data.vertices.size());
+    return statistics;
+}
+
+size_t MeshOptimizer::simulateVertexCache(const std::vector<unsigned int>& indices, size_t numVertices) const
+{
+    // A vertex is still cached if fewer than the cache size of misses happened since it was loaded
+    std::vector<size_t> timestamps(numVertices, 0);
+    size_t time = FIFO_CACHE_SIZE + 1;
+    size_t misses = 0;
+    for (unsigned int index : indices) {
+        if (time - timestamps[index] > FIFO_CACHE_SIZE) {
+            timestamps[index] = time++;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, size_t numVertices) const
+{
+    size_t numTriangles = indices.size() / 3;
+
+    std::vector<unsigned int> remainingTriangles(numVertices, 0);
+    for (unsigned int index : indices) {
+        ++remainingTriangles[index];
+    }
+    std::vector<unsigned int> adjacencyOffsets(numVertices + 1, 0);
+    for (size_t i = 0; i < numVertices; ++i) {
+        adjacencyOffsets[i + 1] = adjacencyOffsets[i] + remainingTriangles[i];
+    }
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    std::vector<int> cachePositions(numVertices, -1);
+    std::vector<float> vertexScores(numVertices);
+    for (size_t i = 0; i < numVertices; ++i) {
+        vertexScores[i] = vertexScore(-1, remainingTriangles[i]);
+    }
+    std::vector<float> triangleScores(numTriangles);
+    size_t bestTriangle = NO_TRIANGLE;
+    float bestScore = -1.0f;
+    for (size_t i = 0; i < numTriangles; ++i) {
+        triangleScores[i] = vertexScores[indices[i * 3]] + vertexScores[indices[i * 3 + 1]] +
+                vertexScores[indices[i * 3 + 2]];
+        if (triangleScores[i] > bestScore) {
+            bestScore = triangleScores[i];
+            bestTriangle = i;
+        }
+    }
+
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<unsigned int> cache;
+    std::vector<unsigned int> newCache;
+    std::vector<unsigned int> optimized;
+    optimized.reserve(indices.size());
+    size_t inputCursor = 0;
+
+    for (size_t i = 0; i < numTriangles; ++i) {
+        if (bestTriangle == NO_TRIANGLE) {
+            // Nothing in the cache is connected to the rest, continue from the next triangle in input order
+            while (emitted[inputCursor]) {
+                ++inputCursor;
+            }
+            bestTriangle = inputCursor;
+        }
+
+        emitted[bestTriangle] = true;
+        const unsigned int* triangle = &indices[bestTriangle * 3];
+        newCache.assign(triangle, triangle + 3);
+        for (int j = 0; j < 3; ++j) {
+            unsigned int vertex = triangle[j];
+            optimized.push_back(vertex);
+
+            unsigned int* begin = &adjacency[adjacencyOffsets[vertex]];
+            unsigned int* end = begin + remainingTriangles[vertex];
+            std::iter_swap(std::find(begin, end, static_cast<unsigned int>(bestTriangle)), end - 1);
+            --remainingTriangles[vertex];
+        }
+        for (unsigned int vertex : cache) {
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+                newCache.push_back(vertex);
+            }
+        }
+
+        // Rescore everything that moved in or out of the cache
+        for (size_t j = 0; j < newCache.size(); ++j) {
+            unsigned int vertex = newCache[j];
+            cachePositions[vertex] = j < static_cast<size_t>(FORSYTH_CACHE_SIZE) ? static_cast<int>(j) : -1;
+            float score = vertexScore(cachePositions[vertex], remainingTriangles[vertex]);
+            float delta = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+            for (unsigned int k = 0; k < remainingTriangles[vertex]; ++k) {
+                triangleScores[adjacency[adjacencyOffsets[vertex] + k]] += delta;
+            }
+        }
+        if (newCache.size() > static_cast<size_t>(FORSYTH_CACHE_SIZE)) {
+            newCache.resize(FORSYTH_CACHE_SIZE);
+        }
+        cache.swap(newCache);
+
+        bestTriangle = NO_TRIANGLE;
+        bestScore = -1.0f;
+        for (unsigned int vertex : cache) {
+            for (unsigned int k = 0; k < remainingTriangles[vertex]; ++k) {
+                unsigned int candidate = adjacency[adjacencyOffsets[vertex] + k];
+                if (triangleScores[candidate] > bestScore) {
+                    bestScore = triangleScores[candidate];
+                    bestTriangle = candidate;
+                }
+            }
+        }
+    }
+
+    indices.swap(optimized);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions) const
+{
+    std::vector<Cluster> clusters;
+    findClusters(indices, positions.size(), clusters);
+    if (clusters.size() < 2) {
+        return;
+    }
+
+    std::vector<glm::vec3> centroids(clusters.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(clusters.size(), glm::vec3(0.0f));
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t i = 0; i < clusters.size(); ++i) {
+        float area = 0.0f;
+        for (size_t j = clusters[i].firstTriangle; j < clusters[i].firstTriangle + clusters[i].numTriangles; ++j) {
+            const glm::vec3& a = positions[indices[j * 3]];
+            const glm::vec3& b = positions[indices[j * 3 + 1]];
+            const glm::vec3& c = positions[indices[j * 3 + 2]];
+            glm::vec3 areaNormal = glm::cross(b - a, c - a);
+            float triangleArea = glm::length(areaNormal);
+            centroids[i] += (a + b + c) * (triangleArea / 3.0f);
+            normals[i] += areaNormal;
+            area += triangleArea;
+        }
+        meshCentroid += centroids[i];
+        meshArea += area;
+        if (area > 0.0f) {
+            centroids[i] /= area;
+        }
+    }
+    if (meshArea <= 0.0f) {
+        return;
+    }
+    meshCentroid /= meshArea;
+
+    // Clusters far out along their own normal are likely to occlude the rest of the mesh, so draw them first
+    for (size_t i = 0; i < clusters.size(); ++i) {
+        float length = glm::length(normals[i]);
+        clusters[i].sortKey = length > 0.0f ? glm::dot(centroids[i] - meshCentroid, normals[i] / length) : 0.0f;
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [] (const Cluster& a, const Cluster& b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (const Cluster& cluster : clusters) {
+        auto begin = indices.begin() + cluster.firstTriangle * 3;
+        sorted.insert(sorted.end(), begin, begin + cluster.numTriangles * 3);
+    }
+    indices.swap(sorted);
+}
+
+void MeshOptimizer::findClusters(const std::vector<unsigned int>& indices, size_t numVertices,
+                                 std::vector<Cluster>& clusters) const
+{
+    size_t numTriangles = indices.size() / 3;
+    std::vector<size_t> timestamps(numVertices, 0);
+    size_t time = FIFO_CACHE_SIZE + 1;
+    auto countMisses = [&] (size_t triangle) {
+        size_t misses = 0;
+        for (size_t i = triangle * 3; i < triangle * 3 + 3; ++i) {
+            if (time - timestamps[indices[i]] > FIFO_CACHE_SIZE) {
+                timestamps[indices[i]] = time++;
+                ++misses;
+            }
+        }
+        return misses;
+    };
+
+    // A triangle that misses all of its vertices starts over with a cold cache, so moving
+    // the triangles between two of those boundaries does not cost any cache efficiency.
+    std::vector<size_t> hardBoundaries;
+    std::vector<size_t> misses(numTriangles);
+    for (size_t i = 0; i < numTriangles; ++i) {
+        misses[i] = countMisses(i);
+        if (i == 0 || misses[i] == 3) {
+            hardBoundaries.push_back(i);
+        }
+    }
+    hardBoundaries.push_back(numTriangles);
+
+    // Hard clusters are split further where the cold start of the next part costs less
+    // than the threshold allows.
+    for (size_t i = 0; i + 1 < hardBoundaries.size(); ++i) {
+        size_t begin = hardBoundaries[i];
+        size_t end = hardBoundaries[i + 1];
+        size_t clusterMisses = 0;
+        for (size_t j = begin; j < end; ++j) {
+            clusterMisses += misses[j];
+        }
+        float maxMisses = static_cast<float>(clusterMisses) / (end - begin) * OVERDRAW_THRESHOLD;
+
+        time += FIFO_CACHE_SIZE + 1;
+        size_t subBegin = begin;
+        size_t subMisses = 0;
+        for (size_t j = begin; j < end; ++j) {
+            subMisses += countMisses(j);
+            size_t subTriangles = j - subBegin + 1;
+            if (j + 1 < end && subMisses <= maxMisses * subTriangles) {
+                clusters.push_back(Cluster{subBegin, subTriangles, 0.0f});
+                subBegin = j + 1;
+                subMisses = 0;
+                time += FIFO_CACHE_SIZE + 1;
+            }
+        }
+        clusters.push_back(Cluster{subBegin, end - subBegin, 0.0f});
+    }
+}
+
+void MeshOptimizer::optimizeVertexFetch(MeshData& data) const
+{
+    std::vector<unsigned int> remap(data.vertices.size(), UNUSED_VERTEX);
+    unsigned int numUsed = 0;
+    auto remapIndices = [&remap, &numUsed] (std::vector<unsigned int>& indices) {
+        for (unsigned int& index : indices) {
+            if (remap[index] == UNUSED_VERTEX) {
+                remap[index] = numUsed++;
+            }
+            index = remap[index];
+        }
+    };
+    // Coarser levels use a subset of the vertices of the full mesh so its order wins
+    remapIndices(data.indices);
+    for (MeshLod& lod : data.lods) {
+        remapIndices(lod.indices);
+    }
+
+    reorderAttribute(data.vertices, remap, numUsed);
+    reorderAttribute(data.normals, remap, numUsed);
+    reorderAttribute(data.tangents, remap, numUsed);
+    reorderAttribute(data.texCoords, remap, numUsed);
+}
+
+} // moar
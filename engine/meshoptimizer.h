@@ -0,0 +1,64 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include "geometrybuffer.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+
+namespace moar
+{
+
+// Import time reordering of triangles and vertices. Triangles are first sorted for the
+// post-transform vertex cache, then clusters of them are sorted to reduce overdraw and
+// finally the vertices are stored in the order they are first referenced. Levels of detail
+// are only ordered for the vertex cache.
+class MeshOptimizer
+{
+public:
+    struct Statistics
+    {
+        size_t verticesBefore = 0;      // Unused vertices are dropped by the optimization
+        size_t verticesAfter = 0;
+        size_t numTriangles = 0;
+        size_t transformedBefore = 0;
+        size_t transformedAfter = 0;
+
+        // Average cache miss ratio, transformed vertices per triangle
+        float getACMR(size_t transformed) const;
+        // Average transform to vertex ratio, 1.0 is the optimum
+        float getATVR(size_t transformed, size_t numVertices) const;
+        void add(const Statistics& other);
+    };
+
+    explicit MeshOptimizer();
+    ~MeshOptimizer();
+    MeshOptimizer(const MeshOptimizer&) = delete;
+    MeshOptimizer(MeshOptimizer&&) = delete;
+    MeshOptimizer& operator=(const MeshOptimizer&) = delete;
+    MeshOptimizer& operator=(MeshOptimizer&&) = delete;
+
+    Statistics optimize(MeshData& data) const;
+    // Number of vertex shader invocations with a FIFO cache of the typical hardware size
+    size_t simulateVertexCache(const std::vector<unsigned int>& indices, size_t numVertices) const;
+
+private:
+    struct Cluster
+    {
+        size_t firstTriangle;
+        size_t numTriangles;
+        float sortKey;
+    };
+
+    void optimizeVertexCache(std::vector<unsigned int>& indices, size_t numVertices) const;
+    void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions) const;
+    void optimizeVertexFetch(MeshData& data) const;
+    void findClusters(const std::vector<unsigned int>& indices, size_t numVertices,
+                      std::vector<Cluster>& clusters) const;
+};
+
+} // moar
+
+#endif // MESHOPTIMIZER_H
@@ -0,0 +1,285 @@
+#include "meshsimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+namespace moar
+{
+
+namespace
+{
+
+const size_t MAX_LODS = 4;
+const float LOD_TRIANGLE_RATIO = 0.5f;
+const size_t MIN_LOD_TRIANGLES = 32;
+// A level that removes less than this share of the previous one is not worth the memory
+const float MIN_LOD_REDUCTION = 0.15f;
+
+uint64_t edgeKey(unsigned int a, unsigned int b)
+{
+    return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+}
+
+} // anonymous
+
+void MeshSimplifier::Quadric::addPlane(const glm::vec3& normal, float distance)
+{
+    double a = normal.x;
+    double b = normal.y;
+    double c = normal.z;
+    double d = distance;
+    a2 += a * a; ab += a * b; ac += a * c; ad += a * d;
+    b2 += b * b; bc += b * c; bd += b * d;
+    c2 += c * c; cd += c * d;
+    d2 += d * d;
+}
+
+void MeshSimplifier::Quadric::add(const Quadric& other)
+{
+    a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+    b2 += other.b2; bc += other.bc; bd += other.bd;
+    c2 += other.c2; cd += other.cd;
+    d2 += other.d2;
+}
+
+double MeshSimplifier::Quadric::evaluate(const glm::vec3& point) const
+{
+    double x = point.x;
+    double y = point.y;
+    double z = point.z;
+    double result = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x +
+                    b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y +
+                    c2 * z * z + 2.0 * cd * z + d2;
+    return std::max(result, 0.0);
+}
+
+MeshSimplifier::MeshSimplifier()
+{
+}
+
+MeshSimplifier::~MeshSimplifier()
+{
+}
+
+void MeshSimplifier::generateLods(MeshData& data) const
+{
+    data.lods.clear();
+    float error = 0.0f;
+    for (size_t level = 0; level < MAX_LODS; ++level) {
+        const std::vector<unsigned int>& previous = level == 0 ? data.indices : data.lods.back().indices;
+        size_t targetTriangles = static_cast<size_t>(previous.size() / 3 * LOD_TRIANGLE_RATIO);
+        if (targetTriangles < MIN_LOD_TRIANGLES) {
+            break;
+        }
+
+        float levelError = 0.0f;
+        std::vector<unsigned int> indices = simplify(data.vertices, previous, targetTriangles * 3, levelError);
+        if (indices.empty() || indices.size() > previous.size() * (1.0f - MIN_LOD_REDUCTION)) {
+            break;
+        }
+        // Each level is simplified from the previous one, so the errors add up
+        error += levelError;
+        data.lods.push_back(MeshLod{std::move(indices), error});
+    }
+}
+
+std::vector<unsigned int> MeshSimplifier::simplify(const std::vector<glm::vec3>& positions,
+                                                   const std::vector<unsigned int>& indices,
+                                                   size_t targetIndices, float& error) const
+{
+    size_t numVertices = positions.size();
+    std::vector<bool> locked = findLockedVertices(positions, indices);
+
+    std::vector<Quadric> quadrics(numVertices);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::vec3& a = positions[indices[i]];
+        glm::vec3 normal = glm::cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a);
+        float length = glm::length(normal);
+        if (length <= 0.0f) {
+            continue;
+        }
+        normal /= length;
+        float distance = -glm::dot(normal, a);
+        for (size_t j = i; j < i + 3; ++j) {
+            quadrics[indices[j]].addPlane(normal, distance);
+        }
+    }
+
+    std::vector<unsigned int> current(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+    std::vector<unsigned int> remap(numVertices);
+    std::vector<bool> touched(numVertices);
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> adjacencyOffsets;
+    std::vector<unsigned int> adjacency;
+    double maxCost = 0.0;
+
+    // Each pass collapses a set of independent edges, cheapest first
+    while (current.size() > targetIndices) {
+        collapses.clear();
+        for (size_t i = 0; i < current.size(); i += 3) {
+            for (size_t j = 0; j < 3; ++j) {
+                unsigned int a = current[i + j];
+                unsigned int b = current[i + (j + 1) % 3];
+                Quadric quadric = quadrics[a];
+                quadric.add(quadrics[b]);
+                if (!locked[a]) {
+                    collapses.push_back(Collapse{a, b, quadric.evaluate(positions[b])});
+                }
+                if (!locked[b]) {
+                    collapses.push_back(Collapse{b, a, quadric.evaluate(positions[a])});
+                }
+            }
+        }
+        if (collapses.empty()) {
+            break;
+        }
+        std::sort(collapses.begin(), collapses.end(), [] (const Collapse& a, const Collapse& b) {
+            return a.cost < b.cost;
+        });
+
+        adjacencyOffsets.assign(numVertices + 1, 0);
+        for (unsigned int index : current) {
+            ++adjacencyOffsets[index + 1];
+        }
+        for (size_t i = 0; i < numVertices; ++i) {
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        }
+        adjacency.resize(current.size());
+        std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < current.size(); ++i) {
+            adjacency[fill[current[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+
+        for (size_t i = 0; i < numVertices; ++i) {
+            remap[i] = static_cast<unsigned int>(i);
+        }
+        std::fill(touched.begin(), touched.end(), false);
+
+        // An interior edge collapse removes two triangles
+        size_t removedTriangles = 0;
+        size_t trianglesToRemove = (current.size() - targetIndices) / 3;
+        for (const Collapse& collapse : collapses) {
+            if (removedTriangles >= trianglesToRemove) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+            if (collapseFlipsTriangle(positions, current, adjacencyOffsets, adjacency, collapse)) {
+                continue;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            maxCost = std::max(maxCost, collapse.cost);
+            removedTriangles += 2;
+
+            // Neighbouring triangles change shape, so their vertices wait for the next pass
+            for (unsigned int k = adjacencyOffsets[collapse.from]; k < adjacencyOffsets[collapse.from + 1]; ++k) {
+                unsigned int triangle = adjacency[k];
+                for (size_t j = 0; j < 3; ++j) {
+                    touched[current[triangle * 3 + j]] = true;
+                }
+            }
+        }
+        if (removedTriangles == 0) {
+            break;
+        }
+
+        size_t numIndices = 0;
+        for (size_t i = 0; i < current.size(); i += 3) {
+            unsigned int a = remap[current[i]];
+            unsigned int b = remap[current[i + 1]];
+            unsigned int c = remap[current[i + 2]];
+            if (a != b && b != c && a != c) {
+                current[numIndices++] = a;
+                current[numIndices++] = b;
+                current[numIndices++] = c;
+            }
+        }
+        current.resize(numIndices);
+    }
+
+    error = static_cast<float>(std::sqrt(maxCost));
+    return current;
+}
+
+std::vector<bool> MeshSimplifier::findLockedVertices(const std::vector<glm::vec3>& positions,
+                                                     const std::vector<unsigned int>& indices) const
+{
+    size_t numVertices = positions.size();
+
+    // Vertices sharing a position are split by some attribute, moving them would tear the seam
+    std::vector<unsigned int> sorted(numVertices);
+    for (size_t i = 0; i < numVertices; ++i) {
+        sorted[i] = static_cast<unsigned int>(i);
+    }
+    std::sort(sorted.begin(), sorted.end(), [&positions] (unsigned int a, unsigned int b) {
+        const glm::vec3& pa = positions[a];
+        const glm::vec3& pb = positions[b];
+        return pa.x != pb.x ? pa.x < pb.x : (pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z);
+    });
+    std::vector<unsigned int> canonical(numVertices);
+    std::vector<bool> locked(numVertices, false);
+    for (size_t i = 0; i < numVertices; ++i) {
+        unsigned int vertex = sorted[i];
+        if (i > 0 && positions[vertex] == positions[sorted[i - 1]]) {
+            canonical[vertex] = canonical[sorted[i - 1]];
+            locked[vertex] = true;
+            locked[sorted[i - 1]] = true;
+        } else {
+            canonical[vertex] = vertex;
+        }
+    }
+
+    // Edges used by only one triangle are on a border and edges used by more are non-manifold
+    std::unordered_map<uint64_t, unsigned int> edgeCounts;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        for (size_t j = 0; j < 3; ++j) {
+            ++edgeCounts[edgeKey(canonical[indices[i + j]], canonical[indices[i + (j + 1) % 3]])];
+        }
+    }
+    std::vector<bool> lockedPositions(numVertices, false);
+    for (const auto& edge : edgeCounts) {
+        if (edge.second != 2) {
+            lockedPositions[static_cast<unsigned int>(edge.first >> 32)] = true;
+            lockedPositions[static_cast<unsigned int>(edge.first & 0xFFFFFFFF)] = true;
+        }
+    }
+    for (size_t i = 0; i < numVertices; ++i) {
+        locked[i] = locked[i] || lockedPositions[canonical[i]];
+    }
+    return locked;
+}
+
+bool MeshSimplifier::collapseFlipsTriangle(const std::vector<glm::vec3>& positions,
+                                           const std::vector<unsigned int>& indices,
+                                           const std::vector<unsigned int>& adjacencyOffsets,
+                                           const std::vector<unsigned int>& adjacency,
+                                           const Collapse& collapse) const
+{
+    const glm::vec3& target = positions[collapse.to];
+    for (unsigned int k = adjacencyOffsets[collapse.from]; k < adjacencyOffsets[collapse.from + 1]; ++k) {
+        const unsigned int* triangle = &indices[adjacency[k] * 3];
+        if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+            continue;
+        }
+
+        glm::vec3 corners[3];
+        glm::vec3 moved[3];
+        for (size_t j = 0; j < 3; ++j) {
+            corners[j] = positions[triangle[j]];
+            moved[j] = triangle[j] == collapse.from ? target : corners[j];
+        }
+        glm::vec3 oldNormal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+        glm::vec3 newNormal = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+        if (glm::dot(oldNormal, newNormal) <= 0.0f) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // moar
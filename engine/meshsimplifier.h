@@ -0,0 +1,61 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include "geometrybuffer.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+
+namespace moar
+{
+
+// Quadric error metric simplification with half edge collapses, so the simplified levels
+// reuse the vertices of the full mesh. Vertices on borders and attribute seams are locked.
+class MeshSimplifier
+{
+public:
+    explicit MeshSimplifier();
+    ~MeshSimplifier();
+    MeshSimplifier(const MeshSimplifier&) = delete;
+    MeshSimplifier(MeshSimplifier&&) = delete;
+    MeshSimplifier& operator=(const MeshSimplifier&) = delete;
+    MeshSimplifier& operator=(MeshSimplifier&&) = delete;
+
+    // Replaces the levels of detail of the mesh with progressively coarser ones
+    void generateLods(MeshData& data) const;
+    // Error is the object space distance that the result may deviate from the input
+    std::vector<unsigned int> simplify(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                                       size_t targetIndices, float& error) const;
+
+private:
+    struct Quadric
+    {
+        double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+        double b2 = 0.0, bc = 0.0, bd = 0.0;
+        double c2 = 0.0, cd = 0.0;
+        double d2 = 0.0;
+
+        void addPlane(const glm::vec3& normal, float distance);
+        void add(const Quadric& other);
+        double evaluate(const glm::vec3& point) const;
+    };
+
+    struct Collapse
+    {
+        unsigned int from;
+        unsigned int to;
+        double cost;
+    };
+
+    std::vector<bool> findLockedVertices(const std::vector<glm::vec3>& positions,
+                                         const std::vector<unsigned int>& indices) const;
+    bool collapseFlipsTriangle(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                               const std::vector<unsigned int>& adjacencyOffsets,
+                               const std::vector<unsigned int>& adjacency, const Collapse& collapse) const;
+};
+
+} // moar
+
+#endif // MESHSIMPLIFIER_H
@@ -16,6 +16,13 @@ const std::vector<std::unique_ptr<Mesh>>& Model::getMeshes() const
     return meshes;
 }
 
+void Model::releaseMeshData(const std::unordered_set<const Mesh*>& occluderMeshes)
+{
+    for (const auto& mesh : meshes) {
+        mesh->releaseData(occluderMeshes.count(mesh.get()) > 0);
+    }
+}
+
 void Model::addMesh(std::unique_ptr<Mesh> mesh)
 {    
     meshes.push_back(std::move(mesh));
@@ -5,6 +5,7 @@
 
 #include <vector>
 #include <memory>
+#include <unordered_set>
 
 namespace moar
 {
@@ -12,6 +13,7 @@ namespace moar
 class Model
 {
     friend class ResourceManager;
+    friend class StaticBatcher;
 
 public:
     explicit Model();
@@ -22,6 +24,8 @@ public:
     Model& operator=(Model&&) = delete;
 
     const std::vector<std::unique_ptr<Mesh>>& getMeshes() const;
+    // Meshes in the set keep their occluder geometry
+    void releaseMeshData(const std::unordered_set<const Mesh*>& occluderMeshes);
 
 private:
     void addMesh(std::unique_ptr<Mesh> mesh);
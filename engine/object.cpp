@@ -6,6 +6,8 @@
 #include <glm/gtx/euler_angles.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+
 namespace moar
 {
 
@@ -19,63 +21,120 @@ const glm::mat4* Object::view = nullptr;
 glm::mat4 Object::viewProjection;
 unsigned int Object::idCounter = 0;
 GLuint Object::transformationBlockBuffer = 0; // Initialized by friend class renderer
-Material* Object::defaultMaterial = nullptr;
+Handle<Material> Object::defaultMaterial;
+TransformSystem Object::transformSystem;
+std::vector<Object*> Object::transformOwners;
+std::vector<Object*> Object::changedObjects;
 
 void Object::updateViewProjectionMatrix()
 {
     viewProjection = (*projection) * (*view);
 }
 
+void Object::updateTransforms(JobSystem* jobSystem)
+{
+    transformSystem.update(jobSystem, *view, viewProjection);
+    changedObjects.clear();
+    for (TransformSystem::Index index : transformSystem.getChangedTransforms()) {
+        if (transformOwners[index]) {
+            changedObjects.push_back(transformOwners[index]);
+        }
+    }
+}
+
+const std::vector<Object*>& Object::getChangedObjects()
+{
+    return changedObjects;
+}
+
 void Object::setMeshDefaultMaterial(Material* material)
 {
-    defaultMaterial = material;
+    defaultMaterial = material->getHandle();
 }
 
-void Object::setViewMatrixUniform()
+void Object::setViewUniforms()
 {
+    // Model dependent transforms come from the instance buffer
     glBindBuffer(GL_UNIFORM_BUFFER, transformationBlockBuffer);
-    GLintptr matrixSize = sizeof(modelMatrix);
-    glBufferSubData(GL_UNIFORM_BUFFER, 1 * matrixSize, matrixSize, glm::value_ptr(*view));
+    GLintptr matrixSize = sizeof(glm::mat4);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0 * matrixSize, matrixSize, glm::value_ptr(*view));
+    glBufferSubData(GL_UNIFORM_BUFFER, 1 * matrixSize, matrixSize, glm::value_ptr(viewProjection));
+    glBindBufferBase(GL_UNIFORM_BUFFER, TRANSFORMATION_BINDING_POINT, transformationBlockBuffer);
 }
 
 Object::Object() :
-    id(++idCounter)
+    Object("")
 {
 }
 
 Object::Object(const std::string& name) :
     id(++idCounter),
+    transformIndex(transformSystem.create()),
     name(name)
 {
+    if (transformOwners.size() <= transformIndex) {
+        transformOwners.resize(transformIndex + 1, nullptr);
+    }
+    transformOwners[transformIndex] = this;
 }
 
 Object::~Object()
 {
+    for (Object* child : children) {
+        child->parent = nullptr;
+    }
+    if (parent) {
+        auto& siblings = parent->children;
+        siblings.erase(std::remove(siblings.begin(), siblings.end(), this), siblings.end());
+    }
+    transformOwners[transformIndex] = nullptr;
+    changedObjects.erase(std::remove(changedObjects.begin(), changedObjects.end(), this), changedObjects.end());
+    transformSystem.destroy(transformIndex);
 }
 
 void Object::move(const glm::vec3& translation)
 {
-    position += translation;
+    transformSystem.setPosition(transformIndex, getPosition() + translation);
 }
 
 void Object::rotate(const glm::vec3& axis, float amount)
 {
-    rotation += axis * amount;
+    transformSystem.setRotation(transformIndex, getRotation() + axis * amount);
 }
 
 void Object::setPosition(const glm::vec3& position)
 {
-    this->position = position;
+    transformSystem.setPosition(transformIndex, position);
 }
 
 void Object::setRotation(const glm::vec3& rotation)
 {
-    this->rotation = rotation;
+    transformSystem.setRotation(transformIndex, rotation);
 }
 
 void Object::setScale(const glm::vec3& scale)
 {
-    this->scale = scale;
+    transformSystem.setScale(transformIndex, scale);
+}
+
+void Object::setParent(Object* parent)
+{
+    if (parent == this->parent) {
+        return;
+    }
+    TransformSystem::Index parentIndex = parent ? parent->transformIndex : TransformSystem::INVALID_INDEX;
+    if (!transformSystem.setParent(transformIndex, parentIndex)) {
+        std::cerr << "WARNING: Could not set parent for object: " << name << "\n";
+        return;
+    }
+    if (this->parent) {
+        auto& siblings = this->parent->children;
+        siblings.erase(std::remove(siblings.begin(), siblings.end(), this), siblings.end());
+    }
+    this->parent = parent;
+    if (parent) {
+        parent->children.push_back(this);
+    }
 }
 
 unsigned int Object::getId() const
@@ -90,29 +149,46 @@ std::string Object::getName() const
 
 glm::vec3 Object::getPosition() const
 {
-    return position;
+    return transformSystem.getPosition(transformIndex);
 }
 
 glm::vec3 Object::getRotation() const
 {
-    return rotation;
+    return transformSystem.getRotation(transformIndex);
 }
 
 glm::vec3 Object::getScale() const
 {
-    return scale;
+    return transformSystem.getScale(transformIndex);
+}
+
+glm::vec3 Object::getWorldPosition() const
+{
+    return glm::vec3(transformSystem.getModelMatrix(transformIndex)[3]);
+}
+
+Object* Object::getParent() const
+{
+    return parent;
 }
 
 glm::vec3 Object::getForward() const
 {
+    const glm::vec3& rotation = transformSystem.getRotation(transformIndex);
     glm::vec4 v =
             glm::yawPitchRoll(rotation.y, rotation.x, rotation.z) *
             glm::vec4(FORWARD.x, FORWARD.y, FORWARD.z, 0.0f);
     return glm::vec3(v.x, v.y, v.z);
 }
 
+glm::vec3 Object::getWorldForward() const
+{
+    return glm::normalize(glm::mat3(transformSystem.getModelMatrix(transformIndex)) * FORWARD);
+}
+
 glm::vec3 Object::getUp() const
 {
+    const glm::vec3& rotation = transformSystem.getRotation(transformIndex);
     glm::vec4 v =
             glm::yawPitchRoll(rotation.y, rotation.x, rotation.z) *
             glm::vec4(UP.x, UP.y, UP.z, 0.0f);
@@ -121,6 +197,7 @@ glm::vec3 Object::getUp() const
 
 glm::vec3 Object::getLeft() const
 {
+    const glm::vec3& rotation = transformSystem.getRotation(transformIndex);
     glm::vec4 v =
             glm::yawPitchRoll(rotation.y, rotation.x, rotation.z) *
             glm::vec4(LEFT.x, LEFT.y, LEFT.z, 0.0f);
@@ -137,36 +214,49 @@ bool Object::isShadowCaster() const
     return shadowCaster;
 }
 
+void Object::setOccluder(bool occluder)
+{
+    this->occluder = occluder;
+}
+
+bool Object::isOccluder() const
+{
+    return occluder;
+}
+
+void Object::setStatic(bool isStatic)
+{
+    staticObject = isStatic;
+}
+
+bool Object::isStatic() const
+{
+    return staticObject;
+}
+
 std::vector<Object::MeshObject>& Object::getMeshObjects()
 {
     return meshObjects;
 }
 
-void Object::setUniforms()
+void Object::updateModelMatrix()
 {
-    glBindBuffer(GL_UNIFORM_BUFFER, transformationBlockBuffer);
-    GLintptr matrixSize = sizeof(modelMatrix);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0 * matrixSize, matrixSize, glm::value_ptr(modelMatrix));
-    glBufferSubData(GL_UNIFORM_BUFFER, 2 * matrixSize, matrixSize, glm::value_ptr(modelViewMatrix));
-    glBufferSubData(GL_UNIFORM_BUFFER, 3 * matrixSize, matrixSize, glm::value_ptr(modelViewProjectionMatrix));
-    glBufferSubData(GL_UNIFORM_BUFFER, 4 * matrixSize, matrixSize, glm::value_ptr(normalMatrix));
-    glBindBufferBase(GL_UNIFORM_BUFFER, TRANSFORMATION_BINDING_POINT, transformationBlockBuffer);
+    transformSystem.updateTransform(transformIndex, *view, viewProjection);
 }
 
-void Object::updateModelMatrix()
+const glm::mat4& Object::getModelMatrix() const
 {
-    modelMatrix =
-            glm::translate(position) *
-            glm::yawPitchRoll(rotation.y, rotation.x, rotation.z) *
-            glm::scale(scale);
-    modelViewMatrix = (*view) * modelMatrix;
-    modelViewProjectionMatrix = viewProjection * modelMatrix;
-    normalMatrix = glm::transpose(glm::inverse(modelMatrix));
+    return transformSystem.getModelMatrix(transformIndex);
+}
+
+const glm::mat4& Object::getModelViewMatrix() const
+{
+    return transformSystem.getModelViewMatrix(transformIndex);
 }
 
-glm::mat4x4 Object::getModelMatrix() const
+const glm::mat4& Object::getNormalMatrix() const
 {
-    return modelMatrix;
+    return transformSystem.getNormalMatrix(transformIndex);
 }
 
 } // moar
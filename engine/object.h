@@ -5,6 +5,7 @@
 #include "model.h"
 #include "material.h"
 #include "light.h"
+#include "transformsystem.h"
 
 #include <glm/glm.hpp>
 
@@ -20,13 +21,17 @@ class Object
 {
     friend class Engine;
     friend class Renderer;
+    friend class StaticBatcher;
 
 public:
     struct MeshObject
     {
         Mesh* mesh;
-        Material* material;
+        Handle<Material> material;
         Object* parent;
+        bool visible;
+        unsigned int lod;
+        unsigned int shadowLod;
 
         bool operator==(const MeshObject& rhs) {
             return this->mesh == rhs.mesh && this->material == rhs.material && this->parent == rhs.parent;
@@ -41,6 +46,8 @@ public:
     static const glm::mat4* view;
 
     static void updateViewProjectionMatrix();
+    static void updateTransforms(JobSystem* jobSystem);
+    static const std::vector<Object*>& getChangedObjects();
 
     explicit Object();
     explicit Object(const std::string& name);
@@ -56,19 +63,33 @@ public:
     virtual void setPosition(const glm::vec3& position);
     virtual void setRotation(const glm::vec3& rotation);
     virtual void setScale(const glm::vec3& scale);
+    void setParent(Object* parent);
 
     unsigned int getId() const;
     std::string getName() const;
     glm::vec3 getPosition() const;
     glm::vec3 getRotation() const;
     glm::vec3 getScale() const;
+    glm::vec3 getWorldPosition() const;
+    Object* getParent() const;
     glm::vec3 getForward() const;
+    // Includes the rotations of the parents, as of the last transform update
+    glm::vec3 getWorldForward() const;
     glm::vec3 getUp() const;
     glm::vec3 getLeft() const;
 
     void setShadowCaster(bool caster);
     bool isShadowCaster() const;
 
+    // Occluders are rasterized into the software occlusion buffer, best suited for large walls and floors
+    void setOccluder(bool occluder);
+    bool isOccluder() const;
+
+    // Meshes of static objects are baked into world space batches when a level is loaded.
+    // Moving a static object afterwards does not move its meshes.
+    void setStatic(bool isStatic);
+    bool isStatic() const;
+
     std::vector<MeshObject>& getMeshObjects();
 
     template<typename T>
@@ -84,9 +105,6 @@ public:
     bool hasComponent() const;
 
 protected:
-    glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
-    glm::vec3 rotation = glm::vec3(0.0f, 0.0f, 0.0f);
-    glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
     glm::vec3 forward = FORWARD;
     glm::vec3 up = UP;
     glm::vec3 left = LEFT;
@@ -95,25 +113,29 @@ private:
     static glm::mat4 viewProjection;
     static unsigned int idCounter;
     static GLuint transformationBlockBuffer;
-    static Material* defaultMaterial;
+    static Handle<Material> defaultMaterial;
+    static TransformSystem transformSystem;
+    static std::vector<Object*> transformOwners;
+    static std::vector<Object*> changedObjects;
 
     static void setMeshDefaultMaterial(Material* material);
-    static void setViewMatrixUniform();
+    static void setViewUniforms();
 
-    void setUniforms();
     void updateModelMatrix();
-    glm::mat4x4 getModelMatrix() const;
+    const glm::mat4& getModelMatrix() const;
+    const glm::mat4& getModelViewMatrix() const;
+    const glm::mat4& getNormalMatrix() const;
 
     unsigned int id;
+    TransformSystem::Index transformIndex;
     std::string name = "";
 
-    bool shadowCaster = true;
-    bool shadowReceiver = true;
+    Object* parent = nullptr;
+    std::vector<Object*> children;
 
-    glm::mat4x4 modelMatrix;
-    glm::mat4x4 modelViewMatrix;
-    glm::mat4x4 modelViewProjectionMatrix;
-    glm::mat4x4 normalMatrix;
+    bool shadowCaster = true;
+    bool occluder = false;
+    bool staticObject = false;
 
     std::unique_ptr<Light> light = nullptr;
     Model* model = nullptr;
@@ -162,9 +184,9 @@ inline Model* Object::addComponent<Model>(Model* model)
     this->model = model;
     meshObjects.clear();
     for (const auto& mesh : model->getMeshes()) {
-        Material* mat = mesh->getMaterial();
+        Material* mat = Material::get(mesh->getMaterial());
         bool useDefaultMaterial = mat == nullptr || mat->getNumTextures() == 0;
-        MeshObject mo = {mesh.get(), (useDefaultMaterial ? defaultMaterial : mat), this};
+        MeshObject mo = {mesh.get(), (useDefaultMaterial ? defaultMaterial : mesh->getMaterial()), this, false, 0, 0};
         meshObjects.push_back(mo);
     }
     return model;
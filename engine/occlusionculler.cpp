@@ -0,0 +1,264 @@
+#include "occlusionculler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace moar
+{
+
+namespace
+{
+
+const float MIN_CLIP_W = 1e-5f;
+const unsigned char VERTEX_PENDING = 0;
+const unsigned char VERTEX_VISIBLE = 1;
+const unsigned char VERTEX_CLIPPED = 2;
+
+glm::vec3 toScreen(const glm::vec4& clip)
+{
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    return glm::vec3((ndc.x * 0.5f + 0.5f) * OcclusionCuller::WIDTH,
+                     (ndc.y * 0.5f + 0.5f) * OcclusionCuller::HEIGHT,
+                     ndc.z * 0.5f + 0.5f);
+}
+
+} // anonymous
+
+OcclusionCuller::OcclusionCuller() :
+    depth(WIDTH * HEIGHT, 1.0f),
+    tileMaxDepth(TILES_X * TILES_Y, 1.0f)
+{
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+}
+
+void OcclusionCuller::clear()
+{
+    numOccluders = 0;
+    numTriangles = 0;
+}
+
+void OcclusionCuller::addOccluder(const glm::mat4& modelViewProjection, const std::vector<glm::vec3>& positions,
+                                  const std::vector<unsigned int>& indices)
+{
+    if (numOccluders == occluders.size()) {
+        occluders.emplace_back();
+    }
+    Occluder& occluder = occluders[numOccluders++];
+    occluder.modelViewProjection = modelViewProjection;
+    occluder.positions = &positions;
+    occluder.indices = &indices;
+}
+
+void OcclusionCuller::setupOccluder(Occluder& occluder) const
+{
+    occluder.triangles.clear();
+    for (auto& bin : occluder.bins) {
+        bin.clear();
+    }
+    const std::vector<glm::vec3>& positions = *occluder.positions;
+    const std::vector<unsigned int>& indices = *occluder.indices;
+    occluder.screen.resize(positions.size());
+    occluder.vertexStates.assign(positions.size(), VERTEX_PENDING);
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        // Vertices shared by several triangles are only transformed by the first one
+        bool clipped = false;
+        for (size_t j = 0; j < 3; ++j) {
+            unsigned int vertex = indices[i + j];
+            if (occluder.vertexStates[vertex] == VERTEX_PENDING) {
+                glm::vec4 clip = occluder.modelViewProjection * glm::vec4(positions[vertex], 1.0f);
+                bool outside = clip.w < MIN_CLIP_W || clip.z < -clip.w;
+                occluder.vertexStates[vertex] = outside ? VERTEX_CLIPPED : VERTEX_VISIBLE;
+                if (!outside) {
+                    occluder.screen[vertex] = toScreen(clip);
+                }
+            }
+            clipped = clipped || occluder.vertexStates[vertex] == VERTEX_CLIPPED;
+        }
+        if (clipped) {
+            continue;
+        }
+
+        const glm::vec3 screen[3] = {occluder.screen[indices[i]], occluder.screen[indices[i + 1]],
+                                     occluder.screen[indices[i + 2]]};
+        const glm::vec3& v0 = screen[0];
+        const glm::vec3& v1 = screen[1];
+        const glm::vec3& v2 = screen[2];
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+        if (area <= 0.0f) {
+            continue;
+        }
+
+        Triangle triangle;
+        triangle.minX = std::max(0, static_cast<int>(std::floor(std::min(std::min(v0.x, v1.x), v2.x))));
+        triangle.maxX = std::min(WIDTH - 1, static_cast<int>(std::ceil(std::max(std::max(v0.x, v1.x), v2.x))));
+        triangle.minY = std::max(0, static_cast<int>(std::floor(std::min(std::min(v0.y, v1.y), v2.y))));
+        triangle.maxY = std::min(HEIGHT - 1, static_cast<int>(std::ceil(std::max(std::max(v0.y, v1.y), v2.y))));
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+            continue;
+        }
+
+        for (size_t j = 0; j < 3; ++j) {
+            const glm::vec3& a = screen[j];
+            const glm::vec3& b = screen[(j + 1) % 3];
+            triangle.edgeA[j] = a.y - b.y;
+            triangle.edgeB[j] = b.x - a.x;
+            triangle.edgeC[j] = a.x * b.y - a.y * b.x;
+        }
+        triangle.depthDx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+        triangle.depthDy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+        triangle.depthAtOrigin = v0.z - triangle.depthDx * v0.x - triangle.depthDy * v0.y;
+        triangle.depthBias = 0.5f * (std::abs(triangle.depthDx) + std::abs(triangle.depthDy));
+        triangle.maxDepth = std::max(std::max(v0.z, v1.z), v2.z);
+
+        unsigned int index = static_cast<unsigned int>(occluder.triangles.size());
+        occluder.triangles.push_back(triangle);
+        for (int tileY = triangle.minY / TILE_SIZE; tileY <= triangle.maxY / TILE_SIZE; ++tileY) {
+            occluder.bins[tileY].push_back(index);
+        }
+    }
+}
+
+void OcclusionCuller::rasterize(JobSystem* jobSystem)
+{
+    // Each occluder has its own triangles and bins, so the setup needs no synchronization
+    jobSystem->parallelFor(0, static_cast<unsigned int>(numOccluders), 1, [this] (unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; ++i) {
+            setupOccluder(occluders[i]);
+        }
+    });
+    numTriangles = 0;
+    for (size_t i = 0; i < numOccluders; ++i) {
+        numTriangles += occluders[i].triangles.size();
+    }
+
+    jobSystem->parallelFor(0, TILES_Y, 1, [this] (unsigned int begin, unsigned int end) {
+        for (unsigned int tileY = begin; tileY < end; ++tileY) {
+            rasterizeTileRow(static_cast<int>(tileY));
+        }
+    });
+}
+
+bool OcclusionCuller::isOccluded(const glm::mat4& modelViewProjection, const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+    if (numTriangles == 0) {
+        return false;
+    }
+
+    glm::vec2 screenMin(static_cast<float>(WIDTH), static_cast<float>(HEIGHT));
+    glm::vec2 screenMax(0.0f);
+    float nearestDepth = 1.0f;
+    for (int i = 0; i < 8; ++i) {
+        glm::vec3 corner((i & 1) ? boxMax.x : boxMin.x, (i & 2) ? boxMax.y : boxMin.y, (i & 4) ? boxMax.z : boxMin.z);
+        glm::vec4 clip = modelViewProjection * glm::vec4(corner, 1.0f);
+        if (clip.w < MIN_CLIP_W || clip.z < -clip.w) {
+            return false;
+        }
+        glm::vec3 screen = toScreen(clip);
+        screenMin = glm::min(screenMin, glm::vec2(screen.x, screen.y));
+        screenMax = glm::max(screenMax, glm::vec2(screen.x, screen.y));
+        nearestDepth = std::min(nearestDepth, screen.z);
+    }
+
+    int minX = std::max(0, static_cast<int>(std::floor(screenMin.x)));
+    int maxX = std::min(WIDTH - 1, static_cast<int>(std::floor(screenMax.x)));
+    int minY = std::max(0, static_cast<int>(std::floor(screenMin.y)));
+    int maxY = std::min(HEIGHT - 1, static_cast<int>(std::floor(screenMax.y)));
+    if (minX > maxX || minY > maxY) {
+        return false;
+    }
+
+    for (int tileY = minY / TILE_SIZE; tileY <= maxY / TILE_SIZE; ++tileY) {
+        for (int tileX = minX / TILE_SIZE; tileX <= maxX / TILE_SIZE; ++tileX) {
+            if (tileMaxDepth[tileY * TILES_X + tileX] < nearestDepth) {
+                continue;
+            }
+            int x0 = std::max(minX, tileX * TILE_SIZE);
+            int x1 = std::min(maxX, tileX * TILE_SIZE + TILE_SIZE - 1);
+            int y0 = std::max(minY, tileY * TILE_SIZE);
+            int y1 = std::min(maxY, tileY * TILE_SIZE + TILE_SIZE - 1);
+            for (int y = y0; y <= y1; ++y) {
+                for (int x = x0; x <= x1; ++x) {
+                    if (depthAt(x, y) >= nearestDepth) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+size_t OcclusionCuller::getNumTriangles() const
+{
+    return numTriangles;
+}
+
+void OcclusionCuller::rasterizeTileRow(int tileY)
+{
+    // Tiles are stored contiguously, so one row of tiles is a contiguous range of the buffer
+    float* row = &depth[tileY * TILES_X * TILE_SIZE * TILE_SIZE];
+    std::fill(row, row + TILES_X * TILE_SIZE * TILE_SIZE, 1.0f);
+
+    int rowBegin = tileY * TILE_SIZE;
+    int rowEnd = rowBegin + TILE_SIZE;
+    for (size_t i = 0; i < numOccluders; ++i) {
+        const Occluder& occluder = occluders[i];
+        for (unsigned int index : occluder.bins[tileY]) {
+            rasterizeTriangle(occluder.triangles[index], rowBegin, rowEnd);
+        }
+    }
+
+    for (int tileX = 0; tileX < TILES_X; ++tileX) {
+        const float* tile = row + tileX * TILE_SIZE * TILE_SIZE;
+        tileMaxDepth[tileY * TILES_X + tileX] = *std::max_element(tile, tile + TILE_SIZE * TILE_SIZE);
+    }
+}
+
+void OcclusionCuller::rasterizeTriangle(const Triangle& triangle, int rowBegin, int rowEnd)
+{
+    int y0 = std::max(triangle.minY, rowBegin);
+    int y1 = std::min(triangle.maxY + 1, rowEnd);
+    for (int y = y0; y < y1; ++y) {
+        float centerY = static_cast<float>(y) + 0.5f;
+        float centerX = static_cast<float>(triangle.minX) + 0.5f;
+        float e0 = triangle.edgeA[0] * centerX + triangle.edgeB[0] * centerY + triangle.edgeC[0];
+        float e1 = triangle.edgeA[1] * centerX + triangle.edgeB[1] * centerY + triangle.edgeC[1];
+        float e2 = triangle.edgeA[2] * centerX + triangle.edgeB[2] * centerY + triangle.edgeC[2];
+        float z = triangle.depthAtOrigin + triangle.depthDx * centerX + triangle.depthDy * centerY + triangle.depthBias;
+
+        // Pixels of a row within one tile are contiguous. The edge functions and the depth step by
+        // a constant per pixel and the store is a select, so the inner loop vectorizes.
+        int x = triangle.minX;
+        while (x <= triangle.maxX) {
+            int spanEnd = std::min(triangle.maxX + 1, (x / TILE_SIZE + 1) * TILE_SIZE);
+            float* pixels = &depthAt(x, y);
+            for (int i = 0; x < spanEnd; ++i, ++x) {
+                bool inside = e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f;
+                float written = std::min(pixels[i], std::min(z, triangle.maxDepth));
+                pixels[i] = inside ? written : pixels[i];
+                e0 += triangle.edgeA[0];
+                e1 += triangle.edgeA[1];
+                e2 += triangle.edgeA[2];
+                z += triangle.depthDx;
+            }
+        }
+    }
+}
+
+float& OcclusionCuller::depthAt(int x, int y)
+{
+    int tile = (y / TILE_SIZE) * TILES_X + x / TILE_SIZE;
+    return depth[tile * TILE_SIZE * TILE_SIZE + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
+}
+
+float OcclusionCuller::depthAt(int x, int y) const
+{
+    int tile = (y / TILE_SIZE) * TILES_X + x / TILE_SIZE;
+    return depth[tile * TILE_SIZE * TILE_SIZE + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
+}
+
+} // moar
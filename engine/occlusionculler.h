@@ -0,0 +1,89 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include "jobsystem.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <array>
+#include <cstddef>
+
+namespace moar
+{
+
+// Low resolution software depth buffer for occlusion culling on the CPU. The occluders are set
+// up and their triangles binned by tile row in parallel, then the rows are rasterized in parallel. Depth is written conservatively,
+// every pixel gets the farthest depth its triangle has within the pixel. Each tile also keeps
+// its farthest depth so that most bounding box tests are resolved without visiting pixels.
+class OcclusionCuller
+{
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+    static const int TILE_SIZE = 8;
+    static const int TILES_X = WIDTH / TILE_SIZE;
+    static const int TILES_Y = HEIGHT / TILE_SIZE;
+
+    explicit OcclusionCuller();
+    ~OcclusionCuller();
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller(OcclusionCuller&&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(OcclusionCuller&&) = delete;
+
+    void clear();
+    // Front facing triangles are counter clockwise, triangles crossing the near plane are skipped.
+    // The geometry is referenced until rasterize() returns.
+    void addOccluder(const glm::mat4& modelViewProjection, const std::vector<glm::vec3>& positions,
+                     const std::vector<unsigned int>& indices);
+    void rasterize(JobSystem* jobSystem);
+    // Safe to call from several threads once the occluders have been rasterized
+    bool isOccluded(const glm::mat4& modelViewProjection, const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+    size_t getNumTriangles() const;
+
+private:
+    struct Triangle
+    {
+        std::array<float, 3> edgeA;     // Edge functions are positive inside the triangle
+        std::array<float, 3> edgeB;
+        std::array<float, 3> edgeC;
+        float depthAtOrigin;
+        float depthDx;
+        float depthDy;
+        float depthBias;                // From the pixel center to its farthest corner
+        float maxDepth;
+        int minX;
+        int maxX;
+        int minY;
+        int maxY;
+    };
+
+    // Kept across frames so that the per occluder storage is reused
+    struct Occluder
+    {
+        glm::mat4 modelViewProjection;
+        const std::vector<glm::vec3>* positions;
+        const std::vector<unsigned int>* indices;
+        std::vector<glm::vec3> screen;          // Of the vertices the indices reference
+        std::vector<unsigned char> vertexStates;
+        std::vector<Triangle> triangles;
+        std::array<std::vector<unsigned int>, TILES_Y> bins;
+    };
+
+    void setupOccluder(Occluder& occluder) const;
+    void rasterizeTileRow(int tileY);
+    void rasterizeTriangle(const Triangle& triangle, int rowBegin, int rowEnd);
+    float& depthAt(int x, int y);
+    float depthAt(int x, int y) const;
+
+    std::vector<Occluder> occluders;
+    size_t numOccluders = 0;
+    size_t numTriangles = 0;
+    std::vector<float> depth;
+    std::vector<float> tileMaxDepth;
+};
+
+} // moar
+
+#endif // OCCLUSIONCULLER_H
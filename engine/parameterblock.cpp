@@ -0,0 +1,86 @@
+#include "parameterblock.h"
+#include "common/globals.h"
+
+namespace moar
+{
+
+ParameterBlock::ParameterBlock()
+{
+}
+
+ParameterBlock::~ParameterBlock()
+{
+    glDeleteBuffers(1, &buffer);
+}
+
+bool ParameterBlock::init(GLuint program)
+{
+    GLuint blockIndex = glGetUniformBlockIndex(program, PARAMETER_BLOCK_NAME.c_str());
+    if (blockIndex == GL_INVALID_INDEX) {
+        return false;
+    }
+
+    GLint size = 0;
+    GLint numUniforms = 0;
+    glGetActiveUniformBlockiv(program, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+    glGetActiveUniformBlockiv(program, blockIndex, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &numUniforms);
+    std::vector<GLint> indices(numUniforms);
+    if (numUniforms > 0) {
+        glGetActiveUniformBlockiv(program, blockIndex, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, &indices[0]);
+    }
+
+    parameters.clear();
+    for (GLint index : indices) {
+        GLuint uniform = static_cast<GLuint>(index);
+        GLint nameLength = 0;
+        glGetActiveUniformsiv(program, 1, &uniform, GL_UNIFORM_NAME_LENGTH, &nameLength);
+        std::vector<GLchar> name(nameLength + 1);
+        glGetActiveUniformName(program, uniform, name.size(), NULL, &name[0]);
+        GLint arraySize = 0;
+        glGetActiveUniformsiv(program, 1, &uniform, GL_UNIFORM_SIZE, &arraySize);
+        if (arraySize > 1) {
+            std::cerr << "WARNING: Array parameter " << &name[0] << " is not supported, it is left out\n";
+            continue;
+        }
+        Parameter parameter;
+        parameter.name = &name[0];
+        glGetActiveUniformsiv(program, 1, &uniform, GL_UNIFORM_OFFSET, &parameter.offset);
+        GLint type = 0;
+        glGetActiveUniformsiv(program, 1, &uniform, GL_UNIFORM_TYPE, &type);
+        parameter.type = static_cast<GLenum>(type);
+        parameters.push_back(parameter);
+    }
+
+    data.assign(size, 0);
+    if (!buffer) {
+        glGenBuffers(1, &buffer);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, size, &data[0], GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    dirty = false;
+    return true;
+}
+
+int ParameterBlock::getIndex(const std::string& name) const
+{
+    for (unsigned int i = 0; i < parameters.size(); ++i) {
+        if (parameters[i].name == name) {
+            return i;
+        }
+    }
+    std::cerr << "WARNING: Parameter not found: " << name << "\n";
+    return -1;
+}
+
+void ParameterBlock::bind()
+{
+    if (dirty) {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, data.size(), &data[0]);
+        dirty = false;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, PARAMETER_BINDING_POINT, buffer);
+}
+
+} // moar
@@ -0,0 +1,84 @@
+#ifndef PARAMETERBLOCK_H
+#define PARAMETERBLOCK_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+
+namespace moar
+{
+
+// Plain data of the ParameterBlock uniform block of a shader. The layout is read from the
+// program, parameters are written to a CPU copy and the buffer is updated only when bound
+// after a change.
+class ParameterBlock
+{
+public:
+    explicit ParameterBlock();
+    ~ParameterBlock();
+    ParameterBlock(const ParameterBlock&) = delete;
+    ParameterBlock(ParameterBlock&&) = delete;
+    ParameterBlock& operator=(const ParameterBlock&) = delete;
+    ParameterBlock& operator=(ParameterBlock&&) = delete;
+
+    // False if the program does not declare the block. Arrays are not supported and left out.
+    bool init(GLuint program);
+    // Returns -1 if there is no such parameter, the index stays valid for the lifetime of the block
+    int getIndex(const std::string& name) const;
+
+    template<typename T>
+    void set(int index, const T& value);
+    template<typename T>
+    void set(const std::string& name, const T& value);
+
+    // Uploads the changes and binds the buffer to the parameter binding point
+    void bind();
+
+private:
+    struct Parameter
+    {
+        std::string name;
+        GLint offset;
+        GLenum type;
+    };
+
+    static GLenum getType(float) { return GL_FLOAT; }
+    static GLenum getType(int) { return GL_INT; }
+    static GLenum getType(const glm::vec2&) { return GL_FLOAT_VEC2; }
+    static GLenum getType(const glm::vec3&) { return GL_FLOAT_VEC3; }
+    static GLenum getType(const glm::vec4&) { return GL_FLOAT_VEC4; }
+    static GLenum getType(const glm::mat4&) { return GL_FLOAT_MAT4; }
+
+    GLuint buffer = 0;
+    std::vector<Parameter> parameters;
+    std::vector<unsigned char> data;
+    bool dirty = false;
+};
+
+template<typename T>
+void ParameterBlock::set(int index, const T& value)
+{
+    if (index < 0 || index >= static_cast<int>(parameters.size()) || parameters[index].type != getType(value)) {
+        std::cerr << "WARNING: Parameter type does not match the block layout\n";
+        return;
+    }
+    unsigned char* target = &data[parameters[index].offset];
+    if (std::memcmp(target, &value, sizeof(T)) != 0) {
+        std::memcpy(target, &value, sizeof(T));
+        dirty = true;
+    }
+}
+
+template<typename T>
+void ParameterBlock::set(const std::string& name, const T& value)
+{
+    set(getIndex(name), value);
+}
+
+} // moar
+
+#endif // PARAMETERBLOCK_H
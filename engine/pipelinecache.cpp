@@ -0,0 +1,103 @@
+#include "pipelinecache.h"
+
+namespace moar
+{
+
+namespace
+{
+
+void setCapability(GLenum capability, bool enabled)
+{
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+}
+
+} // anonymous
+
+const PipelineCache::Handle PipelineCache::INVALID_HANDLE;
+
+PipelineCache::PipelineCache()
+{
+}
+
+PipelineCache::~PipelineCache()
+{
+}
+
+PipelineCache::Handle PipelineCache::create(const Shader* shader, const State& state)
+{
+    pipelines.push_back(Pipeline{shader, state});
+    return static_cast<Handle>(pipelines.size() - 1);
+}
+
+const Shader* PipelineCache::getShader(Handle handle) const
+{
+    return pipelines[handle].shader;
+}
+
+void PipelineCache::bind(Handle handle)
+{
+    const Pipeline& pipeline = pipelines[handle];
+    GLuint program = pipeline.shader->getProgram();
+    if (!valid || program != currentProgram) {
+        glUseProgram(program);
+        currentProgram = program;
+    }
+    apply(pipeline.state);
+    current = pipeline.state;
+    valid = true;
+}
+
+void PipelineCache::invalidate()
+{
+    valid = false;
+}
+
+void PipelineCache::apply(const State& state)
+{
+    if (!valid || state.depthTest != current.depthTest) {
+        setCapability(GL_DEPTH_TEST, state.depthTest);
+    }
+    if (!valid || state.depthWrite != current.depthWrite) {
+        glDepthMask(state.depthWrite ? GL_TRUE : GL_FALSE);
+    }
+    if (!valid || state.depthFunc != current.depthFunc) {
+        glDepthFunc(state.depthFunc);
+    }
+    if (!valid || state.cullFace != current.cullFace) {
+        setCapability(GL_CULL_FACE, state.cullFace);
+    }
+    if (!valid || state.cullMode != current.cullMode) {
+        glCullFace(state.cullMode);
+    }
+    if (!valid) {
+        glBlendEquation(GL_FUNC_ADD);
+        glBlendFunc(GL_ONE, GL_ONE);
+    }
+    if (!valid || state.blend != current.blend) {
+        setCapability(GL_BLEND, state.blend);
+    }
+    if (!valid || state.colorWrite != current.colorWrite) {
+        GLboolean write = state.colorWrite ? GL_TRUE : GL_FALSE;
+        glColorMask(write, write, write, write);
+    }
+    if (!valid || state.stencilTest != current.stencilTest) {
+        setCapability(GL_STENCIL_TEST, state.stencilTest);
+    }
+    if (!valid || state.stencilFunc != current.stencilFunc) {
+        glStencilFunc(state.stencilFunc, 0, 0xFF);
+    }
+    if (!valid || state.stencilVolume != current.stencilVolume) {
+        if (state.stencilVolume) {
+            glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+            glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+        } else {
+            glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        }
+    }
+}
+
+} // moar
@@ -0,0 +1,67 @@
+#ifndef PIPELINECACHE_H
+#define PIPELINECACHE_H
+
+#include "shader.h"
+
+#include <GL/glew.h>
+
+#include <vector>
+
+namespace moar
+{
+
+// Immutable bundles of a program and the raster state it is drawn with, addressed by the index
+// they were created at. Binding one changes only the state that differs from the bound one.
+// The vertex format is not part of a pipeline, each format has its own vertex array.
+class PipelineCache
+{
+public:
+    using Handle = unsigned int;
+
+    static const Handle INVALID_HANDLE = ~0u;
+
+    struct State
+    {
+        bool depthTest = true;
+        bool depthWrite = true;
+        GLenum depthFunc = GL_LEQUAL;
+        bool cullFace = true;
+        GLenum cullMode = GL_BACK;
+        bool blend = false;         // Additive
+        bool colorWrite = true;
+        bool stencilTest = false;
+        GLenum stencilFunc = GL_ALWAYS;
+        bool stencilVolume = false; // Back faces increment and front faces decrement where the depth test fails
+    };
+
+    explicit PipelineCache();
+    ~PipelineCache();
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache(PipelineCache&&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+    PipelineCache& operator=(PipelineCache&&) = delete;
+
+    Handle create(const Shader* shader, const State& state);
+    const Shader* getShader(Handle handle) const;
+    void bind(Handle handle);
+    // Called after the program or the raster state has been changed outside of the cache
+    void invalidate();
+
+private:
+    struct Pipeline
+    {
+        const Shader* shader;
+        State state;
+    };
+
+    void apply(const State& state);
+
+    std::vector<Pipeline> pipelines;
+    State current;
+    GLuint currentProgram = 0;
+    bool valid = false;
+};
+
+} // moar
+
+#endif // PIPELINECACHE_H
@@ -17,7 +17,7 @@ void PostFramebuffer::initQuad()
     };
 
     glGenVertexArrays(1, &quadVAO);
-    glBindVertexArray(quadVAO);
+    bindQuadVAO();
 
     glGenBuffers(1, &quadBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
@@ -36,6 +36,7 @@ void PostFramebuffer::uninitQuad()
 void PostFramebuffer::bindQuadVAO()
 {
     glBindVertexArray(quadVAO);
+    G_BOUND_VERTEX_ARRAY = quadVAO;
 }
 
 PostFramebuffer::PostFramebuffer()
@@ -12,8 +12,12 @@ Postprocess::Postprocess()
 Postprocess::Postprocess(const std::string& name, GLuint shader, int priority) :
     name(name),
     shader(shader),
-    priority(priority)
+    priority(priority),
+    parameters(new ParameterBlock())
 {
+    if (!parameters->init(shader)) {
+        parameters.reset();
+    }
 }
 
 Postprocess::~Postprocess()
@@ -24,7 +28,7 @@ Postprocess::Postprocess(const Postprocess& rhs) :
     name(rhs.name),
     shader(rhs.shader),
     priority(rhs.priority),
-    uniforms(rhs.uniforms)
+    parameters(rhs.parameters)
 {
 }
 
@@ -32,7 +36,7 @@ Postprocess::Postprocess(Postprocess&& rhs) :
     name(std::move(rhs.name)),
     shader(std::move(rhs.shader)),
     priority(std::move(rhs.priority)),
-    uniforms(std::move(rhs.uniforms))
+    parameters(std::move(rhs.parameters))
 {
 }
 
@@ -40,7 +44,7 @@ Postprocess& Postprocess::operator=(Postprocess& rhs) {
     std::swap(name, rhs.name);
     std::swap(shader, rhs.shader);
     std::swap(priority, rhs.priority);
-    std::swap(uniforms, rhs.uniforms);
+    std::swap(parameters, rhs.parameters);
     return *this;
 }
 
@@ -48,21 +52,21 @@ Postprocess& Postprocess::operator=(Postprocess&& rhs) {
     name = std::move(rhs.name);
     shader = std::move(rhs.shader);
     priority = std::move(rhs.priority);
-    uniforms = std::move(rhs.uniforms);
+    parameters = std::move(rhs.parameters);
     return *this;
 }
 
 void Postprocess::bind() const
 {
     glUseProgram(shader);
-    for (auto iter = uniforms.begin(); iter != uniforms.end(); ++iter) {
-        iter->second();
+    if (parameters) {
+        parameters->bind();
     }
 }
 
-void Postprocess::setUniform(const std::string& name, std::function<void()> func)
+ParameterBlock* Postprocess::getParameters() const
 {
-    uniforms[name] = func;
+    return parameters.get();
 }
 
 std::string Postprocess::getName() const
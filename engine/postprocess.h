@@ -1,11 +1,12 @@
 #ifndef POSTPROCESS_H
 #define POSTPROCESS_H
 
+#include "parameterblock.h"
+
 #include <GL/glew.h>
 
 #include <string>
-#include <functional>
-#include <unordered_map>
+#include <memory>
 
 namespace moar
 {
@@ -22,7 +23,8 @@ public:
     Postprocess& operator=(Postprocess&&);
 
     void bind() const;
-    void setUniform(const std::string& name, std::function<void()> func);
+    // Of the ParameterBlock of the shader, nullptr if it has none
+    ParameterBlock* getParameters() const;
 
     std::string getName() const;
     int getPriority() const;
@@ -31,7 +33,7 @@ private:
     std::string name;
     GLuint shader = 0;
     int priority = 0;
-    std::unordered_map<std::string, std::function<void()>> uniforms;
+    std::shared_ptr<ParameterBlock> parameters;  // Shared by the copies
 };
 
 } // moar
@@ -0,0 +1,138 @@
+#include "programcache.h"
+#include "mappedfile.h"
+#include "hash.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+namespace moar
+{
+
+namespace
+{
+
+const char CACHE_MAGIC[8] = {'M', 'O', 'A', 'R', 'P', 'R', 'O', 'G'};
+const uint32_t CACHE_VERSION = 1;
+const char* CACHE_EXTENSION = ".program";
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint64_t key;
+    uint64_t size;
+};
+
+} // anonymous
+
+ProgramCache::ProgramCache()
+{
+}
+
+ProgramCache::~ProgramCache()
+{
+}
+
+void ProgramCache::setPath(const std::string& cachePath)
+{
+    path = cachePath;
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    if (!path.empty() && numFormats == 0) {
+        std::cerr << "WARNING: The driver has no program binary formats, shaders are not cached\n";
+        path.clear();
+    }
+
+    driverHash = HASH_SEED;
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const GLubyte* value = glGetString(name);
+        if (value) {
+            driverHash = hashBytes(value, std::strlen(reinterpret_cast<const char*>(value)), driverHash);
+        }
+    }
+}
+
+bool ProgramCache::isEnabled() const
+{
+    return !path.empty();
+}
+
+uint64_t ProgramCache::computeKey(uint64_t sourceHash) const
+{
+    return hashBytes(&sourceHash, sizeof(sourceHash), driverHash);
+}
+
+bool ProgramCache::load(uint64_t key, GLuint program) const
+{
+    MappedFile file;
+    if (!file.open(getCacheFile(key))) {
+        return false;
+    }
+
+    FileHeader header;
+    if (file.getSize() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, file.getData(), sizeof(header));
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION ||
+        header.key != key || file.getSize() - sizeof(header) < header.size) {
+        return false;
+    }
+
+    glProgramBinary(program, header.format, file.getData() + sizeof(header), static_cast<GLsizei>(header.size));
+    GLint isLinked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+    return isLinked == GL_TRUE;
+}
+
+bool ProgramCache::store(uint64_t key, GLuint program) const
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return false;
+    }
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, &binary[0]);
+
+    // Written next to the final file and renamed so that an interrupted write is never read
+    std::string cacheFile = getCacheFile(key);
+    std::string temporaryFile = cacheFile + ".tmp";
+    std::ofstream out(temporaryFile, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.format = format;
+    header.key = key;
+    header.size = static_cast<uint64_t>(length);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(&binary[0], length);
+
+    out.close();
+    if (!out) {
+        std::remove(temporaryFile.c_str());
+        return false;
+    }
+    std::remove(cacheFile.c_str());
+    return std::rename(temporaryFile.c_str(), cacheFile.c_str()) == 0;
+}
+
+std::string ProgramCache::getCacheFile(uint64_t key) const
+{
+    std::stringstream ss;
+    ss << path << std::hex << std::setw(16) << std::setfill('0') << key << CACHE_EXTENSION;
+    return ss.str();
+}
+
+} // moar
@@ -0,0 +1,43 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <GL/glew.h>
+
+#include <string>
+#include <cstdint>
+
+namespace moar
+{
+
+// Linked program binaries on disk. A binary is valid for one set of preprocessed sources and
+// one driver, a binary that the driver rejects is relinked from the sources and rewritten.
+class ProgramCache
+{
+public:
+    explicit ProgramCache();
+    ~ProgramCache();
+    ProgramCache(const ProgramCache&) = delete;
+    ProgramCache(ProgramCache&&) = delete;
+    ProgramCache& operator=(const ProgramCache&) = delete;
+    ProgramCache& operator=(ProgramCache&&) = delete;
+
+    // Caching is disabled with an empty path, requires a current context
+    void setPath(const std::string& path);
+    bool isEnabled() const;
+
+    // Hash of the sources combined with the vendor, renderer and version of the driver
+    uint64_t computeKey(uint64_t sourceHash) const;
+    // The program is linked if this succeeds
+    bool load(uint64_t key, GLuint program) const;
+    bool store(uint64_t key, GLuint program) const;
+
+private:
+    std::string getCacheFile(uint64_t key) const;
+
+    std::string path;
+    uint64_t driverHash = 0;
+};
+
+} // moar
+
+#endif // PROGRAMCACHE_H
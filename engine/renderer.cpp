@@ -19,12 +19,13 @@ const GLint PROJECTION_ELEMENT_SIZE = 64;
 constexpr GLintptr COLOR_OFFSET = 0;
 constexpr GLintptr POS_OFFSET = MAX_NUM_LIGHTS_PER_TYPE * COLOR_ELEMENT_SIZE;
 constexpr GLintptr FORWARD_OFFSET = MAX_NUM_LIGHTS_PER_TYPE * COLOR_ELEMENT_SIZE * 2;
+const unsigned int CULLING_GRAIN_SIZE = 128;
+const size_t INITIAL_CLUSTER_COMMAND_CAPACITY = 1024;
 
-void enableBlending()
+float getMaxScale(const glm::mat4& model)
 {
-    glEnable(GL_BLEND);
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_ONE, GL_ONE);
+    return std::max(std::max(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1]))),
+                    glm::length(glm::vec3(model[2])));
 }
 
 } // anonymous
@@ -35,6 +36,11 @@ Renderer::Renderer()
         depthMapPointers[Light::POINT].push_back(&pointDepthMaps[i]);
         depthMapPointers[Light::DIRECTIONAL].push_back(&dirDepthMaps[i]);
     }
+    MaterialPipelines unused;
+    unused.gBuffer = PipelineCache::INVALID_HANDLE;
+    unused.forwardLight.fill(PipelineCache::INVALID_HANDLE);
+    materialPipelines.fill(unused);
+    fixedPipelines.fill(PipelineCache::INVALID_HANDLE);
 
     std::uniform_real_distribution<GLfloat> distribution(-1.0, 1.0);
     std::default_random_engine random;
@@ -54,19 +60,28 @@ Renderer::~Renderer()
     glDeleteBuffers(1, &Light::lightBlockBuffer);
     glDeleteBuffers(1, &Light::lightProjectionBlockBuffer);
     glDeleteBuffers(1, &Object::transformationBlockBuffer);
+    glDeleteBuffers(1, &clusterCommandBuffer);
+    glDeleteBuffers(1, &materialBuffer);
     PostFramebuffer::uninitQuad();
 }
 
-bool Renderer::init(const RenderSettings* settings, ResourceManager* manager)
+bool Renderer::init(const RenderSettings* settings, ResourceManager* manager, JobSystem* jobs)
 {
-    if (settings && manager) {
+    if (settings && manager && jobs) {
         renderSettings = settings;
         resourceManager = manager;
+        jobSystem = jobs;
     } else {
         std::cerr << "ERROR: Invalid render settings\n";
         return false;
     }
 
+    // Vertex arrays of the geometry buffers refer to the instance buffer, so create it before any mesh
+    instanceBuffer.init();
+    GeometryBuffer::setInstanceBuffer(instanceBuffer.getBuffer());
+    glGenBuffers(1, &clusterCommandBuffer);
+    glGenBuffers(1, &materialBuffer);
+
     lightSphere.reset(new Object);
     Model* sphereModel = manager->getModel("lowpoly_sphere.obj");
     lightSphere->addComponent<Model>(sphereModel);
@@ -85,6 +100,17 @@ bool Renderer::init(const RenderSettings* settings, ResourceManager* manager)
     Framebuffer::setSize(renderSettings->windowWidth, renderSettings->windowHeight);
     PostFramebuffer::initQuad();
 
+    if (renderSettings->gpuCulling) {
+        gpuCullerReady = gpuCuller.init(manager->getShaderProgramByName("gpu_cull"),
+                                        manager->getShaderProgramByName("gpu_cull_compact"),
+                                        manager->getShaderProgramByName("depth_pyramid"));
+        if (gpuCullerReady) {
+            gpuCuller.setDepthSize(renderSettings->windowWidth, renderSettings->windowHeight);
+        } else {
+            std::cerr << "WARNING: GPU culling disabled\n";
+        }
+    }
+
     GLuint lightBuffer;
     glGenBuffers(1, &lightBuffer);
     glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
@@ -102,15 +128,132 @@ bool Renderer::init(const RenderSettings* settings, ResourceManager* manager)
     GLuint transformationBuffer;
     glGenBuffers(1, &transformationBuffer);
     glBindBuffer(GL_UNIFORM_BUFFER, transformationBuffer);
-    GLsizeiptr transformationBufferSize = 5 * sizeof(*Object::projection);
+    GLsizeiptr transformationBufferSize = 2 * sizeof(*Object::projection);
     glBufferData(GL_UNIFORM_BUFFER, transformationBufferSize, 0, GL_DYNAMIC_DRAW);
     Object::transformationBlockBuffer = transformationBuffer;
 
     glEnable(GL_MULTISAMPLE);
 
+    if (!createFixedPipelines()) {
+        return false;
+    }
+
+    frameGraph.clear();
+    JobSystem::TaskGraph::TaskId containers = frameGraph.addTask([this] { updateObjectContainers(*frameObjects); });
+    JobSystem::TaskGraph::TaskId closest = frameGraph.addTask([this] { updateClosestLights(); });
+    JobSystem::TaskGraph::TaskId occluders = frameGraph.addTask([this] { rasterizeOccluders(); });
+    JobSystem::TaskGraph::TaskId culling = frameGraph.addTask([this] { cullMeshObjects(); });
+    JobSystem::TaskGraph::TaskId instancing = frameGraph.addTask([this] { buildInstancedDraws(); });
+    frameGraph.addDependency(closest, containers);
+    frameGraph.addDependency(occluders, containers);
+    frameGraph.addDependency(culling, occluders);
+    frameGraph.addDependency(instancing, culling);
+
     return true;
 }
 
+bool Renderer::createFixedPipelines()
+{
+    PipelineCache::State opaque;
+
+    PipelineCache::State skybox;
+    skybox.depthWrite = false;
+    skybox.cullMode = GL_FRONT;
+
+    PipelineCache::State stencil;
+    stencil.depthWrite = false;
+    stencil.colorWrite = false;
+    stencil.cullFace = false;
+    stencil.stencilTest = true;
+    stencil.stencilVolume = true;
+
+    // Lights add to the ambient pass, the point lights shade where their stencil volume is set
+    PipelineCache::State pointLight;
+    pointLight.depthTest = false;
+    pointLight.depthWrite = false;
+    pointLight.cullMode = GL_FRONT;
+    pointLight.blend = true;
+    pointLight.stencilTest = true;
+    pointLight.stencilFunc = GL_NOTEQUAL;
+
+    PipelineCache::State directionalLight;
+    directionalLight.depthTest = false;
+    directionalLight.depthWrite = false;
+    directionalLight.blend = true;
+
+    PipelineCache::State post;
+    post.depthTest = false;
+
+    auto create = [&] (FixedPipeline pipeline, const Shader* shader, const PipelineCache::State& state) {
+        if (!shader) {
+            return false;
+        }
+        fixedPipelines[pipeline] = pipelines.create(shader, state);
+        return true;
+    };
+
+    bool created = create(AMBIENT, renderSettings->ambientShader, opaque) &&
+            create(SKYBOX, renderSettings->skyboxShader, skybox) &&
+            create(STENCIL, resourceManager->getShaderByName("stencil_pass"), stencil) &&
+            create(DEFERRED_POINT_LIGHT, resourceManager->getDeferredLightShader(Light::POINT), pointLight) &&
+            create(DEFERRED_DIRECTIONAL_LIGHT, resourceManager->getDeferredLightShader(Light::DIRECTIONAL), directionalLight) &&
+            create(SHADOW_POINT, resourceManager->getDepthMapShader(Light::POINT), opaque) &&
+            create(SHADOW_DIRECTIONAL, resourceManager->getDepthMapShader(Light::DIRECTIONAL), opaque) &&
+            create(SSAO, resourceManager->getShaderByName("ssao"), post) &&
+            create(SSAO_APPLY, resourceManager->getShaderByName("ssao_apply"), post) &&
+            create(BLOOM_GENERATE, resourceManager->getShaderByName("bloom_generate"), post) &&
+            create(BLOOM_BLUR, resourceManager->getShaderByName("bloom_blur"), post) &&
+            create(BLOOM_BLEND, resourceManager->getShaderByName("bloom_blend"), post) &&
+            create(HDR, resourceManager->getShaderByName("hdr"), post) &&
+            create(FXAA, resourceManager->getShaderByName("fxaa"), post) &&
+            create(PASSTHROUGH, resourceManager->getShaderByName("passthrough"), post);
+    if (!created) {
+        std::cerr << "ERROR: Could not create the render pipelines\n";
+    }
+    return created;
+}
+
+PipelineCache::Handle Renderer::getGBufferPipeline(int shaderType)
+{
+    PipelineCache::Handle& handle = materialPipelines[shaderType].gBuffer;
+    if (handle == PipelineCache::INVALID_HANDLE) {
+        // Draw lists of a permutation that is still linking are skipped instead of waited for
+        resourceManager->requestMaterialShaders(shaderType);
+        if (resourceManager->isShaderPending(shaderType)) {
+            return handle;
+        }
+        const Shader* gBufferShader = resourceManager->getGBufferShader(shaderType);
+        if (gBufferShader) {
+            handle = pipelines.create(gBufferShader, PipelineCache::State());
+        }
+    }
+    return handle;
+}
+
+PipelineCache::Handle Renderer::getForwardLightPipeline(int shaderType, Light::Type lightType)
+{
+    PipelineCache::Handle& handle = materialPipelines[shaderType].forwardLight[lightType];
+    if (handle == PipelineCache::INVALID_HANDLE) {
+        resourceManager->requestMaterialShaders(shaderType);
+        if (resourceManager->isShaderPending(shaderType)) {
+            return handle;
+        }
+        const Shader* lightShader = resourceManager->getForwardLightShader(shaderType, lightType);
+        if (lightShader) {
+            PipelineCache::State state;
+            state.blend = true;
+            handle = pipelines.create(lightShader, state);
+        }
+    }
+    return handle;
+}
+
+void Renderer::bindPipeline(PipelineCache::Handle handle)
+{
+    pipelines.bind(handle);
+    shader = pipelines.getShader(handle);
+}
+
 bool Renderer::setDeferredRenderPath(bool enabled)
 {
     if (deferred == enabled) {
@@ -168,31 +311,60 @@ void Renderer::render(const std::vector<std::unique_ptr<Object> >& objects, Obje
 void Renderer::clear()
 {
     renderMeshes.clear();
+    meshObjectList.clear();
+    instancedDraws.clear();
+    shadowDraws.clear();
     lights.clear();
     lights.resize(Light::Type::NUM_TYPES);
 }
 
+void Renderer::prewarmPipelines()
+{
+    // Drivers finish some programs only when they are first drawn with, so each pipeline draws
+    // one triangle into the framebuffer of the render path with rasterization discarded
+    auto draw = [this] (PipelineCache::Handle handle) {
+        if (handle != PipelineCache::INVALID_HANDLE) {
+            pipelines.bind(handle);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    };
+
+    std::vector<int> shaderTypes = resourceManager->getMaterialShaderTypes();
+    glEnable(GL_RASTERIZER_DISCARD);
+    PostFramebuffer::bindQuadVAO();
+    if (deferred) {
+        gBuffer.bind();
+        for (int shaderType : shaderTypes) {
+            draw(getGBufferPipeline(shaderType));
+        }
+        getPostFramebuffer(0)->bind();
+        draw(fixedPipelines[DEFERRED_POINT_LIGHT]);
+        draw(fixedPipelines[DEFERRED_DIRECTIONAL_LIGHT]);
+    } else {
+        multisampleBuffer.bind();
+        for (int shaderType : shaderTypes) {
+            for (int type = 0; type < Light::Type::NUM_TYPES; ++type) {
+                draw(getForwardLightPipeline(shaderType, Light::Type(type)));
+            }
+        }
+    }
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 void Renderer::renderForward(const std::vector<std::unique_ptr<Object>>& objects, Object* skybox)
 {
     setup(&multisampleBuffer, objects);
 
-    glDisable(GL_STENCIL_TEST);
-
     renderAmbient();
     renderShadowmaps();
-    enableBlending();
 
     for (int i = 0; i < Light::NUM_TYPES; ++i) {
         forwardLighting(Light::Type(i));
     }
 
-    glDisable(GL_BLEND);
-
     renderSkybox(skybox);
 
-    glCullFace(GL_BACK);
-    glDisable(GL_DEPTH_TEST);
-
     PostFramebuffer* buffer = getFreePostFramebuffer();
     GLuint renderedTex = buffer->blitColor(multisampleBuffer.getFramebuffer(), 0);
     renderedTex = renderBloom(renderedTex);
@@ -206,25 +378,27 @@ void Renderer::renderDeferred(const std::vector<std::unique_ptr<Object> >& objec
     setup(&gBuffer, objects);
 
     PostFramebuffer* buffer = getPostFramebuffer(0);
-    buffer->bind();
-    renderAmbient();
-    renderGBuffer();
+    if (isGpuCulling()) {
+        // The ambient pass draws what both culling phases found visible
+        renderGBufferCulled();
+        buffer->bind();
+        culledPhases = {GpuCuller::PREVIOUSLY_VISIBLE, GpuCuller::NEWLY_VISIBLE};
+        renderAmbient();
+        culledPhases.clear();
+    } else {
+        buffer->bind();
+        renderAmbient();
+        renderGBuffer();
+    }
 
     renderShadowmaps();
 
     buffer->bind();
-    enableBlending();
     deferredPointLighting();
     deferredDirectionalLighting();
 
-    glDisable(GL_STENCIL_TEST);
-    glDisable(GL_BLEND);
-
     renderSkybox(skybox);
 
-    glCullFace(GL_BACK);
-    glDisable(GL_DEPTH_TEST);
-
     GLuint renderedTex = buffer->getRenderedTex(0);
     renderedTex = renderSSAO(renderedTex);
     renderedTex = renderBloom(renderedTex);
@@ -240,10 +414,31 @@ void Renderer::setup(const Framebuffer* fb, const std::vector<std::unique_ptr<Ob
         std::cerr << "WARNING: Camera not set for renderer\n";
         return;
     }
-    updateObjectContainers(objects);
-    objectsInFrustum.clear();
-    Object::setViewMatrixUniform();
+    frameObjects = &objects;
+    // Pixels covered by one world unit at unit distance, used to project the LOD errors
+    lodProjectionScale = (*camera->getProjectionMatrixPointer())[1][1] * 0.5f * renderSettings->windowHeight;
+    viewProjection = *camera->getProjectionMatrixPointer() * *camera->getViewMatrixPointer();
+    jobSystem->execute(frameGraph);
+    instanceBuffer.upload();
+    if (!clusterCommands.empty()) {
+        // Orphaned like the instance buffer, the commands of the previous frame may still be in use
+        GLsizeiptr size = std::max(clusterCommands.size(), INITIAL_CLUSTER_COMMAND_CAPACITY) * sizeof(GeometryBuffer::DrawCommand);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, clusterCommandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, clusterCommands.size() * sizeof(GeometryBuffer::DrawCommand),
+                        &clusterCommands[0]);
+    }
+    if (isGpuCulling()) {
+        buildCulledDraws();
+    }
+    if (renderSettings->bindlessTextures) {
+        uploadMaterialHandles();
+    }
+    GeometryBuffer::resetBindingCache();
+    Object::setViewUniforms();
 
+    // The GUI and the compute passes change the state behind the pipelines
+    pipelines.invalidate();
     glDepthMask(GL_TRUE);
 
     for (auto& postBuffer : postBuffers) {
@@ -261,85 +456,78 @@ void Renderer::setup(const Framebuffer* fb, const std::vector<std::unique_ptr<Ob
 
 void Renderer::renderAmbient()
 {
-    glEnable(GL_DEPTH_TEST);
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_LEQUAL);
-    glDisable(GL_BLEND);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-
-    shader = renderSettings->ambientShader;
-    glUseProgram(shader->getProgram());
+    bindPipeline(fixedPipelines[AMBIENT]);
     glUniform3f(AMBIENT_LOCATION, renderSettings->ambientColor.x, renderSettings->ambientColor.y, renderSettings->ambientColor.z);
-    for (const auto& shaderMeshMap : renderMeshes) {
-        for (const auto& meshMap : shaderMeshMap .second) {
-            resourceManager->getMaterial(meshMap.first)->setUniforms(shader);
-            for (const auto& meshObject : meshMap.second) {
-                if (!objectInsideFrustum(meshObject)) {
-                   continue;
-                }
-                meshObject.parent->setUniforms();
-                meshObject.mesh->render();
-                objectsInFrustum.insert(meshObject.mesh->getId());
+    for (const auto& shaderDrawMap : instancedDraws) {
+        for (const DrawList& list : shaderDrawMap.second) {
+            if (list.draws.empty()) {
+                continue;
+            }
+            if (!renderSettings->bindlessTextures) {
+                resourceManager->getMaterial(list.material)->setUniforms(shader);
             }
+            renderDrawList(list);
         }
     }
 }
 
+void Renderer::renderGBufferCulled()
+{
+    gpuCuller.cull(GpuCuller::PREVIOUSLY_VISIBLE, viewProjection, instanceBuffer.getBuffer());
+    pipelines.invalidate();
+    culledPhases = {GpuCuller::PREVIOUSLY_VISIBLE};
+    renderGBuffer();
+
+    // Objects hidden last frame are tested against the depth of what was just drawn
+    gpuCuller.buildDepthPyramid(gBuffer.getDepthTexture());
+    gpuCuller.cull(GpuCuller::NEWLY_VISIBLE, viewProjection, instanceBuffer.getBuffer());
+    pipelines.invalidate();
+    culledPhases = {GpuCuller::NEWLY_VISIBLE};
+    renderGBuffer();
+    culledPhases.clear();
+}
+
 void Renderer::renderGBuffer()
 {
     gBuffer.bind();
-    for (const auto& shaderMeshMap : renderMeshes) {
-        shader = resourceManager->getGBufferShader(shaderMeshMap.first);
-        glUseProgram(shader->getProgram());
+    for (const auto& shaderDrawMap : instancedDraws) {
+        PipelineCache::Handle pipeline = getGBufferPipeline(shaderDrawMap.first);
+        if (pipeline == PipelineCache::INVALID_HANDLE) {
+            continue;
+        }
+        bindPipeline(pipeline);
         glUniform3f(CAMERA_POS_LOCATION, camera->getPosition().x, camera->getPosition().y, camera->getPosition().z);
         glUniform1f(FAR_CLIP_DISTANCE_LOCATION, camera->getFarClipDistance());
-        for (const auto& meshMap : shaderMeshMap .second) {
-            resourceManager->getMaterial(meshMap.first)->setUniforms(shader);
-            for (const auto& meshObject : meshMap.second) {
-                if (objectsInFrustum.find(meshObject.mesh->getId()) == objectsInFrustum.end()) {
-                    continue;
-                }
-                meshObject.parent->setUniforms();
-                meshObject.mesh->render();
+        for (const DrawList& list : shaderDrawMap.second) {
+            if (list.draws.empty()) {
+                continue;
             }
+            if (!renderSettings->bindlessTextures) {
+                resourceManager->getMaterial(list.material)->setUniforms(shader);
+            }
+            renderDrawList(list);
         }
     }
 }
 
 void Renderer::renderShadowmaps()
 {
-    glEnable(GL_DEPTH_TEST);
-    glDepthMask(GL_TRUE);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-
     for (int type = 0; type < Light::Type::NUM_TYPES; ++type) {
-        shader = resourceManager->getDepthMapShader(Light::Type(type));
-        glUseProgram(shader->getProgram());
+        bindPipeline(fixedPipelines[type == Light::Type::POINT ? SHADOW_POINT : SHADOW_DIRECTIONAL]);
         int numShadowmaps = std::min(MAX_NUM_SHADOWMAPS, static_cast<int>(closestLights[type].size()));
         for (int lightNum = 0; lightNum < numShadowmaps; ++lightNum) {
             Object* light = closestLights[type][lightNum];
             Light* lightComp = light->getComponent<Light>();
             if (type != Light::Type::DIRECTIONAL) {
-                lightComp->setUniforms(light->getPosition(), light->getForward());
+                lightComp->setUniforms(light->getWorldPosition(), light->getWorldForward());
             }
             DepthMap* depthMap = depthMapPointers[type][lightNum];
             depthMap->bind();
-            depthMap->updateUniformValues(light->getPosition(), light->getForward());
+            depthMap->updateUniformValues(light->getWorldPosition(), light->getWorldForward());
             depthMap->setUniforms();
             glClear(GL_DEPTH_BUFFER_BIT);
             if (lightComp->isShadowingEnabled()) {
-                for (const auto& shaderMeshMap : renderMeshes) {
-                    for (const auto& meshMap : shaderMeshMap.second) {
-                        for (const auto& meshObject : meshMap.second) {
-                            if (meshObject.parent->isShadowCaster()) {
-                                meshObject.parent->setUniforms();
-                                meshObject.mesh->render();
-                            }
-                        }
-                    }
-                }
+                renderInstancedDraws(shadowDraws);
             }
         }
     }
@@ -352,9 +540,12 @@ void Renderer::forwardLighting(Light::Type lightType)
 
     setLightBlockData(lightType, numLights);
 
-    for (const auto& shaderMeshMap : renderMeshes) {
-        shader = resourceManager->getForwardLightShader(shaderMeshMap.first, lightType);
-        glUseProgram(shader->getProgram());
+    for (const auto& shaderDrawMap : instancedDraws) {
+        PipelineCache::Handle pipeline = getForwardLightPipeline(shaderDrawMap.first, lightType);
+        if (pipeline == PipelineCache::INVALID_HANDLE) {
+            continue;
+        }
+        bindPipeline(pipeline);
 
         activateAllShadowMaps(lightType, numLights);
 
@@ -363,15 +554,14 @@ void Renderer::forwardLighting(Light::Type lightType)
         if (shader->hasUniform(FAR_CLIP_DISTANCE_LOCATION)) {
             glUniform1f(FAR_CLIP_DISTANCE_LOCATION, camera->getFarClipDistance());
         }
-        for (const auto& meshMap : shaderMeshMap.second) {
-            resourceManager->getMaterial(meshMap.first)->setUniforms(shader);
-            for (const auto& meshObject : meshMap.second) {
-                if (objectsInFrustum.find(meshObject.mesh->getId()) == objectsInFrustum.end()) {
-                    continue;
-                }
-                meshObject.parent->setUniforms();
-                meshObject.mesh->render();
+        for (const DrawList& list : shaderDrawMap.second) {
+            if (list.draws.empty()) {
+                continue;
             }
+            if (!renderSettings->bindlessTextures) {
+                resourceManager->getMaterial(list.material)->setUniforms(shader);
+            }
+            renderInstancedDraws(list.draws);
         }
     }
 }
@@ -386,8 +576,8 @@ void Renderer::setLightBlockData(Light::Type lightType, int numLights)
         Light* lightComp = light->getComponent<Light>();
 
         glBufferSubData(GL_UNIFORM_BUFFER, COLOR_OFFSET + offset, 16, glm::value_ptr(lightComp->getColor()));
-        glBufferSubData(GL_UNIFORM_BUFFER, POS_OFFSET + offset, 12, glm::value_ptr(light->getPosition()));
-        glBufferSubData(GL_UNIFORM_BUFFER, FORWARD_OFFSET  + offset, 12, glm::value_ptr(light->getForward()));
+        glBufferSubData(GL_UNIFORM_BUFFER, POS_OFFSET + offset, 12, glm::value_ptr(light->getWorldPosition()));
+        glBufferSubData(GL_UNIFORM_BUFFER, FORWARD_OFFSET  + offset, 12, glm::value_ptr(light->getWorldForward()));
         offset += COLOR_ELEMENT_SIZE;
     }
     glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BINDING_POINT, Light::lightBlockBuffer);
@@ -440,8 +630,7 @@ void Renderer::deferredPointLighting()
         return;
     }
 
-    shader = resourceManager->getDeferredLightShader(Light::Type::POINT);
-    glUseProgram(shader->getProgram());
+    bindPipeline(fixedPipelines[DEFERRED_POINT_LIGHT]);
     setGBufferTextures();
 
     for (unsigned int lightNum = 0; lightNum < closestPointLights.size(); ++lightNum) {
@@ -449,40 +638,29 @@ void Renderer::deferredPointLighting()
         Light* lightComponent = light->getComponent<Light>();
         float r = lightComponent->getRange();
         lightSphere->setScale(glm::vec3(r, r, r));
-        lightSphere->setPosition(light->getPosition());
+        lightSphere->setPosition(light->getWorldPosition());
         lightSphere->updateModelMatrix();
+        const Mesh* sphereMesh = lightSphere->getMeshObjects().front().mesh;
+        GLuint sphereInstance = instanceBuffer.addImmediate(makeInstance(lightSphere.get(), sphereMesh));
 
-        stencilPass();
+        stencilPass(sphereInstance);
 
-        glUseProgram(shader->getProgram());
-        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-        glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_FRONT);
-        glDisable(GL_DEPTH_TEST);
+        bindPipeline(fixedPipelines[DEFERRED_POINT_LIGHT]);
 
         activateShadowMap(lightNum, Light::Type::POINT);
-        lightComponent->setUniforms(light->getPosition(), light->getForward());
-        lightSphere->setUniforms();
-        lightSphere->getMeshObjects().front().mesh->render();
+        lightComponent->setUniforms(light->getWorldPosition(), light->getWorldForward());
+        sphereMesh->render(0, sphereInstance, 1);
     }
 }
 
 void Renderer::deferredDirectionalLighting()
 {
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-    glDisable(GL_STENCIL_TEST);
-    glDisable(GL_DEPTH_TEST);
-
     const std::vector<Object*>& closestDirLights = closestLights[Light::Type::DIRECTIONAL];
     if (closestDirLights.empty()) {
         return;
     }
 
-    shader = resourceManager->getDeferredLightShader(Light::Type::DIRECTIONAL);
-    glUseProgram(shader->getProgram());
+    bindPipeline(fixedPipelines[DEFERRED_DIRECTIONAL_LIGHT]);
     setGBufferTextures();
     PostFramebuffer::bindQuadVAO();
 
@@ -490,7 +668,7 @@ void Renderer::deferredDirectionalLighting()
         activateShadowMap(lightNum, Light::Type::DIRECTIONAL);
         Object* light = closestDirLights[lightNum];
         Light* lightComponent = light->getComponent<Light>();
-        lightComponent->setUniforms(light->getPosition(), light->getForward());
+        lightComponent->setUniforms(light->getWorldPosition(), light->getWorldForward());
         glDrawArrays(GL_TRIANGLES, 0, 6);
     }
 }
@@ -506,34 +684,24 @@ void Renderer::activateShadowMap(int lightNum, Light::Type lightType)
 
 }
 
-void Renderer::stencilPass()
+void Renderer::stencilPass(GLuint sphereInstance)
 {
-    glEnable(GL_DEPTH_TEST);
-    glDepthMask(GL_FALSE);
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    glDisable(GL_CULL_FACE);
+    bindPipeline(fixedPipelines[STENCIL]);
     glClear(GL_STENCIL_BUFFER_BIT);
-    glEnable(GL_STENCIL_TEST);
-    glStencilFunc(GL_ALWAYS, 0, 0);
-    glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
-    glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
-
-    glUseProgram(resourceManager->getShaderProgramByName("stencil_pass"));
-    lightSphere->setUniforms();
-    lightSphere->getMeshObjects().front().mesh->render();
+    lightSphere->getMeshObjects().front().mesh->render(0, sphereInstance, 1);
 }
 
 void Renderer::renderSkybox(Object* skybox)
 {
     if (skybox) {
-        glEnable(GL_DEPTH_TEST);
-        glCullFace(GL_FRONT);
-        shader = renderSettings->skyboxShader;
-        glUseProgram(shader->getProgram());
-        skybox->setUniforms();
+        bindPipeline(fixedPipelines[SKYBOX]);
         for (const auto& meshObject : skybox->getMeshObjects()) {
-            meshObject.material->setUniforms(shader);
-            meshObject.mesh->render();
+            GLuint instance = instanceBuffer.addImmediate(makeInstance(skybox, meshObject.mesh));
+            Material* material = resourceManager->getMaterial(meshObject.material);
+            if (material) {
+                material->setUniforms(shader);
+            }
+            meshObject.mesh->render(0, instance, 1);
         }
     }
 }
@@ -544,12 +712,12 @@ GLuint Renderer::renderSSAO(GLuint renderedTex)
         PostFramebuffer* buffer1 = getFreePostFramebuffer();
         PostFramebuffer* buffer2 = getFreePostFramebuffer();
 
-        glUseProgram(resourceManager->getShaderProgramByName("ssao"));
+        bindPipeline(fixedPipelines[SSAO]);
         glUniform3fv(SSAO_KERNEL_LOCATION, SSAO_KERNEL_SIZE, glm::value_ptr(ssaoKernel[0]));
         glUniformMatrix4fv(PROJECTION_MATRIX_LOCATION, 1, GL_FALSE, glm::value_ptr(*camera->getProjectionMatrixPointer()));
         GLuint ssaoTex = buffer1->draw(std::vector<GLuint>{gBuffer.getViewSpacePositionTexture()});
 
-        glUseProgram(resourceManager->getShaderProgramByName("ssao_apply"));
+        bindPipeline(fixedPipelines[SSAO_APPLY]);
         renderedTex = buffer2->draw(std::vector<GLuint>{renderedTex, ssaoTex});
         freeOtherPostFramebuffers(buffer2);
     }
@@ -567,10 +735,10 @@ GLuint Renderer::renderBloom(GLuint renderedTex)
             buffer = buffer == buffer1 ? buffer2 : buffer1;
         };
 
-        glUseProgram(resourceManager->getShaderProgramByName("bloom_generate"));
+        bindPipeline(fixedPipelines[BLOOM_GENERATE]);
         GLuint bloomTex = buffer->draw(std::vector<GLuint>{renderedTex});
 
-        glUseProgram(resourceManager->getShaderProgramByName("bloom_blur"));
+        bindPipeline(fixedPipelines[BLOOM_BLUR]);
         GLboolean horizontal = true;
         for (unsigned int i = 0; i < camera->getBloomIterations(); ++i) {
             switchBuffer();
@@ -580,7 +748,7 @@ GLuint Renderer::renderBloom(GLuint renderedTex)
         }
 
         switchBuffer();
-        glUseProgram(resourceManager->getShaderProgramByName("bloom_blend"));
+        bindPipeline(fixedPipelines[BLOOM_BLEND]);
         renderedTex = buffer->draw(std::vector<GLuint>{renderedTex, bloomTex});
         freeOtherPostFramebuffers(buffer);
     }
@@ -591,7 +759,7 @@ GLuint Renderer::renderHDR(GLuint renderedTex)
 {
     if (camera->isHDREnabled()) {
         PostFramebuffer* buffer = getFreePostFramebuffer();
-        glUseProgram(resourceManager->getShaderProgramByName("hdr"));
+        bindPipeline(fixedPipelines[HDR]);
         renderedTex = buffer->draw(std::vector<GLuint>{renderedTex});
         freeOtherPostFramebuffers(buffer);
     }
@@ -602,7 +770,7 @@ GLuint Renderer::renderFXAA(GLuint renderedTex)
 {
     if (camera->isFXAAEnabled()) {
         PostFramebuffer* buffer = getFreePostFramebuffer();
-        glUseProgram(resourceManager->getShaderProgramByName("fxaa"));
+        bindPipeline(fixedPipelines[FXAA]);
         glUniform2f(SCREEN_SIZE_LOCATION, windowWidth, windowHeight);
         renderedTex = buffer->draw(std::vector<GLuint>{renderedTex});
         freeOtherPostFramebuffers(buffer);
@@ -614,7 +782,10 @@ GLuint Renderer::renderPostprocess(GLuint renderedTex)
 {
     const std::list<Postprocess>& postprocs = camera->getPostprocesses();
     for (auto iter = postprocs.begin(); iter != postprocs.end(); ++iter) {
+        // The effects use their own programs with the raster state of the post processing passes
+        bindPipeline(fixedPipelines[PASSTHROUGH]);
         iter->bind();
+        pipelines.invalidate();
         PostFramebuffer* buffer = getFreePostFramebuffer();
         renderedTex = buffer->draw(std::vector<GLuint>(1, renderedTex));
         freeOtherPostFramebuffers(buffer);
@@ -624,10 +795,10 @@ GLuint Renderer::renderPostprocess(GLuint renderedTex)
 
 void Renderer::renderPassthrough(GLuint texture)
 {
+    bindPipeline(fixedPipelines[PASSTHROUGH]);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glUseProgram(resourceManager->getShaderProgramByName("passthrough"));
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, texture);
     glUniform1i(RENDERED_TEX_LOCATION0, 0);
@@ -638,29 +809,21 @@ void Renderer::renderPassthrough(GLuint texture)
 
 void Renderer::updateObjectContainers(const std::vector<std::unique_ptr<Object>>& objects)
 {
-    glm::vec3 camPos = camera->getPosition();
-    for (int type = 0; type < Light::Type::NUM_TYPES; ++type) {
-        closestLights[type].clear();
-        std::map<float, Object*> lightsByDistance;
-        for (const auto light : lights[type]) {
-            glm::vec3 temp = camPos - light->getPosition();
-            float distance = glm::dot(temp, temp);
-            lightsByDistance.emplace(distance, light);
-        }
-        for (const auto& kv : lightsByDistance) {
-            closestLights[type].push_back(kv.second);
-        }
-    }
-
     if (!G_COMPONENT_CHANGED) {
         return;
     }
 
     for (const auto& obj : objects) {
         for (const auto& meshObject : obj->getMeshObjects()) {
-            int shaderType = meshObject.material->getShaderType();
-            MaterialId materialId = meshObject.material->getId();
-            std::vector<Object::MeshObject>& meshes = renderMeshes[shaderType][materialId];
+            Material* material = resourceManager->getMaterial(meshObject.material);
+            if (!material) {
+                continue;
+            }
+            MeshMap& meshMap = renderMeshes[material->getShaderType()];
+            if (meshMap.size() <= meshObject.material.index) {
+                meshMap.resize(meshObject.material.index + 1);
+            }
+            std::vector<Object::MeshObject>& meshes = meshMap[meshObject.material.index];
             if (std::find(meshes.begin(), meshes.end(), meshObject) == meshes.end()) {
                 meshes.push_back(meshObject);
             }
@@ -681,13 +844,21 @@ void Renderer::updateObjectContainers(const std::vector<std::unique_ptr<Object>>
 
     auto noParent = [] (Object::MeshObject mo) { return mo.parent == nullptr; };
     for (auto& shaderMeshMap : renderMeshes) {
-        for (auto& meshMap : shaderMeshMap.second) {
-            std::vector<Object::MeshObject>& meshes = meshMap.second;
+        for (auto& meshes : shaderMeshMap.second) {
             meshes.erase(std::remove_if(meshes.begin(), meshes.end(), noParent), meshes.end());
         }
     }
     G_COMPONENT_CHANGED = false;
 
+    meshObjectList.clear();
+    for (auto& shaderMeshMap : renderMeshes) {
+        for (auto& meshes : shaderMeshMap.second) {
+            for (auto& meshObject : meshes) {
+                meshObjectList.push_back(&meshObject);
+            }
+        }
+    }
+
     for (int i = 0; i < Light::NUM_TYPES; ++i) {
         if (lights[i].size() > MAX_NUM_LIGHTS_PER_TYPE) {
             std::cerr << "ERROR: There are more lights than the constant MAX_NUM_LIGHTS_PER_TYPE: "
@@ -696,16 +867,358 @@ void Renderer::updateObjectContainers(const std::vector<std::unique_ptr<Object>>
     }
 }
 
+void Renderer::updateClosestLights()
+{
+    glm::vec3 camPos = camera->getPosition();
+    for (int type = 0; type < Light::Type::NUM_TYPES; ++type) {
+        closestLights[type].clear();
+        std::map<float, Object*> lightsByDistance;
+        for (const auto light : lights[type]) {
+            glm::vec3 temp = camPos - light->getWorldPosition();
+            float distance = glm::dot(temp, temp);
+            lightsByDistance.emplace(distance, light);
+        }
+        for (const auto& kv : lightsByDistance) {
+            closestLights[type].push_back(kv.second);
+        }
+    }
+}
+
+void Renderer::cullMeshObjects()
+{
+    unsigned int numMeshObjects = static_cast<unsigned int>(meshObjectList.size());
+    visibleClusters.resize(numMeshObjects);
+    jobSystem->parallelFor(0, numMeshObjects, CULLING_GRAIN_SIZE, [this] (unsigned int begin, unsigned int end) {
+        bool gpuCulling = isGpuCulling();
+        for (unsigned int i = begin; i < end; ++i) {
+            Object::MeshObject* meshObject = meshObjectList[i];
+            meshObject->visible = gpuCulling || (objectInsideFrustum(*meshObject) && !objectOccluded(*meshObject));
+            selectLods(*meshObject);
+            // Coarser levels are drawn whole, they are already cheap and do not match the clusters
+            visibleClusters[i].clear();
+            if (meshObject->visible && !gpuCulling && meshObject->lod == 0 && !meshObject->mesh->getData().clusters.empty()) {
+                meshObject->visible = cullClusters(*meshObject, visibleClusters[i]);
+            }
+        }
+    });
+}
+
 bool Renderer::objectInsideFrustum(const Object::MeshObject& mo) const
 {
     glm::vec3 point = mo.mesh->getCenterPoint();
-    point = glm::vec3((*Object::view) * mo.parent->getModelMatrix() * glm::vec4(point.x, point.y, point.z, 1.0f));
-    glm::vec3 scale = mo.parent->getScale();
-    float scaleMultiplier = std::max(std::max(scale.x, scale.y), scale.z);
-    float radius = mo.mesh->getBoundingRadius() * scaleMultiplier ;
+    point = glm::vec3(mo.parent->getModelViewMatrix() * glm::vec4(point.x, point.y, point.z, 1.0f));
+    float radius = mo.mesh->getBoundingRadius() * getMaxScale(mo.parent->getModelMatrix());
     return camera->sphereInsideFrustum(point, radius);
 }
 
+bool Renderer::cullClusters(const Object::MeshObject& mo, std::vector<ClusterRange>& ranges) const
+{
+    const std::vector<MeshCluster>& clusters = mo.mesh->getData().clusters;
+    const glm::mat4& model = mo.parent->getModelMatrix();
+    const glm::mat4& modelView = mo.parent->getModelViewMatrix();
+    float scaleMultiplier = getMaxScale(model);
+    // Facing is kept by the model transform, so the cones are tested against the camera in object space
+    glm::vec3 cameraPosition = glm::vec3(glm::inverse(model) * glm::vec4(camera->getPosition(), 1.0f));
+
+    size_t numVisible = 0;
+    for (const MeshCluster& cluster : clusters) {
+        glm::vec3 toCluster = cluster.center - cameraPosition;
+        if (glm::dot(toCluster, cluster.coneAxis) >= cluster.coneCutoff * glm::length(toCluster) + cluster.radius) {
+            continue;
+        }
+        glm::vec3 center = glm::vec3(modelView * glm::vec4(cluster.center, 1.0f));
+        if (!camera->sphereInsideFrustum(center, cluster.radius * scaleMultiplier)) {
+            continue;
+        }
+        ++numVisible;
+        if (!ranges.empty() && ranges.back().firstIndex + ranges.back().numIndices == cluster.firstIndex) {
+            ranges.back().numIndices += cluster.numIndices;
+        } else {
+            ranges.push_back(ClusterRange{cluster.firstIndex, cluster.numIndices});
+        }
+    }
+    if (numVisible == clusters.size()) {
+        ranges.clear();
+    }
+    return numVisible > 0;
+}
+
+void Renderer::rasterizeOccluders()
+{
+    occlusionCuller.clear();
+    if (!renderSettings->softwareOcclusion || isGpuCulling()) {
+        return;
+    }
+
+    for (const Object::MeshObject* meshObject : meshObjectList) {
+        if (meshObject->parent->isOccluder() && objectInsideFrustum(*meshObject)) {
+            const Mesh* mesh = meshObject->mesh;
+            occlusionCuller.addOccluder(viewProjection * meshObject->parent->getModelMatrix(),
+                                        mesh->getData().vertices, mesh->getOccluderIndices());
+        }
+    }
+    occlusionCuller.rasterize(jobSystem);
+}
+
+bool Renderer::objectOccluded(const Object::MeshObject& mo) const
+{
+    if (occlusionCuller.getNumTriangles() == 0) {
+        return false;
+    }
+    const glm::mat4 modelViewProjection = viewProjection * mo.parent->getModelMatrix();
+    return occlusionCuller.isOccluded(modelViewProjection, mo.mesh->boundingBoxMin, mo.mesh->boundingBoxMax);
+}
+
+void Renderer::selectLods(Object::MeshObject& mo) const
+{
+    mo.lod = 0;
+    mo.shadowLod = 0;
+    size_t numLods = mo.mesh->getLodCount();
+    if (numLods < 2) {
+        return;
+    }
+
+    glm::vec3 point = glm::vec3(mo.parent->getModelViewMatrix() * glm::vec4(mo.mesh->getCenterPoint(), 1.0f));
+    float scaleMultiplier = getMaxScale(mo.parent->getModelMatrix());
+    float distance = glm::length(point) - mo.mesh->getBoundingRadius() * scaleMultiplier;
+    if (distance <= 0.0f) {
+        return;
+    }
+
+    // Pick the coarsest levels whose error projected to the screen stays under the thresholds.
+    // Shadow maps are filtered and seen from far away, so they get a coarser threshold.
+    float pixelsPerUnit = lodProjectionScale * scaleMultiplier / distance;
+    float shadowThreshold = renderSettings->lodErrorThreshold * renderSettings->shadowLodBias;
+    for (size_t lod = 1; lod < numLods; ++lod) {
+        float pixels = mo.mesh->getLodError(lod) * pixelsPerUnit;
+        if (pixels <= renderSettings->lodErrorThreshold) {
+            mo.lod = static_cast<unsigned int>(lod);
+        }
+        if (pixels <= shadowThreshold) {
+            mo.shadowLod = static_cast<unsigned int>(lod);
+        }
+    }
+}
+
+void Renderer::requestTextureDetail(const Object::MeshObject& mo) const
+{
+    TextureStreamer* streamer = resourceManager->getTextureStreamer();
+    float uvDensity = mo.mesh->getUvDensity();
+    if (!streamer->isEnabled() || uvDensity <= 0.0f) {
+        return;
+    }
+    Material* material = resourceManager->getMaterial(mo.material);
+    if (!material) {
+        return;
+    }
+
+    // Estimated from the nearest point of the bounding sphere instead of measured per pixel. Inside
+    // the sphere, as with large meshes and static batches, nothing is nearer than the near plane.
+    glm::vec3 point = glm::vec3(mo.parent->getModelViewMatrix() * glm::vec4(mo.mesh->getCenterPoint(), 1.0f));
+    float scaleMultiplier = getMaxScale(mo.parent->getModelMatrix());
+    float distance = glm::length(point) - mo.mesh->getBoundingRadius() * scaleMultiplier;
+    distance = std::max(distance, camera->getNearClipDistance());
+    float pixelsPerUv = lodProjectionScale * scaleMultiplier / (distance * uvDensity);
+    for (const auto& texture : material->textures) {
+        streamer->requestDetail(texture.glId, pixelsPerUv);
+    }
+}
+
+void Renderer::buildInstancedDraws()
+{
+    instanceBuffer.clear();
+    instanceHistory.clear();
+    for (auto& shaderDrawMap : instancedDraws) {
+        for (DrawList& list : shaderDrawMap.second) {
+            list.draws.clear();
+        }
+    }
+    shadowDraws.clear();
+    clusterCommands.clear();
+
+    // Mesh objects are visited in the order of meshObjectList, which identifies them across frames
+    // With bindless textures the instances carry their material, so the materials of a shader
+    // share one draw list and the same mesh is instanced across them
+    GLuint history = 0;
+    bool gpuCulling = isGpuCulling();
+    std::vector<DrawSource> sources;
+    std::vector<DrawSource> shadowCasters;
+    bindlessMaterials.clear();
+    for (const auto& shaderMeshMap : renderMeshes) {
+        sources.clear();
+        DrawMap& drawMap = instancedDraws[shaderMeshMap.first];
+        drawMap.resize(std::max(shaderMeshMap.second.size(), BINDLESS_DRAW_LIST + 1));
+        for (size_t slot = 0; slot < shaderMeshMap.second.size(); ++slot) {
+            const std::vector<Object::MeshObject>& meshes = shaderMeshMap.second[slot];
+            if (meshes.empty()) {
+                continue;
+            }
+            GLuint materialSlot = 0;
+            if (renderSettings->bindlessTextures) {
+                materialSlot = static_cast<GLuint>(bindlessMaterials.size());
+                bindlessMaterials.push_back(resourceManager->getMaterial(meshes.front().material));
+            }
+            for (const auto& meshObject : meshes) {
+                if (meshObject.visible) {
+                    sources.push_back(DrawSource{&meshObject, history, materialSlot});
+                    // With GPU culling every mesh is submitted, only the ones in view ask for detail
+                    if (!gpuCulling || objectInsideFrustum(meshObject)) {
+                        requestTextureDetail(meshObject);
+                    }
+                }
+                if (meshObject.parent->isShadowCaster()) {
+                    shadowCasters.push_back(DrawSource{&meshObject, history, 0});
+                }
+                ++history;
+            }
+            if (!renderSettings->bindlessTextures) {
+                drawMap[slot].material = meshes.front().material;
+                addInstancedDraws(sources, false, drawMap[slot].draws);
+                sources.clear();
+            }
+        }
+        if (renderSettings->bindlessTextures) {
+            addInstancedDraws(sources, false, drawMap[BINDLESS_DRAW_LIST].draws);
+        }
+    }
+    // The depth map shaders do not use materials, so shadow casters are instanced across them
+    addInstancedDraws(shadowCasters, true, shadowDraws);
+}
+
+void Renderer::addInstancedDraws(std::vector<DrawSource>& sources, bool shadow, std::vector<InstancedDraw>& draws)
+{
+    auto getLod = [shadow] (const Object::MeshObject* mo) { return shadow ? mo->shadowLod : mo->lod; };
+    // Draws of one geometry buffer and index type are kept together so that they can share a multi draw
+    std::sort(sources.begin(), sources.end(), [&getLod] (const DrawSource& a, const DrawSource& b) {
+        const Mesh* meshA = a.meshObject->mesh;
+        const Mesh* meshB = b.meshObject->mesh;
+        if (meshA->geometryBuffer != meshB->geometryBuffer) {
+            return meshA->geometryBuffer < meshB->geometryBuffer;
+        }
+        GLenum typeA = meshA->allocation ? meshA->allocation->indexType : 0;
+        GLenum typeB = meshB->allocation ? meshB->allocation->indexType : 0;
+        if (typeA != typeB) {
+            return typeA < typeB;
+        }
+        return meshA != meshB ? meshA->getId() < meshB->getId() : getLod(a.meshObject) < getLod(b.meshObject);
+    });
+
+    for (const DrawSource& source : sources) {
+        const Object::MeshObject* mo = source.meshObject;
+        GLuint instance = instanceBuffer.add(makeInstance(mo->parent, mo->mesh, source.materialSlot));
+        instanceHistory.push_back(source.history);
+        unsigned int lod = getLod(mo);
+        const std::vector<ClusterRange>* ranges = shadow ? nullptr : &visibleClusters[source.history];
+        if (ranges && !ranges->empty() && mo->mesh->allocation) {
+            // Partially visible objects get one command per range and are never instanced with others
+            GLuint firstCommand = static_cast<GLuint>(clusterCommands.size());
+            GeometryBuffer::DrawCommand command = mo->mesh->geometryBuffer->getDrawCommand(*mo->mesh->allocation, 0, instance, 1);
+            GLuint meshFirstIndex = command.firstIndex;
+            for (const ClusterRange& range : *ranges) {
+                command.firstIndex = meshFirstIndex + range.firstIndex;
+                command.count = range.numIndices;
+                clusterCommands.push_back(command);
+            }
+            draws.push_back(InstancedDraw{mo->mesh, lod, instance, 1, firstCommand, static_cast<GLsizei>(ranges->size())});
+        } else if (!draws.empty() && draws.back().mesh == mo->mesh && draws.back().lod == lod && draws.back().numCommands == 0) {
+            ++draws.back().numInstances;
+        } else {
+            draws.push_back(InstancedDraw{mo->mesh, lod, instance, 1, 0, 0});
+        }
+    }
+}
+
+void Renderer::buildCulledDraws()
+{
+    gpuCuller.clear();
+    for (auto& shaderDrawMap : instancedDraws) {
+        for (DrawList& list : shaderDrawMap.second) {
+            list.firstGroup = 0;
+            list.numGroups = 0;
+            const GeometryBuffer* groupBuffer = nullptr;
+            GLenum groupType = 0;
+            for (const InstancedDraw& draw : list.draws) {
+                const Mesh* mesh = draw.mesh;
+                if (!mesh->geometryBuffer || !mesh->allocation) {
+                    continue;
+                }
+                if (list.numGroups == 0 || mesh->geometryBuffer != groupBuffer || mesh->allocation->indexType != groupType) {
+                    groupBuffer = mesh->geometryBuffer;
+                    groupType = mesh->allocation->indexType;
+                    GLuint group = gpuCuller.addGroup(groupBuffer, groupType);
+                    if (list.numGroups == 0) {
+                        list.firstGroup = group;
+                    }
+                    ++list.numGroups;
+                }
+                GeometryBuffer::DrawCommand command = groupBuffer->getDrawCommand(*mesh->allocation, draw.lod, draw.firstInstance,
+                                                                                  static_cast<GLuint>(draw.numInstances));
+                gpuCuller.addCommand(command, mesh->getCenterPoint(), mesh->getBoundingRadius());
+            }
+        }
+    }
+    gpuCuller.upload(instanceHistory, meshObjectList.size());
+}
+
+void Renderer::renderDrawList(const DrawList& list) const
+{
+    if (culledPhases.empty()) {
+        renderInstancedDraws(list.draws);
+        return;
+    }
+    for (GpuCuller::Phase phase : culledPhases) {
+        GeometryBuffer::setInstanceBuffer(gpuCuller.getVisibleInstanceBuffer(phase));
+        gpuCuller.draw(phase, list.firstGroup, list.numGroups);
+    }
+    GeometryBuffer::setInstanceBuffer(instanceBuffer.getBuffer());
+}
+
+void Renderer::renderInstancedDraws(const std::vector<InstancedDraw>& draws) const
+{
+    if (!clusterCommands.empty()) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, clusterCommandBuffer);
+    }
+    for (const InstancedDraw& draw : draws) {
+        if (draw.numCommands > 0) {
+            draw.mesh->renderIndirect(draw.firstCommand, draw.numCommands);
+        } else {
+            draw.mesh->render(draw.lod, draw.firstInstance, draw.numInstances);
+        }
+    }
+}
+
+void Renderer::uploadMaterialHandles()
+{
+    // Handles are made resident here on the render thread, the draw lists are built on the workers
+    materialHandles.clear();
+    for (Material* material : bindlessMaterials) {
+        const auto& handles = material->getTextureHandles();
+        materialHandles.insert(materialHandles.end(), handles.begin(), handles.end());
+    }
+    if (materialHandles.empty()) {
+        return;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, materialHandles.size() * sizeof(GLuint64), &materialHandles[0], GL_STREAM_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BINDING_POINT, materialBuffer);
+}
+
+bool Renderer::isGpuCulling() const
+{
+    return gpuCullerReady && deferred;
+}
+
+InstanceBuffer::Instance Renderer::makeInstance(const Object* object, const Mesh* mesh, GLuint materialSlot) const
+{
+    InstanceBuffer::Instance instance;
+    instance.model = object->getModelMatrix();
+    instance.normal = object->getNormalMatrix();
+    const GeometryBuffer::Allocation* allocation = mesh->allocation;
+    instance.positionOffset = glm::vec4(allocation ? allocation->positionOffset : glm::vec3(0.0f), static_cast<float>(materialSlot));
+    instance.positionScale = glm::vec4(allocation ? allocation->positionScale : glm::vec3(1.0f), 0.0f);
+    return instance;
+}
+
 PostFramebuffer* Renderer::getPostFramebuffer(unsigned int index)
 {
     PostBuffer& buffer = postBuffers[index];
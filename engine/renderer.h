@@ -14,8 +14,12 @@
 #include "depthmappoint.h"
 #include "shader.h"
 #include "postprocess.h"
+#include "jobsystem.h"
+#include "instancebuffer.h"
+#include "gpuculler.h"
+#include "occlusionculler.h"
+#include "pipelinecache.h"
 
-#include <unordered_set>
 #include <map>
 #include <vector>
 #include <memory>
@@ -35,23 +39,92 @@ public:
     Renderer& operator=(const Renderer&) = delete;
     Renderer& operator=(Renderer&&) = delete;
 
-    bool init(const RenderSettings* settings, ResourceManager* manager);
+    bool init(const RenderSettings* settings, ResourceManager* manager, JobSystem* jobs);
     bool setDeferredRenderPath(bool enabled);
     void setCamera(const Camera* camera);
     void render(const std::vector<std::unique_ptr<Object>>& objects, Object* skybox = nullptr);
     void clear();
+    // Draws with every material pipeline of the current render path, the draws are discarded
+    void prewarmPipelines();
 
 private:
+    // Created when first drawn with, indexed by the shader type
+    struct MaterialPipelines
+    {
+        PipelineCache::Handle gBuffer;
+        std::array<PipelineCache::Handle, Light::Type::NUM_TYPES> forwardLight;
+    };
+
+    enum FixedPipeline
+    {
+        AMBIENT,
+        SKYBOX,
+        STENCIL,
+        DEFERRED_POINT_LIGHT,
+        DEFERRED_DIRECTIONAL_LIGHT,
+        SHADOW_POINT,
+        SHADOW_DIRECTIONAL,
+        SSAO,
+        SSAO_APPLY,
+        BLOOM_GENERATE,
+        BLOOM_BLUR,
+        BLOOM_BLEND,
+        HDR,
+        FXAA,
+        PASSTHROUGH,
+        NUM_FIXED_PIPELINES
+    };
+
     struct PostBuffer 
 	{
         bool inUse;
         PostFramebuffer framebuffer;
     };
 
+    // Visible mesh objects sharing a mesh and a level of detail within a material
+    struct InstancedDraw
+    {
+        const Mesh* mesh;
+        unsigned int lod;
+        GLuint firstInstance;
+        GLsizei numInstances;
+        GLuint firstCommand;    // Indirect commands of the visible clusters, none when the whole mesh is drawn
+        GLsizei numCommands;
+    };
+
+    // Consecutive visible clusters of a mesh object merged into one index range
+    struct ClusterRange
+    {
+        GLuint firstIndex;
+        GLuint numIndices;
+    };
+
+    struct DrawList
+    {
+        Handle<Material> material;  // Unused in bindless mode
+        std::vector<InstancedDraw> draws;
+        GLuint firstGroup;  // Command groups of the list when culled on the GPU
+        GLuint numGroups;
+    };
+
+    struct DrawSource
+    {
+        const Object::MeshObject* meshObject;
+        GLuint history;     // Index of the mesh object in meshObjectList
+        GLuint materialSlot;    // Index of the material in the bindless material buffer
+    };
+
+    bool createFixedPipelines();
+    // INVALID_HANDLE while the shaders of the type are linking, their draw lists are skipped
+    PipelineCache::Handle getGBufferPipeline(int shaderType);
+    PipelineCache::Handle getForwardLightPipeline(int shaderType, Light::Type lightType);
+    // Binds the pipeline and makes its program the current shader
+    void bindPipeline(PipelineCache::Handle handle);
     void renderForward(const std::vector<std::unique_ptr<Object>>& objects, Object* skybox = nullptr);
     void renderDeferred(const std::vector<std::unique_ptr<Object>>& objects, Object* skybox = nullptr);
     void setup(const Framebuffer* fb, const std::vector<std::unique_ptr<Object>>& objects);
     void renderAmbient();
+    void renderGBufferCulled();
     void renderGBuffer();    
     void renderShadowmaps();
     void forwardLighting(Light::Type lightType);
@@ -61,7 +134,7 @@ private:
     void deferredPointLighting();
     void deferredDirectionalLighting();
     void activateShadowMap(int lightNum, Light::Type lightType);
-    void stencilPass();
+    void stencilPass(GLuint sphereInstance);
     void renderSkybox(Object* skybox = nullptr);
     GLuint renderSSAO(GLuint renderedTex);
     GLuint renderBloom(GLuint renderedTex);
@@ -70,7 +143,22 @@ private:
     GLuint renderPostprocess(GLuint renderedTex);
     void renderPassthrough(GLuint texture);
     void updateObjectContainers(const std::vector<std::unique_ptr<Object>>& objects);
+    void updateClosestLights();
+    void cullMeshObjects();
     bool objectInsideFrustum(const Object::MeshObject& mo) const;
+    bool cullClusters(const Object::MeshObject& mo, std::vector<ClusterRange>& ranges) const;
+    void rasterizeOccluders();
+    bool objectOccluded(const Object::MeshObject& mo) const;
+    void selectLods(Object::MeshObject& mo) const;
+    void requestTextureDetail(const Object::MeshObject& mo) const;
+    void buildInstancedDraws();
+    void addInstancedDraws(std::vector<DrawSource>& sources, bool shadow, std::vector<InstancedDraw>& draws);
+    void buildCulledDraws();
+    void renderDrawList(const DrawList& list) const;
+    void renderInstancedDraws(const std::vector<InstancedDraw>& draws) const;
+    bool isGpuCulling() const;
+    void uploadMaterialHandles();
+    InstanceBuffer::Instance makeInstance(const Object* object, const Mesh* mesh, GLuint materialSlot = 0) const;
     PostFramebuffer* getPostFramebuffer(unsigned int index);
     PostFramebuffer* getFreePostFramebuffer();
     void freeOtherPostFramebuffers(PostFramebuffer* used);
@@ -78,17 +166,40 @@ private:
     bool deferred = true;
     std::function<void(const std::vector<std::unique_ptr<Object>>&, Object* skybox)> renderFunction;
 
-    using MaterialId = int;
+    // Lists of a shader type are indexed by the slot of the material in its pool, in bindless
+    // mode all the materials of a shader type share the first list
+    static const size_t BINDLESS_DRAW_LIST = 0;
     using ShaderType = int;
-    using MeshMap = std::map<MaterialId, std::vector<Object::MeshObject>>;
+    using MeshMap = std::vector<std::vector<Object::MeshObject>>;
     std::map<ShaderType, MeshMap> renderMeshes;
     std::vector<std::vector<Object*>> lights;
     std::array<std::vector<Object*>, Light::Type::NUM_TYPES> closestLights;
     std::unique_ptr<Object> lightSphere;
+    std::vector<Object::MeshObject*> meshObjectList;
+    using DrawMap = std::vector<DrawList>;
+    std::map<ShaderType, DrawMap> instancedDraws;
+    std::vector<InstancedDraw> shadowDraws;
+    InstanceBuffer instanceBuffer;
+    std::vector<GLuint> instanceHistory;
+    std::vector<std::vector<ClusterRange>> visibleClusters;    // By meshObjectList index
+    std::vector<GeometryBuffer::DrawCommand> clusterCommands;
+    GLuint clusterCommandBuffer = 0;
+    std::vector<Material*> bindlessMaterials;   // By material slot
+    std::vector<GLuint64> materialHandles;
+    GLuint materialBuffer = 0;
+
+    GpuCuller gpuCuller;
+    bool gpuCullerReady = false;
+    std::vector<GpuCuller::Phase> culledPhases; // Empty when drawing the CPU culled lists
+    OcclusionCuller occlusionCuller;
+    glm::mat4 viewProjection;
 
     ResourceManager* resourceManager = nullptr;
     const RenderSettings* renderSettings = nullptr;    
     const Camera* camera = nullptr;
+    JobSystem* jobSystem = nullptr;
+    JobSystem::TaskGraph frameGraph;
+    const std::vector<std::unique_ptr<Object>>* frameObjects = nullptr;
 
     std::array<DepthMapDirectional, MAX_NUM_SHADOWMAPS> dirDepthMaps;
     std::array<DepthMapPoint, MAX_NUM_SHADOWMAPS> pointDepthMaps;
@@ -98,12 +209,15 @@ private:
     GBuffer gBuffer;
     std::array<PostBuffer, 3> postBuffers;
 
+    PipelineCache pipelines;
+    std::array<PipelineCache::Handle, NUM_FIXED_PIPELINES> fixedPipelines;
+    std::array<MaterialPipelines, Shader::NUM_TYPE_MASKS> materialPipelines;
     const Shader* shader = nullptr;
-    std::unordered_set<unsigned int> objectsInFrustum;
     std::array<glm::vec3, SSAO_KERNEL_SIZE> ssaoKernel;
 
     float windowWidth = 0.0f;
     float windowHeight = 0.0f;
+    float lodProjectionScale = 0.0f;
 };
 
 } // moar
@@ -26,11 +26,29 @@ bool RenderSettings::loadSettings(const boost::property_tree::ptree& pt, Resourc
         skyboxShader = manager.getShaderByName(pt.get<std::string>("Render.skyboxShader"));
         skyboxTextures.resize(6);
 
-        ambientShader = manager.getShaderByName(pt.get<std::string>("Render.ambientShader"));
+        bindlessTextures = pt.get<bool>("Render.bindlessTextures");
+        if (bindlessTextures && !GLEW_ARB_bindless_texture) {
+            std::cerr << "WARNING: Bindless textures are not supported, binding the material textures\n";
+            bindlessTextures = false;
+        }
+        manager.setBindlessTextures(bindlessTextures);
+
+        std::string ambientShaderName = pt.get<std::string>("Render.ambientShader");
+        if (bindlessTextures) {
+            ambientShader = manager.getBindlessShader(ambientShaderName);
+        } else {
+            ambientShader = manager.getShaderByName(ambientShaderName);
+        }
 
         directionalShadowMapWidth = pt.get<int>("Render.directionalShadowMapWidth");
         directionalShadowMapHeight = pt.get<int>("Render.directionalShadowMapHeight");
         pointShadowMapSize = pt.get<int>("Render.pointShadowMapSize");
+
+        lodErrorThreshold = pt.get<float>("Render.lodErrorThreshold");
+        shadowLodBias = pt.get<float>("Render.shadowLodBias");
+
+        gpuCulling = pt.get<bool>("Render.gpuCulling");
+        softwareOcclusion = pt.get<bool>("Render.softwareOcclusion");
     } catch (boost::property_tree::ptree_error& e) {
         std::cerr << "WARNING: Could not load render settings from the .ini-file\n";
         std::cerr << e.what() << "\n";
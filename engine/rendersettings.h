@@ -42,6 +42,13 @@ public:
     int directionalShadowMapHeight = 768;
     int pointShadowMapSize = 512;
 
+    float lodErrorThreshold = 1.0f; // In pixels
+    float shadowLodBias = 4.0f;
+
+    bool gpuCulling = false; // Deferred path only
+    bool softwareOcclusion = false; // Ignored when culling on the GPU
+    bool bindlessTextures = false; // Materials are not bound per draw, requires ARB_bindless_texture
+
 private:
     bool loaded = false;
 };
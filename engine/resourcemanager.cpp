@@ -6,6 +6,7 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <thread>
 
 namespace moar
 {
@@ -13,6 +14,18 @@ namespace moar
 namespace
 {
 
+const unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
+        aiProcess_GenSmoothNormals | aiProcess_GenUVCoords | aiProcess_CalcTangentSpace;
+
+// By Material::TextureType, neutral values that do not change the shading much
+const unsigned char PLACEHOLDER_TEXELS[][4] =
+{
+    {255, 255, 255, 255},   // Diffuse
+    {0, 0, 0, 255},         // Specular
+    {128, 128, 255, 255},   // Normal pointing straight out
+    {255, 255, 255, 255}    // Bump at the surface
+};
+
 template <typename T, typename U>
 Shader* getShaderPointer(const T& container, const U& key)
 {
@@ -25,34 +38,73 @@ Shader* getShaderPointer(const T& container, const U& key)
 }
 
 template <typename T>
-GLuint createTexture(const std::string& key, const T& data, std::unordered_map<std::string, std::unique_ptr<Texture>>& container)
+GLuint createTexture(const std::string& key, const T& data, HandlePool<Texture>& pool,
+                     std::unordered_map<std::string, Handle<Texture>>& names, TextureUploader* uploader)
 {
     std::unique_ptr<Texture> texture(new Texture());
-    bool isGood = texture->load(data);
+    bool isGood = texture->load(data, uploader);
     if (!isGood) {
         std::cerr << "WARNING: Failed to create texture with key: " << key << "\n";
         return 0;
     }
-    auto iter = container.emplace(key, std::move(texture));
-    return iter.first->second->getID();
+    GLuint id = texture->getID();
+    names[key] = pool.add(std::move(texture));
+    return id;
 }
 
-bool createShader(Shader* shader, const std::string& path, const std::string& defines)
+bool attachShaders(Shader* shader, const std::string& path, const std::string& defines)
 {
     bool attached = shader->attachShader(GL_VERTEX_SHADER, path + ".vert", defines);
-    attached = attached && shader->attachShader(GL_FRAGMENT_SHADER, path + ".frag", defines);
+    return attached && shader->attachShader(GL_FRAGMENT_SHADER, path + ".frag", defines);
+}
 
-    if (!attached) {
-        return false;
-    }
+bool createShader(Shader* shader, const std::string& path, const std::string& defines)
+{
+    return attachShaders(shader, path, defines) && shader->linkProgram();
+}
 
-    return shader->linkProgram();
+// All the links are started before any is waited for so that the driver can compile them in
+// parallel. Every shader of the batch is finished even if one of them fails.
+bool linkShaders(const std::vector<Shader*>& batch)
+{
+    bool linked = true;
+    std::vector<Shader*> pending;
+    for (Shader* shader : batch) {
+        if (shader->startLink()) {
+            pending.push_back(shader);
+        } else {
+            linked = false;
+        }
+    }
+    while (!pending.empty()) {
+        auto complete = std::partition(pending.begin(), pending.end(), [] (const Shader* shader) {
+            return !shader->isLinkComplete();
+        });
+        if (complete == pending.end()) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (auto iter = complete; iter != pending.end(); ++iter) {
+            linked = (*iter)->finishLink() && linked;
+        }
+        pending.erase(complete, pending.end());
+    }
+    return linked;
 }
 
 } // anonymous
 
 ResourceManager::ResourceManager()
 {
+    for (int format = 0; format < GeometryBuffer::NUM_FORMATS; ++format) {
+        geometryBuffers[format].setFormat(GeometryBuffer::VertexFormat(format));
+    }
+    Mesh::geometryBuffers = &geometryBuffers;
+    Shader::programCache = &programCache;
+    Material::pool = &materials;
+    textureStreamer.init(&loader, &textureUploader, [this] (GLuint oldTexture, GLuint newTexture) {
+        renameTexture(oldTexture, newTexture);
+    });
 }
 
 ResourceManager::~ResourceManager()
@@ -87,13 +139,46 @@ void ResourceManager::setLevelPath(const std::string& path)
     levelPath = path;
 }
 
+void ResourceManager::setMeshOptimization(bool enabled)
+{
+    optimizeMeshes = enabled;
+}
+
+void ResourceManager::setLodGeneration(bool enabled)
+{
+    generateLods = enabled;
+}
+
+void ResourceManager::setMeshClustering(bool enabled)
+{
+    clusterMeshes = enabled;
+}
+
+void ResourceManager::setMeshCachePath(const std::string& path)
+{
+    meshCache.setPath(path);
+}
+
+void ResourceManager::setTextureCachePath(const std::string& path)
+{
+    textureCachePath = path;
+}
+
+void ResourceManager::setProgramCachePath(const std::string& path)
+{
+    programCache.setPath(path);
+}
+
 bool ResourceManager::loadShaderFiles(const std::string& path)
 {
     std::string line = "";
     std::string vertex = "";
     std::string fragment = "";
     std::string geometry = "";
+    std::string compute = "";
     std::string name = "";
+    std::vector<std::pair<std::string, std::unique_ptr<Shader>>> created;
+    Shader::enableParallelCompile();
     std::ifstream shaderInfo(path.c_str());
     if (shaderInfo.is_open()) {
         while (std::getline(shaderInfo, line)) {
@@ -104,33 +189,37 @@ bool ResourceManager::loadShaderFiles(const std::string& path)
                 geometry = line;
             } else if (line.find(".frag") != std::string::npos) {
                 fragment = line;
-            } else if (line.empty() && !vertex.empty() && !fragment.empty() && !name.empty()) {
-                if (shadersByName.find(name) != shadersByName.end()) {
+            } else if (line.find(".comp") != std::string::npos) {
+                compute = line;
+                name = compute.substr(0, compute.find(".comp"));
+            } else if (line.empty() && !name.empty() && ((!vertex.empty() && !fragment.empty()) || !compute.empty())) {
+                auto sameName = [&] (const std::pair<std::string, std::unique_ptr<Shader>>& s) { return s.first == name; };
+                if (shadersByName.count(name) > 0 || std::any_of(created.begin(), created.end(), sameName)) {
                     std::cerr << "ERROR: Duplicate shader names, can not initialize (" << name << ")\n";
                     return false;
                 }
 
                 std::unique_ptr<Shader> shader(new Shader());
 
-                bool attached = shader->attachShader(GL_VERTEX_SHADER, shaderPath + vertex);
-                attached = attached && shader->attachShader(GL_FRAGMENT_SHADER, shaderPath + fragment);
-                if (!geometry.empty()) {
-                    attached = attached && shader->attachShader(GL_GEOMETRY_SHADER, shaderPath + geometry);
+                bool attached = false;
+                if (!compute.empty()) {
+                    attached = shader->attachShader(GL_COMPUTE_SHADER, shaderPath + compute);
+                } else {
+                    attached = shader->attachShader(GL_VERTEX_SHADER, shaderPath + vertex);
+                    attached = attached && shader->attachShader(GL_FRAGMENT_SHADER, shaderPath + fragment);
+                    if (!geometry.empty()) {
+                        attached = attached && shader->attachShader(GL_GEOMETRY_SHADER, shaderPath + geometry);
+                    }
                 }
 
                 if (!attached) {
                     return false;
                 }
-                if (!shader->linkProgram()) {
-                    std::cerr << "WARNING: Failed to link shader program: " << name << "\n";
-                    return false;
-                }
-                std::cout << "Created shader: " << name << "\n";
-                shadersByName.emplace(name, shader.get());
-                shaders.push_back(std::move(shader));
+                created.emplace_back(name, std::move(shader));
                 vertex.clear();
                 fragment.clear();
                 geometry.clear();
+                compute.clear();
                 name.clear();
             } else {
                 std::cerr << "ERROR: Failed to parse shaders file\n";
@@ -143,6 +232,20 @@ bool ResourceManager::loadShaderFiles(const std::string& path)
         return false;
     }
 
+    std::vector<Shader*> batch;
+    for (const auto& shader : created) {
+        batch.push_back(shader.second.get());
+    }
+    if (!linkShaders(batch)) {
+        std::cerr << "WARNING: Failed to link shader programs\n";
+        return false;
+    }
+    for (auto& shader : created) {
+        std::cout << "Created shader: " << shader.first << "\n";
+        shadersByName.emplace(shader.first, shader.second.get());
+        shaders.push_back(std::move(shader.second));
+    }
+
     auto addDepthMapShader = [this] (const std::string& name, Light::Type type) {
         auto found = shadersByName.find(name);
         if (found != shadersByName.end()) {
@@ -159,28 +262,60 @@ bool ResourceManager::loadShaderFiles(const std::string& path)
 
 void ResourceManager::clear()
 {
+    // Completions of the dropped loads would refer to the resources cleared below
+    loader.clear();
+    textureStreamer.clear();
+    loadedModels.clear();
+    // Every handle into the cleared pools goes stale at once
     textures.clear();
-    cubeTextures.clear();
+    texturesByName.clear();
+    cubeTexturesByName.clear();
     materials.clear();
-    for (auto it = models.begin(); it != models.end(); ) {
+    importedMaterials.clear();
+    for (auto it = modelsByName.begin(); it != modelsByName.end(); ) {
         if (it->first != "lowpoly_sphere.obj") {
-            it = models.erase(it);
+            models.remove(it->second);
+            it = modelsByName.erase(it);
         } else {
             ++it;
         }
     }
+    for (auto& geometryBuffer : geometryBuffers) {
+        geometryBuffer.compact();
+    }
 }
 
-Material* ResourceManager::createMaterial()
+void ResourceManager::setBindlessTextures(bool enabled)
 {
-    std::unique_ptr<Material> material(new Material());
-    auto iter = materials.emplace(material->getId(), std::move(material));
-    if (iter.second) {
-        return iter.first->second.get();
-    } else {
-        std::cerr << "WARNING: Could not create material\n";
+    bindlessTextures = enabled;
+}
+
+const Shader* ResourceManager::getBindlessShader(const std::string& name)
+{
+    std::string bindlessName = name + "_bindless";
+    auto found = shadersByName.find(bindlessName);
+    if (found != shadersByName.end()) {
+        return found->second;
+    }
+
+    std::unique_ptr<Shader> shader(new Shader());
+    if (!createShader(shader.get(), shaderPath + name, BINDLESS_DEFINE)) {
+        std::cerr << "WARNING: Failed to link bindless shader " << name << "\n";
         return nullptr;
     }
+
+    std::cout << "Created bindless shader " << name << "\n";
+    shadersByName.emplace(bindlessName, shader.get());
+    shaders.push_back(std::move(shader));
+    return shaders.back().get();
+}
+
+Material* ResourceManager::createMaterial()
+{
+    std::unique_ptr<Material> mat(new Material());
+    Material* material = mat.get();
+    material->setHandle(materials.add(std::move(mat)));
+    return material;
 }
 
 const Shader* ResourceManager::getShaderByName(const std::string& name) const
@@ -259,37 +394,163 @@ const Shader* ResourceManager::getGBufferShader(int shaderType)
     return nullptr;
 }
 
+void ResourceManager::initLoader(unsigned int numThreads)
+{
+    loader.init(numThreads);
+}
+
+void ResourceManager::setTextureBudget(size_t bytes)
+{
+    textureStreamer.setBudget(bytes);
+}
+
+TextureStreamer* ResourceManager::getTextureStreamer()
+{
+    return &textureStreamer;
+}
+
+bool ResourceManager::initUploader(size_t size)
+{
+    return textureUploader.init(static_cast<GLsizeiptr>(size));
+}
+
+void ResourceManager::update(double budget, std::vector<Model*>& completedModels)
+{
+    textureStreamer.update();
+    loader.update(budget);
+    completedModels.swap(loadedModels);
+    loadedModels.clear();
+}
+
+bool ResourceManager::isLoading() const
+{
+    return !loader.isIdle();
+}
+
+void ResourceManager::releaseMeshData(const std::unordered_set<const Mesh*>& occluderMeshes)
+{
+    for (const auto& model : modelsByName) {
+        if (model.first != "lowpoly_sphere.obj") {
+            models.get(model.second)->releaseMeshData(occluderMeshes);
+        }
+    }
+}
+
+Model* ResourceManager::requestModel(const std::string& modelName)
+{
+    auto found = modelsByName.find(modelName);
+    if (found != modelsByName.end()) {
+        return models.get(found->second);
+    }
+
+    // The model is registered empty right away so that later requests share the same load
+    std::unique_ptr<Model> model(new Model());
+    Model* target = model.get();
+    Handle<Model> handle = models.add(std::move(model));
+    modelsByName.emplace(modelName, handle);
+    loader.load([this, handle, modelName] {
+        std::shared_ptr<std::vector<MeshCache::CachedMesh>> meshes(new std::vector<MeshCache::CachedMesh>());
+        bool decoded = decodeModel(modelName, *meshes);
+        return [this, handle, modelName, meshes, decoded] {
+            Model* target = models.get(handle);
+            if (!target) {
+                return true;
+            }
+            if (!decoded) {
+                std::cerr << "WARNING: Failed to load model; " << modelPath + modelName << "\n";
+                return true;
+            }
+            createMeshes(target, modelName, *meshes, true);
+            loadedModels.push_back(target);
+            return true;
+        };
+    });
+    return target;
+}
+
+GLuint ResourceManager::requestTexture(const std::string& textureName, Material::TextureType type)
+{
+    auto found = texturesByName.find(textureName);
+    if (found != texturesByName.end()) {
+        return textures.get(found->second)->getID();
+    }
+
+    // Materials get the placeholder and are given the name of the real texture once it has been uploaded
+    std::unique_ptr<Texture> texture(new Texture());
+    texture->setPlaceholder(PLACEHOLDER_TEXELS[type]);
+    GLuint id = texture->getID();
+    Handle<Texture> handle = textures.add(std::move(texture));
+    texturesByName.emplace(textureName, handle);
+
+    std::string textureFile = texturePath + textureName;
+    bool cook = isCookingTextures();
+    // Streamed textures start from their smallest levels, only cooked files have them all on disk
+    bool stream = cook && textureStreamer.isEnabled();
+    int maxSize = stream ? TextureStreamer::MIN_RESIDENT_SIZE : 0;
+    loader.load([this, handle, textureFile, type, cook, stream, maxSize] {
+        std::shared_ptr<Texture::ImageData> image(new Texture::ImageData());
+        bool decoded = decodeTexture(textureFile, type, cook, maxSize, *image);
+        return [this, handle, textureFile, image, decoded, stream] {
+            Texture* target = textures.get(handle);
+            if (!target) {
+                return true;
+            }
+            // Images larger than the whole ring are uploaded directly instead
+            GLsizeiptr size = decoded ? Texture::getStagingSize(*image) : 0;
+            if (decoded && textureUploader.isEnabled() && size <= textureUploader.getCapacity() &&
+                !textureUploader.hasSpace(size)) {
+                return false;
+            }
+            GLuint placeholder = target->getID();
+            if (!decoded || !target->upload(*image, &textureUploader)) {
+                std::cerr << "WARNING: Failed to load texture; " << textureFile << "\n";
+                return true;
+            }
+            renameTexture(placeholder, target->getID());
+            if (stream && image->compressed) {
+                textureStreamer.add(target, *image);
+            }
+            return true;
+        };
+    });
+    return id;
+}
+
 Model* ResourceManager::getModel(const std::string& modelName)
 {
-    auto found = models.find(modelName);
-    if (found == models.end()) {
+    auto found = modelsByName.find(modelName);
+    if (found == modelsByName.end()) {
         std::string modelFile = modelPath + modelName;
         std::unique_ptr<Model> model(new Model());
-        bool isGood = loadModel(model.get(), modelFile);
+        bool isGood = loadModel(model.get(), modelName);
         if (!isGood) {
             std::cerr << "WARNING: Failed to load model; " << modelFile << "\n";
             return nullptr;
         }
-        auto iter = models.emplace(modelName, std::move(model));
-        if (iter.second) {
-            return iter.first->second.get();
-        } else {
-            std::cerr << "WARNING: Could not insert model " << modelName << "\n";
-            return nullptr;
-        }
+        Model* target = model.get();
+        modelsByName.emplace(modelName, models.add(std::move(model)));
+        return target;
     } else {
-        return found->second.get();
+        return models.get(found->second);
     }
 }
 
-GLuint ResourceManager::getTexture(const std::string& textureName)
+GLuint ResourceManager::getTexture(const std::string& textureName, Material::TextureType type)
 {
-    auto found = textures.find(textureName);
-    if (found == textures.end()) {
+    auto found = texturesByName.find(textureName);
+    if (found == texturesByName.end()) {
         std::string textureFile = texturePath + textureName;
-        return createTexture(textureName, textureFile, textures);
+        Texture::ImageData image;
+        std::unique_ptr<Texture> texture(new Texture());
+        if (!decodeTexture(textureFile, type, isCookingTextures(), 0, image) || !texture->upload(image, &textureUploader)) {
+            std::cerr << "WARNING: Failed to create texture with key: " << textureName << "\n";
+            return 0;
+        }
+        GLuint id = texture->getID();
+        texturesByName.emplace(textureName, textures.add(std::move(texture)));
+        return id;
     } else {
-        return found->second->getID();
+        return textures.get(found->second)->getID();
     }
 }
 
@@ -301,23 +562,21 @@ GLuint ResourceManager::getCubeTexture(std::vector<std::string> textureNames)
         name = texturePath + name;
     }
 
-    auto found = cubeTextures.find(textureKey);
-    if (found == cubeTextures.end()) {
-        return createTexture(textureKey, textureNames, cubeTextures);
+    auto found = cubeTexturesByName.find(textureKey);
+    if (found == cubeTexturesByName.end()) {
+        return createTexture(textureKey, textureNames, textures, cubeTexturesByName, &textureUploader);
     } else {
-        return found->second->getID();
+        return textures.get(found->second)->getID();
     }
 }
 
-Material* ResourceManager::getMaterial(int id)
+Material* ResourceManager::getMaterial(Handle<Material> handle) const
 {
-    auto found = materials.find(id);
-    if (found != materials.end()) {
-        return found->second.get();
-    } else {
-        std::cerr << "ERROR: Could not find material with id " << id << "\n";
-        return 0;
+    Material* material = materials.get(handle);
+    if (!material) {
+        std::cerr << "ERROR: Could not find material with handle " << handle.index << ":" << handle.generation << "\n";
     }
+    return material;
 }
 
 std::string ResourceManager::getLevelPath() const
@@ -327,109 +586,283 @@ std::string ResourceManager::getLevelPath() const
 
 void ResourceManager::checkMissingTextures() const
 {
-    for (const auto& mat : materials) {
-        mat.second->checkMissingTextures();
-    }
+    materials.forEach([](Material* material) {
+        material->checkMissingTextures();
+    });
 }
 
 bool ResourceManager::loadForwardLightShader(int shaderType)
 {
-    std::vector<ForwardLightKey> keys;
+    std::vector<PendingShader> pending;
+    return addForwardLightShaders(shaderType, pending) && linkPendingShaders(pending);
+}
+
+bool ResourceManager::loadDeferredLightShader(Light::Type light)
+{
+    std::vector<PendingShader> pending;
+    return addDeferredLightShader(light, pending) && linkPendingShaders(pending);
+}
+
+bool ResourceManager::loadGBufferShader(int shaderType)
+{
+    std::vector<PendingShader> pending;
+    return addGBufferShader(shaderType, pending) && linkPendingShaders(pending);
+}
+
+void ResourceManager::requestMaterialShaders(int shaderType)
+{
+    if (shaderType == Shader::UNDEFINED || isShaderPending(shaderType)) {
+        return;
+    }
+    std::vector<PendingShader> pending;
+    bool attached = addForwardLightShaders(shaderType, pending);
+    attached = addGBufferShader(shaderType, pending) && attached;
+    if (!attached) {
+        std::cerr << "WARNING: Failed to request the shaders with mask " << std::bitset<8>(shaderType) << "\n";
+    }
+    startPendingShaders(pending);
+}
+
+bool ResourceManager::prewarmShaders()
+{
+    // Every permutation that the materials of the level need on either render path, so that
+    // none is compiled in the middle of a frame or when the path is switched
+    std::vector<PendingShader> pending;
+    bool attached = true;
+    for (int shaderType : getMaterialShaderTypes()) {
+        if (!isShaderPending(shaderType)) {
+            attached = addForwardLightShaders(shaderType, pending) && attached;
+            attached = addGBufferShader(shaderType, pending) && attached;
+        }
+    }
     for (int i = 0; i < Light::NUM_TYPES; ++i) {
-        keys.push_back(std::make_pair(shaderType, Light::Type(i)));
+        Light::Type light = Light::Type(i);
+        bool linking = std::any_of(linkingShaders.begin(), linkingShaders.end(), [light] (const PendingShader& p) {
+            return p.kind == PendingShader::DEFERRED_LIGHT && p.light == light;
+        });
+        if (!linking) {
+            attached = addDeferredLightShader(light, pending) && attached;
+        }
     }
+    if (!pending.empty()) {
+        std::cout << "Prewarming " << pending.size() << " shader permutations\n";
+        startPendingShaders(pending);
+    }
+    return attached;
+}
 
-    auto keyFound = [&] (ForwardLightKey key) { return forwardLightShadersByType.count(key) > 0; };
-    if (std::all_of(keys.begin(), keys.end(), keyFound)) {
-        return true;
+void ResourceManager::updateShaders()
+{
+    // The programs are linked on the driver threads, those not complete are asked again next frame
+    auto linking = std::partition(linkingShaders.begin(), linkingShaders.end(), [] (const PendingShader& p) {
+        return !p.shader->isLinkComplete();
+    });
+    for (auto iter = linking; iter != linkingShaders.end(); ++iter) {
+        if (iter->shader->finishLink()) {
+            registerShader(*iter);
+        } else {
+            std::cerr << "WARNING: Failed to link shader with mask " << std::bitset<8>(iter->shaderType) << "\n";
+        }
     }
+    linkingShaders.erase(linking, linkingShaders.end());
+}
 
+bool ResourceManager::isCompilingShaders() const
+{
+    return !linkingShaders.empty();
+}
+
+bool ResourceManager::isShaderPending(int shaderType) const
+{
+    return std::any_of(linkingShaders.begin(), linkingShaders.end(), [shaderType] (const PendingShader& p) {
+        return p.kind != PendingShader::DEFERRED_LIGHT && p.shaderType == shaderType;
+    });
+}
+
+std::vector<int> ResourceManager::getMaterialShaderTypes() const
+{
+    std::vector<int> shaderTypes;
+    materials.forEach([&shaderTypes](Material* material) {
+        int shaderType = material->getShaderType();
+        if (shaderType != Shader::UNDEFINED &&
+            std::find(shaderTypes.begin(), shaderTypes.end(), shaderType) == shaderTypes.end()) {
+            shaderTypes.push_back(shaderType);
+        }
+    });
+    return shaderTypes;
+}
+
+std::string ResourceManager::getMaterialDefines(int shaderType) const
+{
     std::stringstream ss;
+    if (bindlessTextures) {
+        ss << BINDLESS_DEFINE;
+    }
     for (const auto& tm : TEXTURE_TYPE_MAPPINGS) {
         if (shaderType & tm.shaderType) {
             ss << tm.shaderDefine;
         }
     }
-    std::string defines = ss.str();
-
-    auto createForwardLightShader = [&] (Light::Type lightType, std::string path) {
-        path += LIGHT_SHADER_NAME_MAPPINGS.at(lightType);
-        std::unique_ptr<Shader> shader(new Shader());
-        if (!createShader(shader.get(), path, defines)) {
-            std::cerr << "WARNING: Failed to link forward light shader for light type " << lightType << " with mask: " << std::bitset<8>(shaderType) << "\n";
-            return false;
-        }
-
-        std::cout << "Created forward light shader for light type " << lightType << " with mask " << std::bitset<8>(shaderType) << "\n";
-        ForwardLightKey key = std::make_pair(shaderType, lightType);
-        forwardLightShadersByType.emplace(key, shader.get());
-        shaders.push_back(std::move(shader));
-        return true;
-    };
+    // Merged bindless lists draw many materials at once, so there is no block to bind per material
+    if ((shaderType & Shader::PARAMETERS) && !bindlessTextures) {
+        ss << PARAMETERS_DEFINE;
+    }
+    return ss.str();
+}
 
+bool ResourceManager::addForwardLightShaders(int shaderType, std::vector<PendingShader>& pending) const
+{
+    std::string defines = getMaterialDefines(shaderType);
     std::string path = shaderPath + FORWARD_LIGHT_SHADER;
     for (int i = 0; i < Light::NUM_TYPES; ++i) {
-        if (!createForwardLightShader(Light::Type(i), path)) {
+        Light::Type light = Light::Type(i);
+        if (forwardLightShadersByType.count(std::make_pair(shaderType, light)) > 0) {
+            continue;
+        }
+        PendingShader added = {PendingShader::FORWARD_LIGHT, shaderType, light, std::unique_ptr<Shader>(new Shader())};
+        if (!attachShaders(added.shader.get(), path + LIGHT_SHADER_NAME_MAPPINGS.at(light), defines)) {
+            std::cerr << "WARNING: Failed to create forward light shader for light type " << light << " with mask: " << std::bitset<8>(shaderType) << "\n";
             return false;
         }
+        pending.push_back(std::move(added));
     }
     return true;
 }
 
-bool ResourceManager::loadDeferredLightShader(Light::Type light)
+bool ResourceManager::addDeferredLightShader(Light::Type light, std::vector<PendingShader>& pending) const
 {
     if (deferredLightShadersByType.count(light) > 0) {
         return true;
     }
 
-    std::string defines = "";
-    std::string path = shaderPath + DEFERRED_LIGHT_SHADER + LIGHT_SHADER_NAME_MAPPINGS.at(light);;
-    std::unique_ptr<Shader> shader(new Shader());
-    if (!createShader(shader.get(), path, defines)) {
-        std::cerr << "WARNING: Failed to link deferred light shader with light: " << light << "\n";
+    std::string path = shaderPath + DEFERRED_LIGHT_SHADER + LIGHT_SHADER_NAME_MAPPINGS.at(light);
+    PendingShader added = {PendingShader::DEFERRED_LIGHT, Shader::UNDEFINED, light, std::unique_ptr<Shader>(new Shader())};
+    if (!attachShaders(added.shader.get(), path, "")) {
+        std::cerr << "WARNING: Failed to create deferred light shader with light: " << light << "\n";
         return false;
     }
-
-    std::cout << "Created deferred light shader with light: " << light << "\n";
-    deferredLightShadersByType.emplace(light, shader.get());
-    shaders.push_back(std::move(shader));
+    pending.push_back(std::move(added));
     return true;
 }
 
-bool ResourceManager::loadGBufferShader(int shaderType)
+bool ResourceManager::addGBufferShader(int shaderType, std::vector<PendingShader>& pending) const
 {
     if (gBufferShadersByType.count(shaderType) > 0) {
         return true;
     }
 
-    std::stringstream ss;
-    for (const auto& tm : TEXTURE_TYPE_MAPPINGS) {
-        if (shaderType & tm.shaderType) {
-            ss << tm.shaderDefine;
+    std::string path = shaderPath + GBUFFER_SHADER;
+    PendingShader added = {PendingShader::GBUFFER, shaderType, Light::POINT, std::unique_ptr<Shader>(new Shader())};
+    if (!attachShaders(added.shader.get(), path, getMaterialDefines(shaderType))) {
+        std::cerr << "WARNING: Failed to create gbuffer shader with mask: " << std::bitset<8>(shaderType) << "\n";
+        return false;
+    }
+    pending.push_back(std::move(added));
+    return true;
+}
+
+bool ResourceManager::linkPendingShaders(std::vector<PendingShader>& pending)
+{
+    std::vector<Shader*> batch;
+    for (const PendingShader& p : pending) {
+        batch.push_back(p.shader.get());
+    }
+    if (!linkShaders(batch)) {
+        std::cerr << "WARNING: Failed to link a batch of " << batch.size() << " shaders\n";
+        return false;
+    }
+
+    for (PendingShader& p : pending) {
+        registerShader(p);
+    }
+    pending.clear();
+    return true;
+}
+
+void ResourceManager::startPendingShaders(std::vector<PendingShader>& pending)
+{
+    for (PendingShader& p : pending) {
+        if (p.shader->startLink()) {
+            linkingShaders.push_back(std::move(p));
+        } else {
+            std::cerr << "WARNING: Failed to start linking shader with mask " << std::bitset<8>(p.shaderType) << "\n";
         }
     }
+    pending.clear();
+}
 
-    std::string defines = ss.str();
-    std::string path = shaderPath + GBUFFER_SHADER;
-    std::unique_ptr<Shader> shader(new Shader());
-    if (!createShader(shader.get(), path, defines)) {
-        std::cerr << "WARNING: Failed to link gbuffer shader with mask: " << std::bitset<8>(shaderType) << "\n";
+void ResourceManager::registerShader(PendingShader& pending)
+{
+    switch (pending.kind) {
+    case PendingShader::FORWARD_LIGHT:
+        std::cout << "Created forward light shader for light type " << pending.light << " with mask " << std::bitset<8>(pending.shaderType) << "\n";
+        forwardLightShadersByType.emplace(std::make_pair(pending.shaderType, pending.light), pending.shader.get());
+        break;
+    case PendingShader::DEFERRED_LIGHT:
+        std::cout << "Created deferred light shader with light: " << pending.light << "\n";
+        deferredLightShadersByType.emplace(pending.light, pending.shader.get());
+        break;
+    case PendingShader::GBUFFER:
+        std::cout << "Created gbuffer shader with mask " << std::bitset<8>(pending.shaderType) << "\n";
+        gBufferShadersByType.emplace(pending.shaderType, pending.shader.get());
+        break;
+    }
+    shaders.push_back(std::move(pending.shader));
+}
+
+bool ResourceManager::loadModel(Model* model, const std::string& modelName)
+{
+    std::vector<MeshCache::CachedMesh> meshes;
+    if (!decodeModel(modelName, meshes)) {
         return false;
     }
+    createMeshes(model, modelName, meshes, false);
+    return true;
+}
 
-    std::cout << "Created gbuffer shader with mask " << std::bitset<8>(shaderType) << "\n";
-    gBufferShadersByType.emplace(shaderType, shader.get());
-    shaders.push_back(std::move(shader));
+bool ResourceManager::decodeModel(const std::string& modelName, std::vector<MeshCache::CachedMesh>& meshes) const
+{
+    std::string file = modelPath + modelName;
+    uint64_t cacheKey = 0;
+    bool cacheable = meshCache.isEnabled() && meshCache.computeKey(file, getImportOptions(), cacheKey);
+    if (cacheable && meshCache.load(modelName, cacheKey, meshes)) {
+        std::cout << "Loaded model from cache: " << file << "\n";
+        return true;
+    }
+    if (!importModel(file, meshes)) {
+        return false;
+    }
+    if (cacheable && !meshCache.store(modelName, cacheKey, meshes)) {
+        std::cerr << "WARNING: Could not write mesh cache for " << file << "\n";
+    }
     return true;
 }
 
-bool ResourceManager::loadModel(Model* model, const std::string& file)
+void ResourceManager::createMeshes(Model* model, const std::string& modelName,
+                                   std::vector<MeshCache::CachedMesh>& meshes, bool async)
+{
+    for (MeshCache::CachedMesh& cachedMesh : meshes) {
+        std::unique_ptr<Mesh> mesh(new Mesh());
+        GeometryBuffer::VertexFormat format = GeometryBuffer::selectFormat(cachedMesh.data);
+        mesh->setData(std::move(cachedMesh.data), format);
+
+        if (cachedMesh.hasMaterial) {
+            Material* material = getImportedMaterial(cachedMesh.texturePaths, async);
+            if (material) {
+                mesh->setMaterial(material->getHandle());
+            } else {
+                std::cerr << "WARNING: Could not load material for " << modelName << "\n";
+            }
+        }
+        model->addMesh(std::move(mesh));
+    }
+}
+
+bool ResourceManager::importModel(const std::string& file, std::vector<MeshCache::CachedMesh>& meshes) const
 {
     Assimp::Importer importer;
-    unsigned int flags = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices  |
-            aiProcess_GenSmoothNormals | aiProcess_GenUVCoords | aiProcess_CalcTangentSpace;
     // This gives false memory leaks?
-    const aiScene* aScene = importer.ReadFile(file, flags);
+    const aiScene* aScene = importer.ReadFile(file, IMPORT_FLAGS);
 
     if (aScene) {
         if (aScene->mNumMeshes == 0) {
@@ -437,42 +870,43 @@ bool ResourceManager::loadModel(Model* model, const std::string& file)
             return false;
         }
 
+        MeshOptimizer::Statistics statistics;
+        size_t numLods = 0;
+        size_t numClusters = 0;
+        meshes.resize(aScene->mNumMeshes);
         for (unsigned int i = 0; i < aScene->mNumMeshes; ++i) {
             const aiMesh* aMesh = aScene->mMeshes[i];
-            std::vector<glm::vec3> vertices;
-            std::vector<glm::vec3> normals;
-            std::vector<glm::vec3> tangents;
-            std::vector<glm::vec2> texCoords;
-            std::vector<unsigned int> indices;
-            std::unique_ptr<Mesh> mesh(new Mesh());
+            MeshData& data = meshes[i].data;
+            data.vertices.reserve(aMesh->mNumVertices);
+            data.normals.reserve(aMesh->mNumVertices);
+            data.indices.reserve(aMesh->mNumFaces * 3);
 
             for (unsigned int j = 0; j < aMesh->mNumVertices; ++j) {
                 glm::vec3 v;
                 v.x = aMesh->mVertices[j].x;
                 v.y = aMesh->mVertices[j].y;
                 v.z = aMesh->mVertices[j].z;
-                vertices.push_back(v);
-                mesh->checkBoundingBoxLimits(v);
+                data.vertices.push_back(v);
 
                 glm::vec3 n;
                 n.x = aMesh->mNormals[j].x;
                 n.y = aMesh->mNormals[j].y;
                 n.z = aMesh->mNormals[j].z;
-                normals.push_back(n);
+                data.normals.push_back(n);
 
                 if (aMesh->HasTangentsAndBitangents()) {
                     glm::vec3 tan;
                     tan.x = aMesh->mTangents[j].x;
                     tan.y = aMesh->mTangents[j].y;
                     tan.z = aMesh->mTangents[j].z;
-                    tangents.push_back(tan);
+                    data.tangents.push_back(tan);
                 }
 
                 if (aMesh->HasTextureCoords(0)) {
                     glm::vec2 t;
                     t.x = aMesh->mTextureCoords[0][j].x;
                     t.y = -aMesh->mTextureCoords[0][j].y;
-                    texCoords.push_back(t);
+                    data.texCoords.push_back(t);
                 }
             }
 
@@ -481,38 +915,48 @@ bool ResourceManager::loadModel(Model* model, const std::string& file)
                     std::cerr << "WARNING: Unable to parse model indices; " << file << "\n";
                     return false;
                 }
-                indices.push_back(aMesh->mFaces[j].mIndices[0]);
-                indices.push_back(aMesh->mFaces[j].mIndices[1]);
-                indices.push_back(aMesh->mFaces[j].mIndices[2]);
+                data.indices.push_back(aMesh->mFaces[j].mIndices[0]);
+                data.indices.push_back(aMesh->mFaces[j].mIndices[1]);
+                data.indices.push_back(aMesh->mFaces[j].mIndices[2]);
             }
 
-            mesh->setVertices(vertices);
-            mesh->setIndices(indices);
-            mesh->setNormals(normals);
-            if (aMesh->HasTangentsAndBitangents()) {
-                mesh->setTangents(tangents);
+            if (generateLods) {
+                meshSimplifier.generateLods(data);
+                numLods += data.lods.size();
+            }
+            if (optimizeMeshes) {
+                statistics.add(meshOptimizer.optimize(data));
             }
-            if (aMesh->HasTextureCoords(0)) {
-                mesh->setTextureCoordinates(texCoords);
+            if (clusterMeshes) {
+                numClusters += meshClusterer.cluster(data);
             }
-            mesh->calculateCenterPointAndRadius();
 
             aiMaterial* aMaterial = aScene->mMaterials[aMesh->mMaterialIndex];
             if (aMaterial) {
-                std::unique_ptr<Material> mat(new Material());
-                if (loadMaterial(aMaterial, mat.get())) {
-                    mesh->setMaterial(mat.get());
-                    auto iter = materials.emplace(mat->getId(), std::move(mat));
-                    if (!iter.second) {
-                        std::cerr << "ERROR: Could not insert material\n";
+                meshes[i].hasMaterial = true;
+                for (const auto& tm : TEXTURE_TYPE_MAPPINGS) {
+                    aiString path;
+                    if (aMaterial->GetTextureCount(tm.aiType) > 0) {
+                        aMaterial->GetTexture(tm.aiType, 0, &path);
                     }
-                } else {
-                    std::cerr << "WARNING: Could not load material for " << file << "\n";
+                    meshes[i].texturePaths.push_back(std::string(path.C_Str()));
                 }
             }
-            model->addMesh(std::move(mesh));
         }
         std::cout << "Loaded model: " << file << "\n";
+        if (generateLods) {
+            std::cout << "Generated " << numLods << " levels of detail for " << aScene->mNumMeshes << " meshes\n";
+        }
+        if (clusterMeshes && numClusters > 0) {
+            std::cout << "Split meshes into " << numClusters << " clusters\n";
+        }
+        if (optimizeMeshes) {
+            std::cout << "Optimized " << statistics.numTriangles << " triangles, ACMR " <<
+                         statistics.getACMR(statistics.transformedBefore) << " -> " <<
+                         statistics.getACMR(statistics.transformedAfter) << ", ATVR " <<
+                         statistics.getATVR(statistics.transformedBefore, statistics.verticesBefore) << " -> " <<
+                         statistics.getATVR(statistics.transformedAfter, statistics.verticesAfter) << "\n";
+        }
         return true;
     } else {
         std::cerr << "WARNING: Failed to read model \"" << file << "\"\n";
@@ -521,39 +965,91 @@ bool ResourceManager::loadModel(Model* model, const std::string& file)
     }
 }
 
-bool ResourceManager::loadMaterial(aiMaterial* aMaterial, Material* material)
+Material* ResourceManager::getImportedMaterial(const std::vector<std::string>& texturePaths, bool async)
+{
+    // The paths determine the textures and through them the shader type, imported materials
+    // have no parameters
+    std::string key;
+    for (const std::string& path : texturePaths) {
+        key += path;
+        key += '\n';
+    }
+    auto found = importedMaterials.find(key);
+    if (found != importedMaterials.end()) {
+        return materials.get(found->second);
+    }
+
+    std::unique_ptr<Material> mat(new Material());
+    if (!loadMaterial(texturePaths, mat.get(), async)) {
+        return nullptr;
+    }
+    Material* material = mat.get();
+    material->setHandle(materials.add(std::move(mat)));
+    importedMaterials.emplace(key, material->getHandle());
+    return material;
+}
+
+bool ResourceManager::loadMaterial(const std::vector<std::string>& texturePaths, Material* material, bool async)
 {
     int shaderType = 0;
-    auto loadTexture = [&] (aiTextureType aType, Material::TextureType textureType, Shader::Type currentShaderType)
-    {
-        if (aMaterial->GetTextureCount(aType) == 0) {
-            return true;
+    for (size_t i = 0; i < TEXTURE_TYPE_MAPPINGS.size() && i < texturePaths.size(); ++i) {
+        if (texturePaths[i].empty()) {
+            continue;
         }
-
-        aiString path;
-        aMaterial->GetTexture(aType, 0, &path);
-        GLuint tex = getTexture(std::string(path.C_Str()));
+        const TypeMapping& tm = TEXTURE_TYPE_MAPPINGS[i];
+        GLuint tex = async ? requestTexture(texturePaths[i], tm.materialType) : getTexture(texturePaths[i], tm.materialType);
         if (tex == 0) {
             return false;
         }
-        material->setTexture(tex, textureType, GL_TEXTURE_2D);
-        shaderType |= currentShaderType;
-        return true;
-    };
-
-    bool valid = true;
-    for (const auto& tm : TEXTURE_TYPE_MAPPINGS) {
-        if (!loadTexture(tm.aiType, tm.materialType, tm.shaderType)) {
-            valid = false;
-            break;
-        }
+        material->setTexture(tex, tm.materialType, GL_TEXTURE_2D);
+        shaderType |= tm.shaderType;
     }
 
-    if (!valid || !loadForwardLightShader(shaderType) || !loadGBufferShader(shaderType)) {
-        return false;
-    }
+    // Linked in the background while the rest of the level loads, the renderer skips the
+    // meshes of the material until then
     material->setShaderType(shaderType);
+    requestMaterialShaders(shaderType);
     return true;
 }
 
+bool ResourceManager::decodeTexture(const std::string& textureFile, Material::TextureType type, bool cook, int maxSize,
+                                    Texture::ImageData& image) const
+{
+    if (cook) {
+        // Textures are shared by name, a texture used in several roles is cooked for the first one
+        std::string cookedName;
+        if (textureCooker.getCookedName(textureFile, type, cookedName)) {
+            std::string cookedFile = textureCachePath + cookedName;
+            if (Texture::decodeCooked(cookedFile, image, 0, maxSize) ||
+                (textureCooker.cook(textureFile, type, cookedFile) && Texture::decodeCooked(cookedFile, image, 0, maxSize))) {
+                return true;
+            }
+        }
+        std::cerr << "WARNING: Could not cook texture " << textureFile << ", loading it uncompressed\n";
+    }
+    return Texture::decode(textureFile, image);
+}
+
+void ResourceManager::renameTexture(GLuint oldTexture, GLuint newTexture)
+{
+    // Also when the old name was reused, the bindless handles of the materials are out of date
+    materials.forEach([oldTexture, newTexture](Material* material) {
+        material->replaceTexture(oldTexture, newTexture);
+    });
+}
+
+bool ResourceManager::isCookingTextures() const
+{
+    return !textureCachePath.empty() && TextureCooker::isSupported();
+}
+
+uint32_t ResourceManager::getImportOptions() const
+{
+    uint32_t options = IMPORT_FLAGS;
+    options ^= optimizeMeshes ? 1u << 31 : 0u;
+    options ^= generateLods ? 1u << 30 : 0u;
+    options ^= clusterMeshes ? 1u << 29 : 0u;
+    return options;
+}
+
 } // moar
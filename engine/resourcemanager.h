@@ -6,6 +6,17 @@
 #include "model.h"
 #include "texture.h"
 #include "material.h"
+#include "geometrybuffer.h"
+#include "meshoptimizer.h"
+#include "meshsimplifier.h"
+#include "meshclusterer.h"
+#include "meshcache.h"
+#include "programcache.h"
+#include "texturecooker.h"
+#include "textureuploader.h"
+#include "texturestreamer.h"
+#include "assetloader.h"
+#include "handlepool.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -14,8 +25,10 @@
 
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <memory>
+#include <array>
 #include <functional>
 
 namespace moar
@@ -35,10 +48,50 @@ public:
     void setModelPath(const std::string& path);
     void setTexturePath(const std::string& path);
     void setLevelPath(const std::string& path);
+    void setMeshOptimization(bool enabled);
+    void setLodGeneration(bool enabled);
+    void setMeshClustering(bool enabled);
+    void setMeshCachePath(const std::string& path);
+    void setTextureCachePath(const std::string& path);
+    // Set before the shaders are loaded to skip compiling them on later runs
+    void setProgramCachePath(const std::string& path);
     bool loadShaderFiles(const std::string& path);
     void clear();
 
+    // Without loader threads the requests load synchronously
+    void initLoader(unsigned int numThreads);
+    // Size in bytes of the ring the texel data is streamed through
+    bool initUploader(size_t size);
+    // Video memory for the streamed textures in bytes, zero keeps every texture fully resident
+    void setTextureBudget(size_t bytes);
+    TextureStreamer* getTextureStreamer();
+    // Creates the GL resources of the finished loads within the budget in seconds
+    void update(double budget, std::vector<Model*>& completedModels);
+    bool isLoading() const;
+    // Called once the level has loaded and been batched, the models kept across levels are skipped
+    void releaseMeshData(const std::unordered_set<const Mesh*>& occluderMeshes);
+    // Returns an empty model that is filled in by update() once it has been loaded
+    Model* requestModel(const std::string& modelName);
+    // Returns a placeholder texture whose contents are replaced once the image has been loaded
+    GLuint requestTexture(const std::string& textureName, Material::TextureType type);
+
+    // Forward and gbuffer shaders created after this sample the material textures through handles
+    void setBindlessTextures(bool enabled);
+    // Variant of a vertex and fragment shader pair that samples through handles
+    const Shader* getBindlessShader(const std::string& name);
+
     Material* createMaterial();
+    // Starts linking the forward and gbuffer shaders of the type on the driver threads unless
+    // they exist or are linking already
+    void requestMaterialShaders(int shaderType);
+    // Starts linking the forward, gbuffer and deferred light shaders of all the materials
+    bool prewarmShaders();
+    // Registers the requested shaders that have finished linking, never waits for the others
+    void updateShaders();
+    bool isCompilingShaders() const;
+    bool isShaderPending(int shaderType) const;
+    // Distinct shader types of the materials
+    std::vector<int> getMaterialShaderTypes() const;
 
     const Shader* getShaderByName(const std::string& name) const;
     GLuint getShaderProgramByName(const std::string& name) const;
@@ -47,9 +100,9 @@ public:
     const Shader* getDepthMapShader(Light::Type light) const;
     const Shader* getGBufferShader(int shaderType);
     Model* getModel(const std::string& modelName);
-    GLuint getTexture(const std::string& textureName);
+    GLuint getTexture(const std::string& textureName, Material::TextureType type = Material::DIFFUSE);
     GLuint getCubeTexture(std::vector<std::string> textureNames);
-    Material* getMaterial(int id);
+    Material* getMaterial(Handle<Material> handle) const;
     std::string getLevelPath() const;
 
     void checkMissingTextures() const;
@@ -61,30 +114,87 @@ private:
     {
         size_t operator()(const ForwardLightKey& key) const
         {
-            return std::hash<std::string>()(std::to_string(key.first) + std::to_string(key.second));
+            return std::hash<int>()(key.first * Light::NUM_TYPES + key.second);
         }
     };
 
+    // Attached but not linked, registered once linked
+    struct PendingShader
+    {
+        enum Kind
+        {
+            FORWARD_LIGHT,
+            DEFERRED_LIGHT,
+            GBUFFER
+        };
+
+        Kind kind;
+        int shaderType;
+        Light::Type light;
+        std::unique_ptr<Shader> shader;
+    };
+
     bool loadForwardLightShader(int shaderType);
     bool loadDeferredLightShader(Light::Type light);
     bool loadGBufferShader(int shaderType);
-    bool loadModel(Model* model, const std::string& file);
-    bool loadMaterial(aiMaterial* aMaterial, Material* material);
+    std::string getMaterialDefines(int shaderType) const;
+    bool addForwardLightShaders(int shaderType, std::vector<PendingShader>& pending) const;
+    bool addDeferredLightShader(Light::Type light, std::vector<PendingShader>& pending) const;
+    bool addGBufferShader(int shaderType, std::vector<PendingShader>& pending) const;
+    bool linkPendingShaders(std::vector<PendingShader>& pending);
+    void startPendingShaders(std::vector<PendingShader>& pending);
+    void registerShader(PendingShader& pending);
+    bool loadModel(Model* model, const std::string& modelName);
+    // Decoding runs on the loader threads and only reads the settings of the manager
+    bool decodeModel(const std::string& modelName, std::vector<MeshCache::CachedMesh>& meshes) const;
+    bool importModel(const std::string& file, std::vector<MeshCache::CachedMesh>& meshes) const;
+    bool decodeTexture(const std::string& textureFile, Material::TextureType type, bool cook, int maxSize,
+                       Texture::ImageData& image) const;
+    void createMeshes(Model* model, const std::string& modelName, std::vector<MeshCache::CachedMesh>& meshes, bool async);
+    // Meshes with the same textures share a material across the models of the level
+    Material* getImportedMaterial(const std::vector<std::string>& texturePaths, bool async);
+    bool loadMaterial(const std::vector<std::string>& texturePaths, Material* material, bool async);
+    void renameTexture(GLuint oldTexture, GLuint newTexture);
+    bool isCookingTextures() const;
+    uint32_t getImportOptions() const;
 
     std::string shaderPath;
     std::string modelPath;
     std::string texturePath;
     std::string levelPath;
+    bool optimizeMeshes = true;
+    MeshOptimizer meshOptimizer;
+    bool generateLods = true;
+    MeshSimplifier meshSimplifier;
+    bool clusterMeshes = true;
+    bool bindlessTextures = false;
+    MeshClusterer meshClusterer;
+    MeshCache meshCache;
+    ProgramCache programCache;
+    std::string textureCachePath;
+    TextureCooker textureCooker;
+    TextureUploader textureUploader;
+    TextureStreamer textureStreamer;
+    // Declared before the models so that the buffers outlive their meshes
+    std::array<GeometryBuffer, GeometryBuffer::NUM_FORMATS> geometryBuffers;
     std::vector<std::unique_ptr<Shader>> shaders;
     std::unordered_map<ForwardLightKey, Shader*, ForwardLightHash> forwardLightShadersByType;
     std::unordered_map<int, Shader*> deferredLightShadersByType;
     std::unordered_map<int, Shader*> depthMapShadersByType;
     std::unordered_map<int, Shader*> gBufferShadersByType;
     std::unordered_map<std::string, Shader*> shadersByName;
-    std::unordered_map<std::string, std::unique_ptr<Model>> models;
-    std::unordered_map<std::string, std::unique_ptr<Texture>> textures;
-    std::unordered_map<std::string, std::unique_ptr<Texture>> cubeTextures;
-    std::unordered_map<int, std::unique_ptr<Material>> materials;
+    std::vector<PendingShader> linkingShaders;  // Started, polled by updateShaders()
+    // The names are only looked up while loading, the resources are addressed through handles
+    HandlePool<Model> models;
+    HandlePool<Texture> textures;
+    HandlePool<Material> materials;
+    std::unordered_map<std::string, Handle<Model>> modelsByName;
+    std::unordered_map<std::string, Handle<Texture>> texturesByName;
+    std::unordered_map<std::string, Handle<Texture>> cubeTexturesByName;
+    std::unordered_map<std::string, Handle<Material>> importedMaterials;  // By texture paths
+    std::vector<Model*> loadedModels;
+    // Declared last so that the loader threads are stopped before anything they read is destroyed
+    AssetLoader loader;
 };
 
 } // moar
@@ -1,5 +1,6 @@
 #include "shader.h"
 #include "common/globals.h"
+#include "hash.h"
 
 #include <algorithm>
 #include <iterator>
@@ -13,6 +14,9 @@ namespace moar
 
 std::string Shader::commonVertexShaderCode = "";
 std::string Shader::commonFragmentShaderCode = "";
+std::unordered_map<std::string, std::string> Shader::sourceFiles;
+bool Shader::parallelCompile = false;
+ProgramCache* Shader::programCache = nullptr;
 
 void Shader::loadCommonShaderCode(GLenum type, const std::string& file)
 {
@@ -50,6 +54,33 @@ std::string* Shader::selectCommonCode(GLenum type)
     return nullptr;
 }
 
+void Shader::enableParallelCompile()
+{
+    // The driver picks the number of threads
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        parallelCompile = true;
+    } else if (GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        parallelCompile = true;
+    }
+}
+
+const std::string* Shader::readSourceFile(const std::string& filename)
+{
+    // Permutations of the same file are read only once
+    auto found = sourceFiles.find(filename);
+    if (found != sourceFiles.end()) {
+        return &found->second;
+    }
+    std::ifstream shaderFile(filename.c_str());
+    if (!shaderFile) {
+        return nullptr;
+    }
+    std::string source((std::istreambuf_iterator<char>(shaderFile)), std::istreambuf_iterator<char>());
+    return &sourceFiles.emplace(filename, std::move(source)).first->second;
+}
+
 Shader::Shader()
 {
     program = glCreateProgram();
@@ -64,36 +95,91 @@ Shader::~Shader()
 
 bool Shader::attachShader(GLenum shaderType, const std::string& filename, const std::string& defines)
 {
-    GLuint shader = glCreateShader(shaderType);
-    std::string common = "";
-    switch (shaderType) {
-    case GL_VERTEX_SHADER: common = commonVertexShaderCode; break;
-    case GL_FRAGMENT_SHADER: common = commonFragmentShaderCode; break;
-    }
-
-    if (!shader || !compileShader(shader, filename, defines, common)) {
-        glDeleteShader(shader);
+    const std::string* source = readSourceFile(filename);
+    if (!source) {
+        std::cerr << "WARNING: Could not open shader file: " << filename << "\n";
         return false;
     }
 
-    shaders.push_back(shader);
-    glAttachShader(program, shader);
+    Stage stage;
+    stage.type = shaderType;
+    stage.filename = filename;
+    stage.code = GLSL_VERSION + defines;
+    const std::string* common = selectCommonCode(shaderType);
+    if (common) {
+        stage.code += *common;
+    }
+    stage.code += *source;
+    stages.push_back(std::move(stage));
     return true;
 }
 
 bool Shader::linkProgram()
 {
+    return startLink() && finishLink();
+}
+
+bool Shader::startLink()
+{
+    if (stages.empty()) {
+        return false;
+    }
+    bool cacheable = programCache && programCache->isEnabled();
+    cacheKey = cacheable ? programCache->computeKey(hashStages()) : 0;
+    linkedFromBinary = cacheable && programCache->load(cacheKey, program);
+    if (linkedFromBinary) {
+        return true;
+    }
+
+    // Statuses are not asked for here so that the driver can work on the next program
+    for (const Stage& stage : stages) {
+        GLuint shader = glCreateShader(stage.type);
+        if (!shader) {
+            return false;
+        }
+        const char* shaderCodeCstr = stage.code.c_str();
+        glShaderSource(shader, 1, &shaderCodeCstr, NULL);
+        glCompileShader(shader);
+        shaders.push_back(shader);
+        glAttachShader(program, shader);
+    }
+    if (cacheable) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(program);
+    return true;
+}
 
-    GLint isLinked = 0;
-    glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
-    if (isLinked == GL_FALSE) {
-        GLint maxLength = 0;
-        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength);
-        std::vector<GLchar> infoLog(maxLength);
-        glGetProgramInfoLog(program, maxLength, &maxLength, &infoLog[0]);
-        std::copy(infoLog.begin(), infoLog.end(), std::ostream_iterator<GLchar>(std::cerr, ""));
-        glDeleteProgram(program);
+bool Shader::isLinkComplete() const
+{
+    if (linkedFromBinary || !parallelCompile) {
+        return true;
+    }
+    GLint isComplete = GL_TRUE;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &isComplete);
+    return isComplete == GL_TRUE;
+}
+
+bool Shader::finishLink()
+{
+    if (!linkedFromBinary) {
+        GLint isLinked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+        if (isLinked == GL_FALSE) {
+            for (size_t i = 0; i < shaders.size(); ++i) {
+                checkCompileStatus(shaders[i], stages[i]);
+            }
+            std::cerr << "WARNING: Failed to link program of " << stages.front().filename << "\n";
+            GLint maxLength = 0;
+            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength);
+            std::vector<GLchar> infoLog(maxLength + 1);
+            glGetProgramInfoLog(program, maxLength, &maxLength, &infoLog[0]);
+            std::copy(infoLog.begin(), infoLog.begin() + maxLength, std::ostream_iterator<GLchar>(std::cerr, ""));
+            return false;
+        }
+        if (programCache && programCache->isEnabled() && !programCache->store(cacheKey, program)) {
+            std::cerr << "WARNING: Could not write program cache for " << stages.front().filename << "\n";
+        }
     }
 
     auto setUniformBlock = [&] (const std::string& name, int bindingPoint) {
@@ -106,14 +192,15 @@ bool Shader::linkProgram()
     setUniformBlock(LIGHT_BLOCK_NAME, LIGHT_BINDING_POINT);
     setUniformBlock(LIGHT_PROJECTION_BLOCK_NAME, LIGHT_PROJECTION_BINDING_POINT);
     setUniformBlock(TRANSFORMATION_BLOCK_NAME, TRANSFORMATION_BINDING_POINT);
+    setUniformBlock(PARAMETER_BLOCK_NAME, PARAMETER_BINDING_POINT);
 
     if (!readUniformLocations()) {
         return false;
     }
 
     deleteShaders();
-
-    return isLinked == GL_TRUE;
+    stages.clear();
+    return true;
 }
 
 GLuint Shader::getProgram() const
@@ -145,22 +232,10 @@ void Shader::deleteShaders()
     shaders.clear();
 }
 
-bool Shader::compileShader(GLuint shader, const std::string& filename, const std::string& defines, const std::string& common)
+bool Shader::checkCompileStatus(GLuint shader, const Stage& stage) const
 {
-    std::string shaderCode = GLSL_VERSION + defines + common;
-    std::ifstream shaderFile(filename.c_str());
-    if (shaderFile) {
-        shaderCode.append((std::istreambuf_iterator<char>(shaderFile)), std::istreambuf_iterator<char>());
-        shaderFile.close();
-    } else {
-        std::cerr << "WARNING: Could not open shader file: " << filename << "\n";
-        return false;
-    }
-
-    const char* shaderCodeCstr = shaderCode.c_str();
-    glShaderSource(shader, 1, &shaderCodeCstr, NULL);
-
-    glCompileShader(shader);
+    const std::string& shaderCode = stage.code;
+    const std::string& filename = stage.filename;
     GLint isCompiled = 0;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
     if (isCompiled == GL_FALSE) {
@@ -182,6 +257,16 @@ bool Shader::compileShader(GLuint shader, const std::string& filename, const std
     return true;
 }
 
+uint64_t Shader::hashStages() const
+{
+    uint64_t hash = HASH_SEED;
+    for (const Stage& stage : stages) {
+        hash = hashBytes(&stage.type, sizeof(stage.type), hash);
+        hash = hashBytes(stage.code.data(), stage.code.size(), hash);
+    }
+    return hash;
+}
+
 bool Shader::readUniformLocations()
 {
     GLint numActiveUniforms = 0;
@@ -2,6 +2,7 @@
 #define SHADER_H
 
 #include "common/globals.h"
+#include "programcache.h"
 
 #include <GL/glew.h>
 
@@ -9,6 +10,7 @@
 #include <string>
 #include <bitset>
 #include <array>
+#include <unordered_map>
 
 namespace moar
 {
@@ -23,12 +25,21 @@ public:
         SPECULAR = 1 << 1,
         NORMAL = 1 << 2,
         BUMP = 1 << 3,
-        DEPTH = 1 << 4
+        DEPTH = 1 << 4,
+        PARAMETERS = 1 << 5   // The material has a parameter block
     };
 
+    // Number of the combinations of the types
+    static const int NUM_TYPE_MASKS = PARAMETERS << 1;
+
     static void loadCommonShaderCode(GLenum type, const std::string& file);
     static void addCommonShaderCode(GLenum type, const std::string& addition);
 
+    // Compiles and links on driver threads when the parallel compile extension is supported
+    static void enableParallelCompile();
+
+    static ProgramCache* programCache; // Set by the resource manager that owns it
+
     explicit Shader();
     ~Shader();
     Shader(const Shader& rhs) = delete;
@@ -36,8 +47,14 @@ public:
     Shader& operator=(Shader rhs) = delete;
     Shader& operator=(Shader&& rhs) = delete;
 
+    // The source is only read here, the stages are compiled when linking if there is no binary
     bool attachShader(GLenum shaderType, const std::string& filename, const std::string& defines = "");
     bool linkProgram();
+    // Linking in two steps, start a batch of programs before finishing any of them
+    bool startLink();
+    // Finishing a program that is not complete waits for it
+    bool isLinkComplete() const;
+    bool finishLink();
 
     GLuint getProgram() const;
     bool hasUniform(GLuint location) const;
@@ -45,17 +62,31 @@ public:
     GLuint getShadowMapLocation(int num) const;
 
 private:
+    struct Stage
+    {
+        GLenum type;
+        std::string filename;
+        std::string code;   // Preprocessed, with the version, defines and common code
+    };
+
     static std::string* selectCommonCode(GLenum type);
+    static const std::string* readSourceFile(const std::string& filename);
 
     static std::string commonVertexShaderCode;
     static std::string commonFragmentShaderCode;
+    static std::unordered_map<std::string, std::string> sourceFiles;
+    static bool parallelCompile;
 
     void deleteShaders();
-    bool compileShader(GLuint shader, const std::string& filename, const std::string& defines = "", const std::string& common = "");
+    bool checkCompileStatus(GLuint shader, const Stage& stage) const;
+    uint64_t hashStages() const;
     bool readUniformLocations();
 
     GLuint program;    
+    std::vector<Stage> stages;
     std::vector<GLuint> shaders;
+    uint64_t cacheKey = 0;
+    bool linkedFromBinary = false;
     std::bitset<MAX_UNIFORM_LOCATION> uniforms;
     std::array<GLuint, MAX_NUM_SHADOWMAPS> shadowMapLocations;
 };
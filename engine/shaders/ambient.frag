@@ -4,7 +4,9 @@ layout(location = 0) out vec4 outColor0;
 layout(location = 1) out vec4 outColor1;
 
 layout (location = 10) uniform vec3 ambient;
+#if !defined(BINDLESS)
 layout (location = 20) uniform sampler2D diffuseTex;
+#endif
 
 void main()
 {
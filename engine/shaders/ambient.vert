@@ -2,11 +2,8 @@ layout (location = 1) in vec3 position;
 layout (location = 2) in vec2 tex;
 
 layout (std140) uniform TransformationBlock {
-    mat4 M;
     mat4 V;
-    mat4 MV;
-    mat4 MVP;
-    mat4 NormalMatrix;
+    mat4 VP;
 };
 
 out vec2 texCoord;
@@ -14,5 +11,8 @@ out vec2 texCoord;
 void main()
 {
     texCoord = tex;
-    gl_Position = MVP * vec4(position, 1.0);
+#if defined(BINDLESS)
+    materialIndex = getMaterialIndex();
+#endif
+    gl_Position = VP * instanceModel * vec4(decodePosition(position), 1.0);
 }
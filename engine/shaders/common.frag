@@ -21,7 +21,10 @@ vec2 getBumpedTexCoord(vec3 eyeDir_World, vec3 T, vec3 B, sampler2D bumpTex, vec
 
 vec3 getWorldSpaceNormal(sampler2D normalTex, vec2 texCoord, mat3 TBN)
 {
-  return normalize(TBN * normalize(texture(normalTex, texCoord).rgb * 2.0 - vec3(1.0)));
+  // Z is reconstructed so that two channel compressed normal maps work as well
+  vec2 xy = texture(normalTex, texCoord).rg * 2.0 - vec2(1.0);
+  vec3 normal = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+  return normalize(TBN * normal);
 }
 
 float getDiffuse(vec3 normal, vec3 lightDir) 
@@ -79,5 +82,24 @@ bool isTransparent(float alpha)
   return alpha < 0.1;
 }
 
+#if defined(PARAMETERS)
+// Declared once here so that the forward and the gbuffer programs of a material share the layout
+layout (std140) uniform ParameterBlock {
+  vec4 diffuseTint;
+  float specularScale;
+};
+#endif
+
+#if defined(BINDLESS)
+// Texture handles of the materials by Material::TextureType. Defined last so that the names of
+// the sampler parameters above are not replaced.
+layout (std430, binding = 8) readonly buffer MaterialBlock { uvec2 materialTextures[]; };
+flat in uint materialIndex;
+#define diffuseTex sampler2D(materialTextures[materialIndex * 4 + 0])
+#define specularTex sampler2D(materialTextures[materialIndex * 4 + 1])
+#define normalTex sampler2D(materialTextures[materialIndex * 4 + 2])
+#define bumpTex sampler2D(materialTextures[materialIndex * 4 + 3])
+#endif
+
 // end common.frag 
 
@@ -1,3 +1,27 @@
+// Quantized mesh positions are stored relative to the mesh bounds. Both come with the
+// instance data, other meshes get a zero offset and a unit scale.
+layout (location = 5) in vec4 positionOffset;
+layout (location = 6) in vec3 positionScale;
+
+// Model transforms come per instance, the view dependent ones from TransformationBlock
+layout (location = 7) in mat4 instanceModel;
+layout (location = 11) in mat4 instanceNormal;
+
+#if defined(BINDLESS)
+// The material of the instance in MaterialBlock, carried in the unused w of the position offset
+flat out uint materialIndex;
+
+uint getMaterialIndex()
+{
+  return uint(positionOffset.w);
+}
+#endif
+
+vec3 decodePosition(vec3 position)
+{
+  return positionOffset.xyz + position * positionScale;
+}
+
 void getTBN(vec3 normal, vec3 tangent, mat3 M, out vec3 T, out vec3 B, out mat3 TBN)
 {
   vec3 N = normal;
@@ -1,11 +1,8 @@
 layout (location = 1) in vec3 position;
 
 layout (std140) uniform TransformationBlock {
-  mat4 M;
   mat4 V;
-  mat4 MV;
-  mat4 MVP;
-  mat4 NormalMatrix;
+  mat4 VP;
 };
 
 out vec2 texCoord;
@@ -8,11 +8,8 @@ layout (location = 16) uniform int numLights;
 layout (location = 50) uniform mat4 lightSpaceProj;
 
 layout (std140) uniform TransformationBlock {
-  mat4 M;
   mat4 V;
-  mat4 MV;
-  mat4 MVP;
-  mat4 NormalMatrix;
+  mat4 VP;
 };
 
 layout (std140) uniform LightProjectionBlock {
@@ -30,17 +27,22 @@ out mat3 TBN;
 
 void main()
 {
-  gl_Position = MVP * vec4(position, 1.0);
+  mat4 M = instanceModel;
+  vec4 position_World = M * vec4(decodePosition(position), 1.0);
+  gl_Position = VP * position_World;
   texCoord = tex;
-  vertexPos_World = vec3(M * vec4(position, 1.0));
-  normal_World = normalize(vec3(NormalMatrix * vec4(normal, 0.0)));
+#if defined(BINDLESS)
+  materialIndex = getMaterialIndex();
+#endif
+  vertexPos_World = vec3(position_World);
+  normal_World = normalize(vec3(instanceNormal * vec4(normal, 0.0)));
 
 #if defined(BUMP) || defined(SPECULAR)
   eyeDir_World = cameraPos_World - vertexPos_World;
 #endif
   
   for (int i = 0; i < numLights; ++i) {
-    pos_Light[i] = LP[i] * M * vec4(position, 1.0);
+    pos_Light[i] = LP[i] * position_World;
   }
 
 #if defined(BUMP) || defined(NORMAL)
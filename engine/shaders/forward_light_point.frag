@@ -1,10 +1,12 @@
 layout(location = 0) out vec4 outColor;
 
 layout (location = 16) uniform int numLights;
+#if !defined(BINDLESS)
 layout (location = 20) uniform sampler2D diffuseTex;
 layout (location = 21) uniform sampler2D normalTex;
 layout (location = 22) uniform sampler2D bumpTex;
 layout (location = 23) uniform sampler2D specularTex;
+#endif
 layout (location = 43) uniform float farPlane;
 
 uniform samplerCube depthTexs[MAX_NUM_SHADOWMAPS];
@@ -49,6 +51,10 @@ void main()
 
   vec3 normEyeDir_World = normalize(eyeDir_World);
   float specularPower = texture(specularTex, sampleCoord).r;
+#if defined(PARAMETERS)
+  texColor.rgb *= diffuseTint.rgb;
+  specularPower *= specularScale;
+#endif
 
   // Start light loop
   for (int i = 0; i < numLights; ++i) {
@@ -4,10 +4,12 @@ layout(location = 2) out vec4 outColor;
 layout(location = 3) out vec3 outVSPosition;
 
 layout (location = 12) uniform vec3 cameraPos_World;
+#if !defined(BINDLESS)
 layout (location = 20) uniform sampler2D diffuseTex;
 layout (location = 21) uniform sampler2D normalTex;
 layout (location = 22) uniform sampler2D bumpTex;
 layout (location = 23) uniform sampler2D specularTex;
+#endif
 layout (location = 43) uniform float farPlane;
 
 in vec2 texCoord;
@@ -32,6 +34,9 @@ void main()
   if (isTransparent(outColor.a)) {
     discard;
   }
+#if defined(PARAMETERS)
+  outColor.rgb *= diffuseTint.rgb;
+#endif
 
   outPosition.xyz = vertexPos_World;
 
@@ -43,6 +48,9 @@ void main()
 
 #if defined(SPECULAR)
   outColor.a = texture(specularTex, sampleCoord).r;
+#if defined(PARAMETERS)
+  outColor.a *= specularScale;
+#endif
 #else
   outColor.a = 0.0;
 #endif
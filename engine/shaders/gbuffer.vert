@@ -6,11 +6,8 @@ layout (location = 4) in vec3 tangent;
 layout (location = 12) uniform vec3 cameraPos_World;
 
 layout (std140) uniform TransformationBlock {
-  mat4 M;
   mat4 V;
-  mat4 MV;
-  mat4 MVP;
-  mat4 NormalMatrix;
+  mat4 VP;
 };
 
 out vec2 texCoord;
@@ -24,11 +21,16 @@ out mat3 TBN;
 
 void main()
 {
-  gl_Position = MVP * vec4(position, 1.0);
+  mat4 M = instanceModel;
+  vec4 position_World = M * vec4(decodePosition(position), 1.0);
+  gl_Position = VP * position_World;
   texCoord = tex;
-  vertexPos_World = vec3(M * vec4(position, 1.0));
-  vertexPos_View = vec3(MV * vec4(position, 1.0));
-  normal_World = normalize(vec3(NormalMatrix * vec4(normal, 0.0)));
+#if defined(BINDLESS)
+  materialIndex = getMaterialIndex();
+#endif
+  vertexPos_World = vec3(position_World);
+  vertexPos_View = vec3(V * position_World);
+  normal_World = normalize(vec3(instanceNormal * vec4(normal, 0.0)));
 
 #if defined(BUMP)
   eyeDir_World = cameraPos_World - vertexPos_World;
@@ -3,8 +3,11 @@ in vec2 texCoord;
 out vec4 outColor;
 
 layout (location = 30) uniform sampler2D renderedTex;
-layout (location = 40) uniform float time;
-layout (location = 41) uniform vec2 screenSize;
+layout (std140) uniform ParameterBlock
+{
+    float time;
+    vec2 screenSize;
+};
 
 
 void main()
@@ -3,15 +3,12 @@ layout (location = 1) in vec3 position;
 out vec3 texCoord;
 
 layout (std140) uniform TransformationBlock {
-    mat4 M;
     mat4 V;
-    mat4 MV;
-    mat4 MVP;
-    mat4 NormalMatrix;
+    mat4 VP;
 };
 
 void main()
 {    
-    gl_Position = (MVP * vec4(position, 1.0)).xyww;
-    texCoord = position;
+    gl_Position = (VP * instanceModel * vec4(decodePosition(position), 1.0)).xyww;
+    texCoord = decodePosition(position);
 }
@@ -0,0 +1,190 @@
+#include "staticbatcher.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <utility>
+
+namespace moar
+{
+
+namespace
+{
+
+const float STATIC_CHUNK_SIZE = 10.0f;
+const size_t MAX_CHUNK_VERTICES = 65536;
+
+glm::vec3 transformDirection(const glm::mat3& matrix, const glm::vec3& direction)
+{
+    glm::vec3 transformed = matrix * direction;
+    float length = glm::length(transformed);
+    return length > 0.0f ? transformed / length : transformed;
+}
+
+float getMaxScale(const glm::mat4& model)
+{
+    return std::max(std::max(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1]))),
+                    glm::length(glm::vec3(model[2])));
+}
+
+void appendIndices(const std::vector<unsigned int>& source, unsigned int baseVertex, bool flipWinding,
+                   std::vector<unsigned int>& target)
+{
+    for (size_t i = 0; i + 2 < source.size(); i += 3) {
+        target.push_back(baseVertex + source[i]);
+        target.push_back(baseVertex + source[flipWinding ? i + 2 : i + 1]);
+        target.push_back(baseVertex + source[flipWinding ? i + 1 : i + 2]);
+    }
+}
+
+} // anonymous
+
+StaticBatcher::StaticBatcher()
+{
+}
+
+StaticBatcher::~StaticBatcher()
+{
+}
+
+const std::vector<StaticBatcher::Batch>& StaticBatcher::build(const std::vector<Object*>& objects)
+{
+    clear();
+
+    // Meshes are grouped by shadow casting, occluding, material and the world space cell of their center
+    // point so that every merged mesh stays compact enough to be frustum culled on its own.
+    using ChunkKey = std::tuple<bool, bool, Handle<Material>, int, int, int>;
+    std::map<ChunkKey, std::vector<SourceMesh>> chunks;
+    unsigned int numSourceMeshes = 0;
+    for (Object* obj : objects) {
+        const glm::mat4& modelMatrix = obj->getModelMatrix();
+        const glm::mat4& normalMatrix = obj->getNormalMatrix();
+        for (const auto& meshObject : obj->getMeshObjects()) {
+            glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(meshObject.mesh->getCenterPoint(), 1.0f));
+            glm::ivec3 cell = glm::ivec3(glm::floor(center / STATIC_CHUNK_SIZE));
+            ChunkKey key(obj->isShadowCaster(), obj->isOccluder(), meshObject.material, cell.x, cell.y, cell.z);
+            chunks[key].push_back(SourceMesh{meshObject.mesh, &modelMatrix, &normalMatrix});
+            ++numSourceMeshes;
+        }
+    }
+
+    auto getBatchModel = [this] (bool shadowCaster, bool occluder) {
+        for (auto& batch : batches) {
+            if (batch.shadowCaster == shadowCaster && batch.occluder == occluder) {
+                return batch.model.get();
+            }
+        }
+        batches.push_back(Batch{std::unique_ptr<Model>(new Model()), shadowCaster, occluder});
+        return batches.back().model.get();
+    };
+
+    unsigned int numMergedMeshes = 0;
+    for (const auto& chunk : chunks) {
+        Model* model = getBatchModel(std::get<0>(chunk.first), std::get<1>(chunk.first));
+        Handle<Material> material = std::get<2>(chunk.first);
+        std::vector<SourceMesh> group;
+        size_t numVertices = 0;
+        for (const SourceMesh& source : chunk.second) {
+            size_t sourceVertices = source.mesh->getData().vertices.size();
+            if (!group.empty() && numVertices + sourceVertices > MAX_CHUNK_VERTICES) {
+                model->addMesh(mergeMeshes(group, material));
+                ++numMergedMeshes;
+                group.clear();
+                numVertices = 0;
+            }
+            group.push_back(source);
+            numVertices += sourceVertices;
+        }
+        if (!group.empty()) {
+            model->addMesh(mergeMeshes(group, material));
+            ++numMergedMeshes;
+        }
+    }
+
+    std::cout << "Static batching merged " << numSourceMeshes << " meshes into " << numMergedMeshes << " meshes\n";
+    return batches;
+}
+
+const std::vector<StaticBatcher::Batch>& StaticBatcher::getBatches() const
+{
+    return batches;
+}
+
+void StaticBatcher::clear()
+{
+    batches.clear();
+}
+
+void StaticBatcher::setMeshClustering(bool enabled)
+{
+    clusterMeshes = enabled;
+}
+
+std::unique_ptr<Mesh> StaticBatcher::mergeMeshes(const std::vector<SourceMesh>& sources, Handle<Material> material) const
+{
+    bool hasTangents = false;
+    bool hasTexCoords = false;
+    size_t numLods = 0;
+    for (const SourceMesh& source : sources) {
+        hasTangents = hasTangents || !source.mesh->getData().tangents.empty();
+        hasTexCoords = hasTexCoords || !source.mesh->getData().texCoords.empty();
+        numLods = std::max(numLods, source.mesh->getData().lods.size());
+    }
+
+    // Each merged level takes the same level of every source or its coarsest one if it has fewer,
+    // the error is the largest world space error among them
+    MeshData data;
+    data.lods.resize(numLods);
+    for (MeshLod& lod : data.lods) {
+        lod.error = 0.0f;
+    }
+    for (const SourceMesh& source : sources) {
+        const MeshData& src = source.mesh->getData();
+        unsigned int baseVertex = static_cast<unsigned int>(data.vertices.size());
+        glm::mat3 tangentMatrix(*source.modelMatrix);
+        glm::mat3 normalMatrix(*source.normalMatrix);
+
+        for (size_t i = 0; i < src.vertices.size(); ++i) {
+            data.vertices.push_back(glm::vec3(*source.modelMatrix * glm::vec4(src.vertices[i], 1.0f)));
+            glm::vec3 normal = i < src.normals.size() ? src.normals[i] : glm::vec3(0.0f, 1.0f, 0.0f);
+            data.normals.push_back(transformDirection(normalMatrix, normal));
+            if (hasTangents) {
+                glm::vec3 tangent = i < src.tangents.size() ? src.tangents[i] : glm::vec3(0.0f);
+                data.tangents.push_back(transformDirection(tangentMatrix, tangent));
+            }
+            if (hasTexCoords) {
+                data.texCoords.push_back(i < src.texCoords.size() ? src.texCoords[i] : glm::vec2(0.0f));
+            }
+        }
+
+        // Mirroring transforms flip the winding, so keep the front faces facing out
+        bool flipWinding = glm::determinant(tangentMatrix) < 0.0f;
+        appendIndices(src.indices, baseVertex, flipWinding, data.indices);
+        float scale = getMaxScale(*source.modelMatrix);
+        for (size_t lod = 0; lod < numLods; ++lod) {
+            if (src.lods.empty()) {
+                appendIndices(src.indices, baseVertex, flipWinding, data.lods[lod].indices);
+                continue;
+            }
+            const MeshLod& srcLod = src.lods[std::min(lod, src.lods.size() - 1)];
+            appendIndices(srcLod.indices, baseVertex, flipWinding, data.lods[lod].indices);
+            data.lods[lod].error = std::max(data.lods[lod].error, srcLod.error * scale);
+        }
+    }
+
+    // The merged index order follows the sources, so clusters of consecutive triangles stay local
+    if (clusterMeshes) {
+        meshClusterer.cluster(data);
+    }
+
+    std::unique_ptr<Mesh> mesh(new Mesh());
+    GeometryBuffer::VertexFormat format = GeometryBuffer::selectFormat(data);
+    mesh->setData(std::move(data), format);
+    mesh->setMaterial(material);
+    return mesh;
+}
+
+} // moar
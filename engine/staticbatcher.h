@@ -0,0 +1,55 @@
+#ifndef STATICBATCHER_H
+#define STATICBATCHER_H
+
+#include "object.h"
+#include "model.h"
+#include "meshclusterer.h"
+
+#include <vector>
+#include <memory>
+
+namespace moar
+{
+
+class StaticBatcher
+{
+public:
+    struct Batch
+    {
+        std::unique_ptr<Model> model;
+        bool shadowCaster;
+        bool occluder;
+    };
+
+    explicit StaticBatcher();
+    ~StaticBatcher();
+    StaticBatcher(const StaticBatcher&) = delete;
+    StaticBatcher(StaticBatcher&&) = delete;
+    StaticBatcher& operator=(const StaticBatcher&) = delete;
+    StaticBatcher& operator=(StaticBatcher&&) = delete;
+
+    // Merges the meshes of the given objects by material into world space chunks.
+    // World matrices of the objects must be up to date.
+    const std::vector<Batch>& build(const std::vector<Object*>& objects);
+    const std::vector<Batch>& getBatches() const;
+    void clear();
+    void setMeshClustering(bool enabled);
+
+private:
+    struct SourceMesh
+    {
+        const Mesh* mesh;
+        const glm::mat4* modelMatrix;
+        const glm::mat4* normalMatrix;
+    };
+
+    std::unique_ptr<Mesh> mergeMeshes(const std::vector<SourceMesh>& sources, Handle<Material> material) const;
+
+    std::vector<Batch> batches;
+    bool clusterMeshes = true;
+    MeshClusterer meshClusterer;
+};
+
+} // moar
+
+#endif // STATICBATCHER_H
@@ -1,4 +1,6 @@
 #include "texture.h"
+#include "texturecooker.h"
+#include "mappedfile.h"
 
 #include <SOIL.h>
 #include <iostream>
@@ -7,6 +9,83 @@
 namespace moar
 {
 
+namespace
+{
+
+GLsizei getNumMipLevels(int width, int height)
+{
+    GLsizei numLevels = 1;
+    for (int size = std::max(width, height); size > 1; size /= 2) {
+        ++numLevels;
+    }
+    return numLevels;
+}
+
+} // anonymous
+
+bool Texture::decode(const std::string& file, ImageData& image)
+{
+    int width;
+    int height;
+    int channels;
+    unsigned char* pixels = SOIL_load_image(file.c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+    if (!pixels) {
+        return false;
+    }
+
+    image.file = file;
+    image.internalFormat = GL_RGBA8;
+    image.compressed = false;
+    image.levels.resize(1);
+    image.levels[0].width = width;
+    image.levels[0].height = height;
+    image.levels[0].data.assign(pixels, pixels + width * height * 4);
+    SOIL_free_image_data(pixels);
+    return true;
+}
+
+bool Texture::decodeCooked(const std::string& file, ImageData& image, size_t firstLevel, int maxSize)
+{
+    MappedFile mappedFile;
+    std::vector<TextureCooker::Level> levels;
+    if (!mappedFile.open(file) ||
+        !TextureCooker::parse(mappedFile.getData(), mappedFile.getSize(), image.internalFormat, levels)) {
+        return false;
+    }
+
+    if (maxSize > 0) {
+        while (firstLevel + 1 < levels.size() && std::max(levels[firstLevel].width, levels[firstLevel].height) > maxSize) {
+            ++firstLevel;
+        }
+    }
+    firstLevel = std::min(firstLevel, levels.size() - 1);
+
+    image.file = file;
+    image.compressed = true;
+    image.firstLevel = firstLevel;
+    image.fileWidth = levels[0].width;
+    image.fileHeight = levels[0].height;
+    image.numFileLevels = levels.size();
+    image.levels.resize(levels.size() - firstLevel);
+    for (size_t i = 0; i < image.levels.size(); ++i) {
+        const TextureCooker::Level& level = levels[firstLevel + i];
+        image.levels[i].width = level.width;
+        image.levels[i].height = level.height;
+        image.levels[i].data.assign(level.data, level.data + level.size);
+    }
+    return true;
+}
+
+GLsizeiptr Texture::getStagingSize(const ImageData& image)
+{
+    size_t numSourceLevels = image.compressed ? image.levels.size() : std::min<size_t>(image.levels.size(), 1);
+    GLsizeiptr size = 0;
+    for (size_t i = 0; i < numSourceLevels; ++i) {
+        size += TextureUploader::align(image.levels[i].data.size());
+    }
+    return size;
+}
+
 Texture::Texture()
 {
     glGenTextures(1, &id);
@@ -17,52 +96,155 @@ Texture::~Texture()
     glDeleteTextures(1, &id);
 }
 
-bool Texture::load(const std::string& file)
+bool Texture::load(const std::string& file, TextureUploader* uploader)
 {
-    glBindTexture(GL_TEXTURE_2D, id);
+    ImageData image;
+    return decode(file, image) && upload(image, uploader);
+}
 
-    int width;
-    int height;
-    int channels;
-    unsigned char* image = SOIL_load_image(file.c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+bool Texture::loadCooked(const std::string& file, TextureUploader* uploader)
+{
+    ImageData image;
+    return decodeCooked(file, image) && upload(image, uploader);
+}
 
-    if (!image) {
+bool Texture::upload(const ImageData& image, TextureUploader* uploader)
+{
+    if (image.levels.empty()) {
         return false;
     }
+    if (immutable) {
+        std::cerr << "WARNING: Texture storage is immutable, could not upload " << image.file << "\n";
+        return false;
+    }
+    if (placeholder) {
+        glDeleteTextures(1, &id);
+        glGenTextures(1, &id);
+        placeholder = false;
+    }
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    internalFormat = image.internalFormat;
+    compressed = image.compressed;
+    width = image.levels[0].width;
+    height = image.levels[0].height;
+    numLevels = compressed ? static_cast<GLsizei>(image.levels.size()) : getNumMipLevels(width, height);
+    firstLevel = image.firstLevel;
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexStorage2D(GL_TEXTURE_2D, numLevels, internalFormat, width, height);
+    immutable = true;
 
-    SOIL_free_image_data(image);
+    uploadLevels(image, compressed ? image.levels.size() : 1, uploader);
+    if (!compressed) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    setParameters();
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    std::cout << "Loaded texture: " << image.file << "\n";
 
-    std::cout << "Loaded texture: " << file << "\n";
+    return true;
+}
+
+bool Texture::restream(const ImageData& image, size_t newFirstLevel, TextureUploader* uploader)
+{
+    if (!immutable || !compressed) {
+        std::cerr << "WARNING: Only uploaded compressed textures can be restreamed\n";
+        return false;
+    }
+    size_t numNew = newFirstLevel < firstLevel ? firstLevel - newFirstLevel : 0;
+    size_t numDropped = newFirstLevel > firstLevel ? newFirstLevel - firstLevel : 0;
+    if (numDropped >= static_cast<size_t>(numLevels) ||
+        (numNew > 0 && (image.firstLevel != newFirstLevel || image.levels.size() < numNew))) {
+        std::cerr << "WARNING: Could not restream texture levels of " << image.file << "\n";
+        return false;
+    }
+
+    int newWidth = numNew > 0 ? image.levels[0].width : std::max(width >> numDropped, 1);
+    int newHeight = numNew > 0 ? image.levels[0].height : std::max(height >> numDropped, 1);
+    GLsizei newNumLevels = numLevels + static_cast<GLsizei>(numNew) - static_cast<GLsizei>(numDropped);
+    GLuint newId;
+    glGenTextures(1, &newId);
+    glBindTexture(GL_TEXTURE_2D, newId);
+    glTexStorage2D(GL_TEXTURE_2D, newNumLevels, internalFormat, newWidth, newHeight);
+    uploadLevels(image, numNew, uploader);
+
+    // The levels that stay resident never go back through the CPU
+    for (GLsizei level = static_cast<GLsizei>(numNew); level < newNumLevels; ++level) {
+        GLint source = level - static_cast<GLint>(numNew) + static_cast<GLint>(numDropped);
+        glCopyImageSubData(id, GL_TEXTURE_2D, source, 0, 0, 0, newId, GL_TEXTURE_2D, level, 0, 0, 0,
+                           std::max(width >> source, 1), std::max(height >> source, 1), 1);
+    }
+    glDeleteTextures(1, &id);
 
+    id = newId;
+    width = newWidth;
+    height = newHeight;
+    numLevels = newNumLevels;
+    firstLevel = newFirstLevel;
+    setParameters();
     return true;
 }
 
-bool Texture::load(const std::vector<std::string>& files)
+void Texture::setPlaceholder(const unsigned char* rgba)
+{
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    placeholder = true;
+}
+
+bool Texture::load(const std::vector<std::string>& files, TextureUploader* uploader)
 {
     if (files.size() != 6) {
         std::cerr << "WARNING: Could not load cube map texture, requires six faces\n";
         return false;
     }
+    if (immutable) {
+        std::cerr << "WARNING: Texture storage is immutable, could not upload the cube map\n";
+        return false;
+    }
 
     glBindTexture(GL_TEXTURE_CUBE_MAP, id);
 
-    int width;
-    int height;
+    int faceWidth = 0;
+    int faceHeight = 0;
     for(unsigned int i = 0; i < files.size(); i++) {
-        unsigned char* image = SOIL_load_image(files[i].c_str(), &width, &height, 0, SOIL_LOAD_RGB);
+        int width;
+        int height;
+        unsigned char* image = SOIL_load_image(files[i].c_str(), &width, &height, 0, SOIL_LOAD_RGBA);
         if (!image) {
             std::cerr << "WARNING: Failed to load cube texture; " << files[i] << "\n";
             return false;
         }
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+        if (i == 0) {
+            faceWidth = width;
+            faceHeight = height;
+            glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, GL_RGBA8, width, height);
+            immutable = true;
+        } else if (width != faceWidth || height != faceHeight) {
+            std::cerr << "WARNING: Cube texture face size differs from the first face; " << files[i] << "\n";
+            SOIL_free_image_data(image);
+            return false;
+        }
+
+        size_t size = static_cast<size_t>(width) * height * 4;
+        GLintptr offset = -1;
+        if (uploader && uploader->isEnabled()) {
+            offset = uploader->allocate(size);
+        }
+        if (offset >= 0) {
+            std::copy(image, image + size, uploader->getPointer(offset));
+            uploader->bind();
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                            reinterpret_cast<const void*>(offset));
+            uploader->unbind();
+            uploader->fence();
+        } else {
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, image);
+        }
         SOIL_free_image_data(image);
     }
 
@@ -84,4 +266,57 @@ GLuint Texture::getID() const
     return id;
 }
 
+void Texture::uploadLevels(const ImageData& image, size_t numSourceLevels, TextureUploader* uploader)
+{
+    GLsizeiptr size = 0;
+    for (size_t i = 0; i < numSourceLevels; ++i) {
+        size += TextureUploader::align(image.levels[i].data.size());
+    }
+
+    std::vector<const unsigned char*> sources(numSourceLevels);
+    GLintptr offset = -1;
+    if (uploader && uploader->isEnabled() && size > 0) {
+        offset = uploader->allocate(size);
+    }
+    bool staged = offset >= 0;
+    if (staged) {
+        for (size_t i = 0; i < numSourceLevels; ++i) {
+            const std::vector<unsigned char>& data = image.levels[i].data;
+            std::copy(data.begin(), data.end(), uploader->getPointer(offset));
+            sources[i] = reinterpret_cast<const unsigned char*>(offset);
+            offset += TextureUploader::align(data.size());
+        }
+        uploader->bind();
+    } else {
+        for (size_t i = 0; i < numSourceLevels; ++i) {
+            sources[i] = &image.levels[i].data[0];
+        }
+    }
+
+    for (size_t i = 0; i < numSourceLevels; ++i) {
+        const Level& level = image.levels[i];
+        if (image.compressed) {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), 0, 0, level.width, level.height,
+                                      image.internalFormat, static_cast<GLsizei>(level.data.size()), sources[i]);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), 0, 0, level.width, level.height, GL_RGBA,
+                            GL_UNSIGNED_BYTE, sources[i]);
+        }
+    }
+
+    if (staged) {
+        uploader->unbind();
+        uploader->fence();
+    }
+}
+
+void Texture::setParameters()
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
 } // moar
@@ -1,6 +1,8 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include "textureuploader.h"
+
 #include <GL/glew.h>
 
 #include <string>
@@ -12,6 +14,34 @@ namespace moar
 class Texture
 {
 public:
+    struct Level
+    {
+        int width;
+        int height;
+        std::vector<unsigned char> data;
+    };
+
+    // Decoded on any thread and uploaded on the render thread. Uncompressed images have only
+    // the first level, the rest are generated on the GPU.
+    struct ImageData
+    {
+        std::string file;
+        GLenum internalFormat = GL_RGBA8;
+        bool compressed = false;
+        std::vector<Level> levels;
+        // Cooked images may start from a smaller level of the file
+        size_t firstLevel = 0;
+        int fileWidth = 0;
+        int fileHeight = 0;
+        size_t numFileLevels = 0;
+    };
+
+    static bool decode(const std::string& file, ImageData& image);
+    // Decodes the levels from the first one on, or from the first one that fits in maxSize if given
+    static bool decodeCooked(const std::string& file, ImageData& image, size_t firstLevel = 0, int maxSize = 0);
+    // Bytes the image takes in the texture uploader
+    static GLsizeiptr getStagingSize(const ImageData& image);
+
     explicit Texture();
     ~Texture();
     Texture(const Texture&) = delete;
@@ -19,13 +49,36 @@ public:
     Texture& operator=(const Texture&) = delete;
     Texture& operator=(Texture&&) = delete;
 
-    bool load(const std::string& file);
-    bool load(const std::vector<std::string>& files);
+    // The storage is immutable, so a texture is loaded only once. Without an uploader the texels
+    // are copied from the client memory.
+    bool load(const std::string& file, TextureUploader* uploader = nullptr);
+    bool load(const std::vector<std::string>& files, TextureUploader* uploader = nullptr);
+    // Block compressed file with a complete mip chain written by the texture cooker
+    bool loadCooked(const std::string& file, TextureUploader* uploader = nullptr);
+    bool upload(const ImageData& image, TextureUploader* uploader = nullptr);
+    // Reallocates a compressed texture to start from the given level of the file. The new larger
+    // levels come from the image, the kept levels are copied on the GPU. The name changes.
+    bool restream(const ImageData& image, size_t firstLevel, TextureUploader* uploader = nullptr);
+    // Single texel shown until the real image has been uploaded. The upload creates a new name,
+    // the placeholder may already have a bindless handle that freezes its storage.
+    void setPlaceholder(const unsigned char* rgba);
 
     GLuint getID() const;
 
 private:
+    void uploadLevels(const ImageData& image, size_t numSourceLevels, TextureUploader* uploader);
+    void setParameters();
+
     GLuint id = 0;
+    bool immutable = false;
+    bool placeholder = false;
+    // Storage of the last upload
+    GLenum internalFormat = GL_RGBA8;
+    bool compressed = false;
+    int width = 0;
+    int height = 0;
+    GLsizei numLevels = 0;
+    size_t firstLevel = 0;
 };
 
 } // moar
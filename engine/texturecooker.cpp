@@ -0,0 +1,497 @@
+#include "texturecooker.h"
+#include "mappedfile.h"
+#include "hash.h"
+
+#include <SOIL.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <limits>
+
+namespace moar
+{
+
+namespace
+{
+
+// Increment when the cooked output changes so that old files are not picked up
+const uint32_t COOKER_VERSION = 1;
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+const uint32_t DDS_HEADER_SIZE = 124;
+const uint32_t DDS_PIXEL_FORMAT_SIZE = 32;
+const uint32_t DDSD_REQUIRED = 0x1 | 0x2 | 0x4 | 0x1000; // Caps, height, width and pixel format
+const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+const uint32_t DDSD_LINEARSIZE = 0x80000;
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t DDSCAPS_TEXTURE = 0x1000;
+const uint32_t DDSCAPS_COMPLEX = 0x8;
+const uint32_t DDSCAPS_MIPMAP = 0x400000;
+
+// Offsets in 32 bit words of the header that follows the magic number
+const int DDS_FLAGS = 1;
+const int DDS_HEIGHT = 2;
+const int DDS_WIDTH = 3;
+const int DDS_LINEAR_SIZE = 4;
+const int DDS_MIP_COUNT = 6;
+const int DDS_PIXEL_FORMAT = 18;
+const int DDS_FOURCC = 20;
+const int DDS_CAPS = 26;
+
+struct FormatInfo
+{
+    uint32_t fourCC;
+    GLenum internalFormat;
+    size_t blockSize;
+};
+
+constexpr uint32_t makeFourCC(char a, char b, char c, char d)
+{
+    return static_cast<uint32_t>(a) | static_cast<uint32_t>(b) << 8 | static_cast<uint32_t>(c) << 16 |
+           static_cast<uint32_t>(d) << 24;
+}
+
+// By TextureCooker::Format
+const FormatInfo FORMAT_INFOS[] =
+{
+    {makeFourCC('D', 'X', 'T', '1'), GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 8},
+    {makeFourCC('D', 'X', 'T', '5'), GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16},
+    {makeFourCC('A', 'T', 'I', '1'), GL_COMPRESSED_RED_RGTC1, 8},
+    {makeFourCC('A', 'T', 'I', '2'), GL_COMPRESSED_RG_RGTC2, 16}
+};
+
+size_t calculateLevelSize(int width, int height, size_t blockSize)
+{
+    return static_cast<size_t>((width + 3) / 4) * static_cast<size_t>((height + 3) / 4) * blockSize;
+}
+
+float srgbToLinear(unsigned char value)
+{
+    float c = value / 255.0f;
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+unsigned char linearToSrgb(float value)
+{
+    float c = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    return static_cast<unsigned char>(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+unsigned char toByte(float value)
+{
+    return static_cast<unsigned char>(std::min(std::max(value, 0.0f), 255.0f) + 0.5f);
+}
+
+uint16_t packColor(const float* color)
+{
+    int r = static_cast<int>(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = static_cast<int>(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = static_cast<int>(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+void unpackColor(uint16_t packed, float* color)
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    color[0] = static_cast<float>(r << 3 | r >> 2);
+    color[1] = static_cast<float>(g << 2 | g >> 4);
+    color[2] = static_cast<float>(b << 3 | b >> 2);
+}
+
+} // anonymous
+
+bool TextureCooker::isSupported()
+{
+    // The RGTC formats used for BC4 and BC5 are core since OpenGL 3.0
+    return GLEW_EXT_texture_compression_s3tc != 0;
+}
+
+size_t TextureCooker::getLevelSize(GLenum internalFormat, int width, int height)
+{
+    for (const FormatInfo& info : FORMAT_INFOS) {
+        if (info.internalFormat == internalFormat) {
+            return calculateLevelSize(width, height, info.blockSize);
+        }
+    }
+    return 0;
+}
+
+bool TextureCooker::parse(const unsigned char* data, size_t size, GLenum& internalFormat, std::vector<Level>& levels)
+{
+    uint32_t header[DDS_HEADER_SIZE / 4];
+    uint32_t magic;
+    if (size < sizeof(magic) + sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&magic, data, sizeof(magic));
+    std::memcpy(header, data + sizeof(magic), sizeof(header));
+    if (magic != DDS_MAGIC || header[0] != DDS_HEADER_SIZE || !(header[DDS_PIXEL_FORMAT + 1] & DDPF_FOURCC)) {
+        return false;
+    }
+
+    const FormatInfo* info = nullptr;
+    for (const FormatInfo& formatInfo : FORMAT_INFOS) {
+        if (formatInfo.fourCC == header[DDS_FOURCC]) {
+            info = &formatInfo;
+        }
+    }
+    if (!info) {
+        return false;
+    }
+
+    internalFormat = info->internalFormat;
+    int width = static_cast<int>(header[DDS_WIDTH]);
+    int height = static_cast<int>(header[DDS_HEIGHT]);
+    uint32_t numLevels = (header[DDS_FLAGS] & DDSD_MIPMAPCOUNT) ? std::max(header[DDS_MIP_COUNT], 1u) : 1;
+    size_t offset = sizeof(magic) + sizeof(header);
+    levels.clear();
+    for (uint32_t i = 0; i < numLevels; ++i) {
+        size_t levelSize = calculateLevelSize(width, height, info->blockSize);
+        if (size - offset < levelSize) {
+            return false;
+        }
+        levels.push_back(Level{width, height, data + offset, levelSize});
+        offset += levelSize;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    return true;
+}
+
+TextureCooker::TextureCooker()
+{
+}
+
+TextureCooker::~TextureCooker()
+{
+}
+
+bool TextureCooker::getCookedName(const std::string& sourceFile, Material::TextureType type, std::string& name) const
+{
+    MappedFile source;
+    if (!source.open(sourceFile)) {
+        return false;
+    }
+    uint64_t hash = hashBytes(source.getData(), source.getSize());
+    uint32_t options = COOKER_VERSION << 8 | static_cast<uint32_t>(type);
+    hash = hashBytes(&options, sizeof(options), hash);
+
+    std::ostringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << hash << ".dds";
+    name = ss.str();
+    return true;
+}
+
+bool TextureCooker::cook(const std::string& sourceFile, Material::TextureType type, const std::string& cookedFile) const
+{
+    int width;
+    int height;
+    int channels;
+    unsigned char* pixels = SOIL_load_image(sourceFile.c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+    if (!pixels) {
+        return false;
+    }
+
+    std::vector<Image> mips(1);
+    mips[0].width = width;
+    mips[0].height = height;
+    mips[0].pixels.assign(pixels, pixels + width * height * 4);
+    SOIL_free_image_data(pixels);
+
+    while (mips.back().width > 1 || mips.back().height > 1) {
+        Image mip;
+        downsample(mips.back(), type, mip);
+        mips.push_back(std::move(mip));
+    }
+
+    Format format = selectFormat(type, mips[0]);
+    std::vector<std::vector<unsigned char>> levels(mips.size());
+    for (size_t i = 0; i < mips.size(); ++i) {
+        compress(mips[i], format, levels[i]);
+    }
+
+    if (!writeDds(cookedFile, format, mips, levels)) {
+        std::cerr << "WARNING: Could not write cooked texture " << cookedFile << "\n";
+        return false;
+    }
+    std::cout << "Cooked texture: " << sourceFile << "\n";
+    return true;
+}
+
+TextureCooker::Format TextureCooker::selectFormat(Material::TextureType type, const Image& image) const
+{
+    switch (type) {
+    case Material::NORMAL:
+        return BC5;
+    case Material::SPECULAR:
+    case Material::BUMP:
+        return BC4;
+    default:
+        for (size_t i = 3; i < image.pixels.size(); i += 4) {
+            if (image.pixels[i] < 255) {
+                return BC3;
+            }
+        }
+        return BC1;
+    }
+}
+
+void TextureCooker::downsample(const Image& source, Material::TextureType type, Image& target) const
+{
+    target.width = std::max(source.width / 2, 1);
+    target.height = std::max(source.height / 2, 1);
+    target.pixels.resize(target.width * target.height * 4);
+
+    for (int y = 0; y < target.height; ++y) {
+        for (int x = 0; x < target.width; ++x) {
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (int i = 0; i < 4; ++i) {
+                int sx = std::min(x * 2 + (i & 1), source.width - 1);
+                int sy = std::min(y * 2 + (i >> 1), source.height - 1);
+                const unsigned char* pixel = &source.pixels[(sy * source.width + sx) * 4];
+                for (int c = 0; c < 4; ++c) {
+                    // Color is averaged in linear space so that the mips do not darken
+                    if (type == Material::DIFFUSE && c < 3) {
+                        sum[c] += srgbToLinear(pixel[c]);
+                    } else if (type == Material::NORMAL && c < 3) {
+                        sum[c] += pixel[c] / 127.5f - 1.0f;
+                    } else {
+                        sum[c] += pixel[c];
+                    }
+                }
+            }
+
+            unsigned char* pixel = &target.pixels[(y * target.width + x) * 4];
+            if (type == Material::NORMAL) {
+                float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                for (int c = 0; c < 3; ++c) {
+                    float n = length > 0.0f ? sum[c] / length : (c == 2 ? 1.0f : 0.0f);
+                    pixel[c] = toByte((n + 1.0f) * 127.5f);
+                }
+            } else {
+                for (int c = 0; c < 3; ++c) {
+                    pixel[c] = type == Material::DIFFUSE ? linearToSrgb(sum[c] * 0.25f) : toByte(sum[c] * 0.25f);
+                }
+            }
+            pixel[3] = toByte(sum[3] * 0.25f);
+        }
+    }
+}
+
+void TextureCooker::compress(const Image& image, Format format, std::vector<unsigned char>& output) const
+{
+    size_t blockSize = FORMAT_INFOS[format].blockSize;
+    int blocksX = (image.width + 3) / 4;
+    int blocksY = (image.height + 3) / 4;
+    output.resize(calculateLevelSize(image.width, image.height, blockSize));
+
+    Block block;
+    for (int by = 0; by < blocksY; ++by) {
+        for (int bx = 0; bx < blocksX; ++bx) {
+            // Blocks over the edge repeat the last row and column
+            for (int i = 0; i < 16; ++i) {
+                int x = std::min(bx * 4 + (i & 3), image.width - 1);
+                int y = std::min(by * 4 + (i >> 2), image.height - 1);
+                std::memcpy(&block[i][0], &image.pixels[(y * image.width + x) * 4], 4);
+            }
+
+            unsigned char* out = &output[(by * blocksX + bx) * blockSize];
+            switch (format) {
+            case BC1:
+                compressColorBlock(block, out);
+                break;
+            case BC3:
+                compressChannelBlock(block, 3, out);
+                compressColorBlock(block, out + 8);
+                break;
+            case BC4:
+                compressChannelBlock(block, 0, out);
+                break;
+            case BC5:
+                compressChannelBlock(block, 0, out);
+                compressChannelBlock(block, 1, out + 8);
+                break;
+            }
+        }
+    }
+}
+
+void TextureCooker::compressColorBlock(const Block& block, unsigned char* output) const
+{
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (const auto& pixel : block) {
+        for (int c = 0; c < 3; ++c) {
+            mean[c] += pixel[c] / 16.0f;
+        }
+    }
+
+    // The endpoints are the extremes along the principal axis of the colors, found by power iteration
+    float covariance[3][3] = {};
+    for (const auto& pixel : block) {
+        float d[3] = {pixel[0] - mean[0], pixel[1] - mean[1], pixel[2] - mean[2]};
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                covariance[i][j] += d[i] * d[j];
+            }
+        }
+    }
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[3];
+        for (int i = 0; i < 3; ++i) {
+            next[i] = covariance[i][0] * axis[0] + covariance[i][1] * axis[1] + covariance[i][2] * axis[2];
+        }
+        float scale = std::max(std::max(std::abs(next[0]), std::abs(next[1])), std::abs(next[2]));
+        if (scale < 1e-6f) {
+            break;
+        }
+        for (int i = 0; i < 3; ++i) {
+            axis[i] = next[i] / scale;
+        }
+    }
+    float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    for (int i = 0; i < 3; ++i) {
+        axis[i] /= axisLength;
+    }
+
+    float minT = 0.0f;
+    float maxT = 0.0f;
+    for (const auto& pixel : block) {
+        float t = (pixel[0] - mean[0]) * axis[0] + (pixel[1] - mean[1]) * axis[1] + (pixel[2] - mean[2]) * axis[2];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    // Insetting the endpoints a little lowers the error of the interpolated colors
+    float inset = (maxT - minT) / 16.0f;
+    float high[3];
+    float low[3];
+    for (int i = 0; i < 3; ++i) {
+        high[i] = mean[i] + axis[i] * (maxT - inset);
+        low[i] = mean[i] + axis[i] * (minT + inset);
+    }
+
+    uint16_t color0 = packColor(high);
+    uint16_t color1 = packColor(low);
+    // The first color must be greater to select the four color mode
+    if (color0 < color1) {
+        std::swap(color0, color1);
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        float palette[4][3];
+        unpackColor(color0, palette[0]);
+        unpackColor(color1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+        for (int i = 0; i < 16; ++i) {
+            uint32_t best = 0;
+            float bestDistance = std::numeric_limits<float>::max();
+            for (uint32_t p = 0; p < 4; ++p) {
+                float distance = 0.0f;
+                for (int c = 0; c < 3; ++c) {
+                    float d = block[i][c] - palette[p][c];
+                    distance += d * d;
+                }
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (i * 2);
+        }
+    }
+
+    output[0] = static_cast<unsigned char>(color0 & 0xff);
+    output[1] = static_cast<unsigned char>(color0 >> 8);
+    output[2] = static_cast<unsigned char>(color1 & 0xff);
+    output[3] = static_cast<unsigned char>(color1 >> 8);
+    for (int i = 0; i < 4; ++i) {
+        output[4 + i] = static_cast<unsigned char>(indices >> (i * 8));
+    }
+}
+
+void TextureCooker::compressChannelBlock(const Block& block, int channel, unsigned char* output) const
+{
+    unsigned char high = 0;
+    unsigned char low = 255;
+    for (const auto& pixel : block) {
+        high = std::max(high, pixel[channel]);
+        low = std::min(low, pixel[channel]);
+    }
+
+    // With the first value greater the block has six interpolated values between the two
+    uint64_t indices = 0;
+    if (high != low) {
+        float palette[8];
+        palette[0] = high;
+        palette[1] = low;
+        for (int i = 1; i < 7; ++i) {
+            palette[i + 1] = ((7 - i) * high + i * low) / 7.0f;
+        }
+        for (int i = 0; i < 16; ++i) {
+            uint64_t best = 0;
+            float bestDistance = std::numeric_limits<float>::max();
+            for (uint64_t p = 0; p < 8; ++p) {
+                float distance = std::abs(block[i][channel] - palette[p]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (i * 3);
+        }
+    }
+
+    output[0] = high;
+    output[1] = low;
+    for (int i = 0; i < 6; ++i) {
+        output[2 + i] = static_cast<unsigned char>(indices >> (i * 8));
+    }
+}
+
+bool TextureCooker::writeDds(const std::string& file, Format format, const std::vector<Image>& mips,
+                             const std::vector<std::vector<unsigned char>>& levels) const
+{
+    uint32_t header[DDS_HEADER_SIZE / 4] = {};
+    header[0] = DDS_HEADER_SIZE;
+    header[DDS_FLAGS] = DDSD_REQUIRED | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header[DDS_HEIGHT] = static_cast<uint32_t>(mips[0].height);
+    header[DDS_WIDTH] = static_cast<uint32_t>(mips[0].width);
+    header[DDS_LINEAR_SIZE] = static_cast<uint32_t>(levels[0].size());
+    header[DDS_MIP_COUNT] = static_cast<uint32_t>(mips.size());
+    header[DDS_PIXEL_FORMAT] = DDS_PIXEL_FORMAT_SIZE;
+    header[DDS_PIXEL_FORMAT + 1] = DDPF_FOURCC;
+    header[DDS_FOURCC] = FORMAT_INFOS[format].fourCC;
+    header[DDS_CAPS] = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+    // Written next to the final file and renamed so that an interrupted write is never read
+    std::string temporaryFile = file + ".tmp";
+    std::ofstream out(temporaryFile, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&DDS_MAGIC), sizeof(DDS_MAGIC));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for (const auto& level : levels) {
+        out.write(reinterpret_cast<const char*>(&level[0]), level.size());
+    }
+    out.close();
+    if (!out) {
+        std::remove(temporaryFile.c_str());
+        return false;
+    }
+    std::remove(file.c_str());
+    return std::rename(temporaryFile.c_str(), file.c_str()) == 0;
+}
+
+} // moar
@@ -0,0 +1,77 @@
+#ifndef TEXTURECOOKER_H
+#define TEXTURECOOKER_H
+
+#include "material.h"
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace moar
+{
+
+// Converts source images into block compressed DDS files with a full mip chain. The format is
+// chosen by the role of the texture: BC1 for opaque and BC3 for transparent color, BC4 for the
+// single channel specular and bump maps and BC5 for the two channel normal maps.
+class TextureCooker
+{
+public:
+    enum Format
+    {
+        BC1 = 0,
+        BC3 = 1,
+        BC4 = 2,
+        BC5 = 3
+    };
+
+    struct Level
+    {
+        int width;
+        int height;
+        const unsigned char* data;
+        size_t size;
+    };
+
+    static bool isSupported();
+    // Levels point into the given data
+    static bool parse(const unsigned char* data, size_t size, GLenum& internalFormat, std::vector<Level>& levels);
+    // Bytes of a level in one of the cooked formats, zero for other formats
+    static size_t getLevelSize(GLenum internalFormat, int width, int height);
+
+    explicit TextureCooker();
+    ~TextureCooker();
+    TextureCooker(const TextureCooker&) = delete;
+    TextureCooker(TextureCooker&&) = delete;
+    TextureCooker& operator=(const TextureCooker&) = delete;
+    TextureCooker& operator=(TextureCooker&&) = delete;
+
+    // Name of the cooked file for the contents of the source file, changes when the source does
+    bool getCookedName(const std::string& sourceFile, Material::TextureType type, std::string& name) const;
+    bool cook(const std::string& sourceFile, Material::TextureType type, const std::string& cookedFile) const;
+
+private:
+    using Block = std::array<std::array<unsigned char, 4>, 16>;
+
+    struct Image
+    {
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;  // RGBA
+    };
+
+    Format selectFormat(Material::TextureType type, const Image& image) const;
+    void downsample(const Image& source, Material::TextureType type, Image& target) const;
+    void compress(const Image& image, Format format, std::vector<unsigned char>& output) const;
+    void compressColorBlock(const Block& block, unsigned char* output) const;
+    void compressChannelBlock(const Block& block, int channel, unsigned char* output) const;
+    bool writeDds(const std::string& file, Format format, const std::vector<Image>& mips,
+                  const std::vector<std::vector<unsigned char>>& levels) const;
+};
+
+} // moar
+
+#endif // TEXTURECOOKER_H
@@ -0,0 +1,256 @@
+#include "texturestreamer.h"
+#include "texturecooker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace moar
+{
+
+TextureStreamer::TextureStreamer()
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+}
+
+void TextureStreamer::init(AssetLoader* loader, TextureUploader* uploader, const RenameCallback& callback)
+{
+    this->loader = loader;
+    this->uploader = uploader;
+    renameCallback = callback;
+}
+
+void TextureStreamer::setBudget(size_t bytes)
+{
+    budget = bytes;
+    if (budget > 0) {
+        std::cout << "Texture streaming budget " << budget / (1024 * 1024) << " MB\n";
+    }
+}
+
+bool TextureStreamer::isEnabled() const
+{
+    return budget > 0 && loader && uploader;
+}
+
+void TextureStreamer::add(Texture* texture, const Texture::ImageData& image)
+{
+    StreamedTexture streamed;
+    streamed.file = image.file;
+    streamed.internalFormat = image.internalFormat;
+    streamed.width = image.fileWidth;
+    streamed.height = image.fileHeight;
+    streamed.numLevels = image.numFileLevels;
+    streamed.residentLevel = image.firstLevel;
+    streamed.desiredLevel = image.firstLevel;
+    streamed.minLevel = image.firstLevel;
+    streamed.pendingBytes = 0;
+    streamed.lastUsed = 0;
+    streamed.pixelsPerUv = 0.0f;
+    streamed.failed = false;
+    residentBytes += getLevelBytes(streamed, streamed.residentLevel, streamed.numLevels);
+    textures[texture] = streamed;
+    texturesById[texture->getID()] = texture;
+}
+
+void TextureStreamer::clear()
+{
+    textures.clear();
+    texturesById.clear();
+    residentBytes = 0;
+    pendingBytes = 0;
+    numPending = 0;
+}
+
+void TextureStreamer::requestDetail(GLuint texture, float pixelsPerUv)
+{
+    auto found = texturesById.find(texture);
+    if (found == texturesById.end()) {
+        return;
+    }
+    StreamedTexture& streamed = textures[found->second];
+    streamed.pixelsPerUv = std::max(streamed.pixelsPerUv, pixelsPerUv);
+    streamed.lastUsed = frame;
+}
+
+void TextureStreamer::update()
+{
+    if (!isEnabled()) {
+        ++frame;
+        return;
+    }
+
+    std::vector<std::pair<Texture*, StreamedTexture*>> candidates;
+    for (auto& kv : textures) {
+        StreamedTexture& streamed = kv.second;
+        // Textures that were not seen keep their levels until the memory is needed
+        if (streamed.lastUsed == frame) {
+            streamed.desiredLevel = getDesiredLevel(streamed);
+        }
+        streamed.pixelsPerUv = 0.0f;
+        if (streamed.pendingBytes == 0 && !streamed.failed && streamed.desiredLevel < streamed.residentLevel) {
+            candidates.emplace_back(kv.first, &streamed);
+        }
+    }
+
+    // The most recently seen textures that miss the most levels go first
+    std::sort(candidates.begin(), candidates.end(), [] (const std::pair<Texture*, StreamedTexture*>& a,
+                                                         const std::pair<Texture*, StreamedTexture*>& b) {
+        if (a.second->lastUsed != b.second->lastUsed) {
+            return a.second->lastUsed > b.second->lastUsed;
+        }
+        return a.second->residentLevel - a.second->desiredLevel > b.second->residentLevel - b.second->desiredLevel;
+    });
+
+    for (const auto& candidate : candidates) {
+        if (numPending >= MAX_PENDING_LOADS) {
+            break;
+        }
+        StreamedTexture& streamed = *candidate.second;
+        size_t level = streamed.desiredLevel;
+        size_t needed = getLevelBytes(streamed, level, streamed.residentLevel);
+        while (residentBytes + pendingBytes + needed > budget) {
+            size_t evictLevel;
+            Texture* victim = findVictim(candidate.first, streamed.lastUsed, evictLevel);
+            if (!victim) {
+                break;
+            }
+            StreamedTexture& evicted = textures[victim];
+            size_t freed = 0;
+            size_t victimLevel = evicted.residentLevel;
+            while (victimLevel < evictLevel && residentBytes - freed + pendingBytes + needed > budget) {
+                freed += getLevelBytes(evicted, victimLevel, victimLevel + 1);
+                ++victimLevel;
+            }
+            Texture::ImageData image;
+            image.file = evicted.file;
+            if (!restream(victim, evicted, image, victimLevel)) {
+                break;
+            }
+        }
+
+        // Whatever fits in the budget is loaded, the rest waits for memory to free up
+        while (level < streamed.residentLevel && residentBytes + pendingBytes + needed > budget) {
+            needed -= getLevelBytes(streamed, level, level + 1);
+            ++level;
+        }
+        if (level < streamed.residentLevel) {
+            load(candidate.first, streamed, level);
+        }
+    }
+    ++frame;
+}
+
+size_t TextureStreamer::getResidentBytes() const
+{
+    return residentBytes;
+}
+
+size_t TextureStreamer::getDesiredLevel(const StreamedTexture& streamed) const
+{
+    if (streamed.pixelsPerUv <= 0.0f) {
+        return streamed.minLevel;
+    }
+    // One texel per pixel of the largest dimension, the finer levels would only be minified
+    float texelsPerPixel = static_cast<float>(std::max(streamed.width, streamed.height)) / streamed.pixelsPerUv;
+    if (texelsPerPixel <= 1.0f) {
+        return 0;
+    }
+    return std::min(static_cast<size_t>(std::log2(texelsPerPixel)), streamed.minLevel);
+}
+
+size_t TextureStreamer::getLevelBytes(const StreamedTexture& streamed, size_t firstLevel, size_t endLevel) const
+{
+    size_t bytes = 0;
+    for (size_t level = firstLevel; level < endLevel; ++level) {
+        bytes += TextureCooker::getLevelSize(streamed.internalFormat, std::max(streamed.width >> level, 1),
+                                             std::max(streamed.height >> level, 1));
+    }
+    return bytes;
+}
+
+Texture* TextureStreamer::findVictim(const Texture* requester, unsigned int requesterUsed, size_t& evictLevel) const
+{
+    // Textures seen less recently than the requester drop to their minimum, the others only lose
+    // the levels beyond what they need
+    Texture* victim = nullptr;
+    unsigned int victimUsed = 0;
+    for (const auto& kv : textures) {
+        const StreamedTexture& streamed = kv.second;
+        if (kv.first == requester || streamed.pendingBytes > 0) {
+            continue;
+        }
+        size_t limit = streamed.lastUsed < requesterUsed ? streamed.minLevel : streamed.desiredLevel;
+        if (streamed.residentLevel >= limit) {
+            continue;
+        }
+        if (!victim || streamed.lastUsed < victimUsed) {
+            victim = kv.first;
+            victimUsed = streamed.lastUsed;
+            evictLevel = limit;
+        }
+    }
+    return victim;
+}
+
+void TextureStreamer::load(Texture* texture, StreamedTexture& streamed, size_t level)
+{
+    streamed.pendingBytes = getLevelBytes(streamed, level, streamed.residentLevel);
+    pendingBytes += streamed.pendingBytes;
+    ++numPending;
+
+    std::string file = streamed.file;
+    loader->load([this, texture, file, level] {
+        std::shared_ptr<Texture::ImageData> image(new Texture::ImageData());
+        bool decoded = Texture::decodeCooked(file, *image, level);
+        return [this, texture, image, decoded, level] {
+            auto found = textures.find(texture);
+            if (found == textures.end()) {
+                return true;
+            }
+            StreamedTexture& streamed = found->second;
+            // Only the levels above the resident ones are uploaded
+            GLsizeiptr size = 0;
+            for (size_t i = 0; decoded && i < image->levels.size() && level + i < streamed.residentLevel; ++i) {
+                size += TextureUploader::align(image->levels[i].data.size());
+            }
+            if (uploader->isEnabled() && size <= uploader->getCapacity() && !uploader->hasSpace(size)) {
+                return false;
+            }
+
+            pendingBytes -= streamed.pendingBytes;
+            streamed.pendingBytes = 0;
+            --numPending;
+            if (!decoded || !restream(texture, streamed, *image, level)) {
+                streamed.failed = true;
+                std::cerr << "WARNING: Failed to stream texture levels; " << streamed.file << "\n";
+            }
+            return true;
+        };
+    });
+}
+
+bool TextureStreamer::restream(Texture* texture, StreamedTexture& streamed, const Texture::ImageData& image, size_t level)
+{
+    GLuint oldId = texture->getID();
+    if (!texture->restream(image, level, uploader)) {
+        return false;
+    }
+    GLuint newId = texture->getID();
+    residentBytes -= getLevelBytes(streamed, streamed.residentLevel, streamed.numLevels);
+    residentBytes += getLevelBytes(streamed, level, streamed.numLevels);
+    streamed.residentLevel = level;
+    texturesById.erase(oldId);
+    texturesById[newId] = texture;
+    if (renameCallback) {
+        renameCallback(oldId, newId);
+    }
+    return true;
+}
+
+} // moar
@@ -0,0 +1,89 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include "texture.h"
+#include "textureuploader.h"
+#include "assetloader.h"
+
+#include <GL/glew.h>
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <cstddef>
+
+namespace moar
+{
+
+// Keeps the cooked textures resident only at the levels the screen needs. Textures start with
+// their smallest levels, the renderer reports the texel density each one is seen at and the
+// larger levels are loaded under the memory budget. The least recently seen textures are
+// evicted first. Changing the levels reallocates the texture, which changes its name.
+class TextureStreamer
+{
+public:
+    using RenameCallback = std::function<void(GLuint oldTexture, GLuint newTexture)>;
+
+    // Largest level that stays resident when a texture is not seen
+    static const int MIN_RESIDENT_SIZE = 64;
+    static const size_t MAX_PENDING_LOADS = 4;
+
+    explicit TextureStreamer();
+    ~TextureStreamer();
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer(TextureStreamer&&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(TextureStreamer&&) = delete;
+
+    void init(AssetLoader* loader, TextureUploader* uploader, const RenameCallback& callback);
+    // Bytes of video memory for the streamed textures, zero disables streaming
+    void setBudget(size_t bytes);
+    bool isEnabled() const;
+
+    // The image holds the smallest levels of the cooked file that the texture was uploaded from
+    void add(Texture* texture, const Texture::ImageData& image);
+    void clear();
+    // Called while rendering, pixelsPerUv is the screen size of one texture coordinate unit
+    void requestDetail(GLuint texture, float pixelsPerUv);
+    // Evicts and queues loads for the requests since the previous update
+    void update();
+    size_t getResidentBytes() const;
+
+private:
+    struct StreamedTexture
+    {
+        std::string file;
+        GLenum internalFormat;
+        int width;              // Of the first level of the file
+        int height;
+        size_t numLevels;
+        size_t residentLevel;   // First level in video memory
+        size_t desiredLevel;
+        size_t minLevel;        // Coarsest first level that is always resident
+        size_t pendingBytes;    // Of the load in flight
+        unsigned int lastUsed;
+        float pixelsPerUv;
+        bool failed;            // The levels could not be loaded, stays as it is
+    };
+
+    size_t getDesiredLevel(const StreamedTexture& streamed) const;
+    size_t getLevelBytes(const StreamedTexture& streamed, size_t firstLevel, size_t endLevel) const;
+    Texture* findVictim(const Texture* requester, unsigned int requesterUsed, size_t& evictLevel) const;
+    void load(Texture* texture, StreamedTexture& streamed, size_t level);
+    bool restream(Texture* texture, StreamedTexture& streamed, const Texture::ImageData& image, size_t level);
+
+    AssetLoader* loader = nullptr;
+    TextureUploader* uploader = nullptr;
+    RenameCallback renameCallback;
+    size_t budget = 0;
+    size_t residentBytes = 0;
+    size_t pendingBytes = 0;
+    size_t numPending = 0;
+    unsigned int frame = 1;
+    std::unordered_map<Texture*, StreamedTexture> textures;
+    std::unordered_map<GLuint, Texture*> texturesById;
+};
+
+} // moar
+
+#endif // TEXTURESTREAMER_H
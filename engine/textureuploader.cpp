@@ -0,0 +1,162 @@
+#include "textureuploader.h"
+
+#include <iostream>
+
+namespace moar
+{
+
+GLsizeiptr TextureUploader::align(size_t size)
+{
+    return static_cast<GLsizeiptr>((size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+}
+
+TextureUploader::TextureUploader()
+{
+}
+
+TextureUploader::~TextureUploader()
+{
+    deinit();
+}
+
+bool TextureUploader::init(GLsizeiptr size)
+{
+    deinit();
+    if (!GLEW_ARB_buffer_storage) {
+        std::cerr << "WARNING: Persistent buffer mapping is not supported, textures are uploaded directly\n";
+        return false;
+    }
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+    mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!mapped) {
+        std::cerr << "ERROR: Could not map the texture upload buffer\n";
+        deinit();
+        return false;
+    }
+
+    capacity = size;
+    std::cout << "Texture upload buffer of " << size / (1024 * 1024) << " MB\n";
+    return true;
+}
+
+void TextureUploader::deinit()
+{
+    for (const Submission& submission : submissions) {
+        glDeleteSync(submission.sync);
+    }
+    submissions.clear();
+    if (mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        mapped = nullptr;
+    }
+    if (buffer) {
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+    capacity = 0;
+    head = 0;
+    tail = 0;
+    pending = false;
+}
+
+bool TextureUploader::isEnabled() const
+{
+    return mapped != nullptr;
+}
+
+GLsizeiptr TextureUploader::getCapacity() const
+{
+    return capacity;
+}
+
+bool TextureUploader::hasSpace(GLsizeiptr size)
+{
+    retire();
+    return findSpace(align(size)) >= 0;
+}
+
+GLintptr TextureUploader::allocate(GLsizeiptr size)
+{
+    size = align(size);
+    retire();
+    GLintptr offset = findSpace(size);
+    if (offset < 0) {
+        return -1;
+    }
+    if (submissions.empty() && !pending) {
+        tail = 0;
+    }
+    head = offset + size;
+    pending = true;
+    return offset;
+}
+
+unsigned char* TextureUploader::getPointer(GLintptr offset) const
+{
+    return mapped + offset;
+}
+
+void TextureUploader::bind() const
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+}
+
+void TextureUploader::unbind() const
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureUploader::fence()
+{
+    if (!pending) {
+        return;
+    }
+    Submission submission;
+    submission.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    submission.end = head;
+    submissions.push_back(submission);
+    pending = false;
+}
+
+void TextureUploader::retire()
+{
+    // Polled without waiting, a range that is still being read is left for a later frame
+    while (!submissions.empty()) {
+        GLenum status = glClientWaitSync(submissions.front().sync, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            return;
+        }
+        tail = submissions.front().end;
+        glDeleteSync(submissions.front().sync);
+        submissions.pop_front();
+    }
+}
+
+GLintptr TextureUploader::findSpace(GLsizeiptr size) const
+{
+    if (!mapped || size > capacity) {
+        return -1;
+    }
+    if (submissions.empty() && !pending) {
+        return 0;
+    }
+
+    // The used range runs from the tail to the head and may wrap around the end, the head is
+    // kept from reaching the tail so that equal offsets always mean an empty ring
+    if (head >= tail) {
+        if (head + size <= capacity) {
+            return head;
+        }
+        return size < tail ? 0 : -1;
+    }
+    return head + size < tail ? head : -1;
+}
+
+} // moar
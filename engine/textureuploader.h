@@ -0,0 +1,66 @@
+#ifndef TEXTUREUPLOADER_H
+#define TEXTUREUPLOADER_H
+
+#include <GL/glew.h>
+
+#include <deque>
+#include <cstddef>
+
+namespace moar
+{
+
+// Ring of persistently mapped pixel unpack memory. Texel data is copied into the ring and the
+// texture copies are sourced from it, so the driver does not have to copy the client memory
+// before the call returns. Each upload is fenced and its range is reused once the fence signals.
+class TextureUploader
+{
+public:
+    static const GLsizeiptr ALIGNMENT = 256;
+
+    static GLsizeiptr align(size_t size);
+
+    explicit TextureUploader();
+    ~TextureUploader();
+    TextureUploader(const TextureUploader&) = delete;
+    TextureUploader(TextureUploader&&) = delete;
+    TextureUploader& operator=(const TextureUploader&) = delete;
+    TextureUploader& operator=(TextureUploader&&) = delete;
+
+    bool init(GLsizeiptr size);
+    void deinit();
+    bool isEnabled() const;
+    GLsizeiptr getCapacity() const;
+
+    // False while the previous uploads still hold the space, they complete within a few frames
+    bool hasSpace(GLsizeiptr size);
+    // Returns the offset of the range in the unpack buffer or -1 if there is no space
+    GLintptr allocate(GLsizeiptr size);
+    unsigned char* getPointer(GLintptr offset) const;
+    // Binds the ring as the unpack buffer, offsets are then passed as the texel pointers
+    void bind() const;
+    void unbind() const;
+    // Closes the ranges allocated since the previous fence
+    void fence();
+
+private:
+    struct Submission
+    {
+        GLsync sync;
+        GLintptr end;
+    };
+
+    void retire();
+    GLintptr findSpace(GLsizeiptr size) const;
+
+    GLuint buffer = 0;
+    unsigned char* mapped = nullptr;
+    GLsizeiptr capacity = 0;
+    GLintptr head = 0;
+    GLintptr tail = 0;
+    bool pending = false;
+    std::deque<Submission> submissions;
+};
+
+} // moar
+
+#endif // TEXTUREUPLOADER_H
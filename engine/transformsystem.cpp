@@ -0,0 +1,370 @@
+#include "transformsystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define TRANSFORM_SIMD_AVX
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_SIMD_SSE
+#endif
+
+namespace moar
+{
+
+namespace
+{
+
+const unsigned int TRANSFORM_UPDATE_GRAIN_SIZE = 256;
+
+// Column-major 4x4 product, out must not alias the inputs
+void multiplyMatrices(const glm::mat4& lhs, const glm::mat4& rhs, glm::mat4& result)
+{
+    const float* a = &lhs[0][0];
+    const float* b = &rhs[0][0];
+    float* out = &result[0][0];
+#if defined(TRANSFORM_SIMD_AVX)
+    __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a));
+    __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 4));
+    __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 8));
+    __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 12));
+    for (int column = 0; column < 4; column += 2) {
+        __m256 bc = _mm256_loadu_ps(b + column * 4);
+        __m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bc, 0x00));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bc, 0x55)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bc, 0xAA)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bc, 0xFF)));
+        _mm256_storeu_ps(out + column * 4, r);
+    }
+#elif defined(TRANSFORM_SIMD_SSE)
+    __m128 a0 = _mm_loadu_ps(a);
+    __m128 a1 = _mm_loadu_ps(a + 4);
+    __m128 a2 = _mm_loadu_ps(a + 8);
+    __m128 a3 = _mm_loadu_ps(a + 12);
+    for (int column = 0; column < 4; ++column) {
+        __m128 bc = _mm_loadu_ps(b + column * 4);
+        __m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(bc, bc, 0x00));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(bc, bc, 0x55)));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(bc, bc, 0xAA)));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(bc, bc, 0xFF)));
+        _mm_storeu_ps(out + column * 4, r);
+    }
+#else
+    (void)a;
+    (void)b;
+    (void)out;
+    result = lhs * rhs;
+#endif
+}
+
+} // anonymous
+
+const TransformSystem::Index TransformSystem::INVALID_INDEX = ~0u;
+
+TransformSystem::TransformSystem() :
+    hierarchyChanged(false)
+{
+}
+
+TransformSystem::~TransformSystem()
+{
+}
+
+TransformSystem::Index TransformSystem::create()
+{
+    Index index = 0;
+    if (!freeIndices.empty()) {
+        index = freeIndices.back();
+        freeIndices.pop_back();
+    } else {
+        index = static_cast<Index>(positions.size());
+        positions.emplace_back();
+        rotations.emplace_back();
+        scales.emplace_back();
+        parents.push_back(INVALID_INDEX);
+        firstChildren.push_back(INVALID_INDEX);
+        nextSiblings.push_back(INVALID_INDEX);
+        modelMatrices.emplace_back();
+        normalMatrices.emplace_back();
+        modelViewMatrices.emplace_back();
+        modelViewProjectionMatrices.emplace_back();
+        dirty.push_back(0);
+        alive.push_back(0);
+        changed.push_back(0);
+    }
+
+    positions[index] = glm::vec3(0.0f, 0.0f, 0.0f);
+    rotations[index] = glm::vec3(0.0f, 0.0f, 0.0f);
+    scales[index] = glm::vec3(1.0f, 1.0f, 1.0f);
+    parents[index] = INVALID_INDEX;
+    firstChildren[index] = INVALID_INDEX;
+    nextSiblings[index] = INVALID_INDEX;
+    dirty[index] = 1;
+    alive[index] = 1;
+    changed[index] = 0;
+    hierarchyChanged = true;
+    return index;
+}
+
+void TransformSystem::destroy(Index index)
+{
+    for (Index child = firstChildren[index]; child != INVALID_INDEX; ) {
+        Index next = nextSiblings[child];
+        parents[child] = INVALID_INDEX;
+        nextSiblings[child] = INVALID_INDEX;
+        dirty[child] = 1;
+        child = next;
+    }
+    firstChildren[index] = INVALID_INDEX;
+    detachFromParent(index);
+    alive[index] = 0;
+    dirty[index] = 0;
+    changed[index] = 0;
+    freeIndices.push_back(index);
+    hierarchyChanged = true;
+}
+
+void TransformSystem::setPosition(Index index, const glm::vec3& position)
+{
+    positions[index] = position;
+    dirty[index] = 1;
+}
+
+void TransformSystem::setRotation(Index index, const glm::vec3& rotation)
+{
+    rotations[index] = rotation;
+    dirty[index] = 1;
+}
+
+void TransformSystem::setScale(Index index, const glm::vec3& scale)
+{
+    scales[index] = scale;
+    dirty[index] = 1;
+}
+
+bool TransformSystem::setParent(Index index, Index parent)
+{
+    for (Index ancestor = parent; ancestor != INVALID_INDEX; ancestor = parents[ancestor]) {
+        if (ancestor == index) {
+            std::cerr << "WARNING: Transform parent would create a cycle\n";
+            return false;
+        }
+    }
+    detachFromParent(index);
+    if (parent != INVALID_INDEX) {
+        nextSiblings[index] = firstChildren[parent];
+        firstChildren[parent] = index;
+    }
+    parents[index] = parent;
+    dirty[index] = 1;
+    hierarchyChanged = true;
+    return true;
+}
+
+const glm::vec3& TransformSystem::getPosition(Index index) const
+{
+    return positions[index];
+}
+
+const glm::vec3& TransformSystem::getRotation(Index index) const
+{
+    return rotations[index];
+}
+
+const glm::vec3& TransformSystem::getScale(Index index) const
+{
+    return scales[index];
+}
+
+TransformSystem::Index TransformSystem::getParent(Index index) const
+{
+    return parents[index];
+}
+
+const glm::mat4& TransformSystem::getModelMatrix(Index index) const
+{
+    return modelMatrices[index];
+}
+
+const glm::mat4& TransformSystem::getNormalMatrix(Index index) const
+{
+    return normalMatrices[index];
+}
+
+const glm::mat4& TransformSystem::getModelViewMatrix(Index index) const
+{
+    return modelViewMatrices[index];
+}
+
+const glm::mat4& TransformSystem::getModelViewProjectionMatrix(Index index) const
+{
+    return modelViewProjectionMatrices[index];
+}
+
+const std::vector<TransformSystem::Index>& TransformSystem::getChangedTransforms() const
+{
+    return changedTransforms;
+}
+
+void TransformSystem::update(JobSystem* jobSystem, const glm::mat4& view, const glm::mat4& viewProjection)
+{
+    bool viewChanged = view != this->view || viewProjection != this->viewProjection;
+    this->view = view;
+    this->viewProjection = viewProjection;
+
+    if (hierarchyChanged) {
+        rebuildHierarchyOrder();
+    }
+
+    // Levels run one after another so a parent is always final before its children read it
+    for (size_t level = 0; level + 1 < levelOffsets.size(); ++level) {
+        jobSystem->parallelFor(levelOffsets[level], levelOffsets[level + 1], TRANSFORM_UPDATE_GRAIN_SIZE,
+                               [this, viewChanged] (unsigned int begin, unsigned int end) {
+            updateRange(begin, end, viewChanged);
+        });
+    }
+
+    changedTransforms.clear();
+    for (Index index : order) {
+        if (changed[index]) {
+            changedTransforms.push_back(index);
+        }
+    }
+}
+
+void TransformSystem::updateTransform(Index index, const glm::mat4& view, const glm::mat4& viewProjection)
+{
+    this->view = view;
+    this->viewProjection = viewProjection;
+    composeModelMatrix(index);
+    updateViewMatrices(index);
+    dirty[index] = 0;
+}
+
+void TransformSystem::detachFromParent(Index index)
+{
+    Index parent = parents[index];
+    if (parent != INVALID_INDEX) {
+        Index* link = &firstChildren[parent];
+        while (*link != index) {
+            link = &nextSiblings[*link];
+        }
+        *link = nextSiblings[index];
+    }
+    parents[index] = INVALID_INDEX;
+    nextSiblings[index] = INVALID_INDEX;
+}
+
+void TransformSystem::rebuildHierarchyOrder()
+{
+    Index numTransforms = static_cast<Index>(parents.size());
+    std::vector<unsigned int> depths(numTransforms, 0);
+    unsigned int maxDepth = 0;
+    unsigned int numAlive = 0;
+    for (Index i = 0; i < numTransforms; ++i) {
+        if (!alive[i]) {
+            continue;
+        }
+        unsigned int depth = 0;
+        for (Index parent = parents[i]; parent != INVALID_INDEX; parent = parents[parent]) {
+            ++depth;
+        }
+        depths[i] = depth;
+        maxDepth = std::max(maxDepth, depth);
+        ++numAlive;
+    }
+
+    levelOffsets.assign(numAlive > 0 ? maxDepth + 2 : 1, 0);
+    for (Index i = 0; i < numTransforms; ++i) {
+        if (alive[i]) {
+            ++levelOffsets[depths[i] + 1];
+        }
+    }
+    for (size_t level = 1; level < levelOffsets.size(); ++level) {
+        levelOffsets[level] += levelOffsets[level - 1];
+    }
+
+    order.resize(numAlive);
+    std::vector<unsigned int> insertPositions(levelOffsets.begin(), levelOffsets.end() - 1);
+    for (Index i = 0; i < numTransforms; ++i) {
+        if (alive[i]) {
+            order[insertPositions[depths[i]]++] = i;
+        }
+    }
+    hierarchyChanged = false;
+}
+
+void TransformSystem::updateRange(unsigned int begin, unsigned int end, bool viewChanged)
+{
+    for (unsigned int position = begin; position < end; ++position) {
+        Index index = order[position];
+        Index parent = parents[index];
+        bool modelChanged = dirty[index] != 0 || (parent != INVALID_INDEX && changed[parent] != 0);
+        changed[index] = modelChanged ? 1 : 0;
+        if (modelChanged) {
+            composeModelMatrix(index);
+            dirty[index] = 0;
+        }
+        if (modelChanged || viewChanged) {
+            updateViewMatrices(index);
+        }
+    }
+}
+
+void TransformSystem::composeModelMatrix(Index index)
+{
+    // Same rotation as glm::yawPitchRoll(rotation.y, rotation.x, rotation.z)
+    const glm::vec3& rotation = rotations[index];
+    float ch = std::cos(rotation.y);
+    float sh = std::sin(rotation.y);
+    float cp = std::cos(rotation.x);
+    float sp = std::sin(rotation.x);
+    float cb = std::cos(rotation.z);
+    float sb = std::sin(rotation.z);
+    glm::vec3 x(ch * cb + sh * sp * sb, sb * cp, -sh * cb + ch * sp * sb);
+    glm::vec3 y(-ch * sb + sh * sp * cb, cb * cp, sb * sh + ch * sp * cb);
+    glm::vec3 z(sh * cp, -sp, ch * cp);
+
+    const glm::vec3& scale = scales[index];
+    glm::mat4& model = modelMatrices[index];
+    model[0] = glm::vec4(x * scale.x, 0.0f);
+    model[1] = glm::vec4(y * scale.y, 0.0f);
+    model[2] = glm::vec4(z * scale.z, 0.0f);
+    model[3] = glm::vec4(positions[index], 1.0f);
+
+    // The inverse transpose of T * R * S is R * S^-1. Normals are renormalized in the shaders
+    // so a uniform scale only matters through its sign.
+    glm::mat4& normal = normalMatrices[index];
+    if (scale.x == scale.y && scale.y == scale.z) {
+        float sign = scale.x < 0.0f ? -1.0f : 1.0f;
+        normal[0] = glm::vec4(x * sign, 0.0f);
+        normal[1] = glm::vec4(y * sign, 0.0f);
+        normal[2] = glm::vec4(z * sign, 0.0f);
+    } else {
+        auto inverse = [] (float s) { return s != 0.0f ? 1.0f / s : 0.0f; };
+        normal[0] = glm::vec4(x * inverse(scale.x), 0.0f);
+        normal[1] = glm::vec4(y * inverse(scale.y), 0.0f);
+        normal[2] = glm::vec4(z * inverse(scale.z), 0.0f);
+    }
+    normal[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+    // The inverse transpose distributes over the product, so the parent normal matrix can be applied as is
+    Index parent = parents[index];
+    if (parent != INVALID_INDEX) {
+        glm::mat4 local = model;
+        multiplyMatrices(modelMatrices[parent], local, model);
+        local = normal;
+        multiplyMatrices(normalMatrices[parent], local, normal);
+    }
+}
+
+void TransformSystem::updateViewMatrices(Index index)
+{
+    multiplyMatrices(view, modelMatrices[index], modelViewMatrices[index]);
+    multiplyMatrices(viewProjection, modelMatrices[index], modelViewProjectionMatrices[index]);
+}
+
+} // moar
@@ -0,0 +1,84 @@
+#ifndef TRANSFORMSYSTEM_H
+#define TRANSFORMSYSTEM_H
+
+#include "jobsystem.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace moar
+{
+
+class TransformSystem
+{
+public:
+    using Index = unsigned int;
+
+    static const Index INVALID_INDEX;
+
+    explicit TransformSystem();
+    ~TransformSystem();
+    TransformSystem(const TransformSystem&) = delete;
+    TransformSystem(TransformSystem&&) = delete;
+    TransformSystem& operator=(const TransformSystem&) = delete;
+    TransformSystem& operator=(TransformSystem&&) = delete;
+
+    Index create();
+    void destroy(Index index);
+
+    void setPosition(Index index, const glm::vec3& position);
+    void setRotation(Index index, const glm::vec3& rotation);
+    void setScale(Index index, const glm::vec3& scale);
+    bool setParent(Index index, Index parent);
+
+    const glm::vec3& getPosition(Index index) const;
+    const glm::vec3& getRotation(Index index) const;
+    const glm::vec3& getScale(Index index) const;
+    Index getParent(Index index) const;
+    const glm::mat4& getModelMatrix(Index index) const;
+    const glm::mat4& getNormalMatrix(Index index) const;
+    const glm::mat4& getModelViewMatrix(Index index) const;
+    const glm::mat4& getModelViewProjectionMatrix(Index index) const;
+    const std::vector<Index>& getChangedTransforms() const;
+
+    void update(JobSystem* jobSystem, const glm::mat4& view, const glm::mat4& viewProjection);
+    void updateTransform(Index index, const glm::mat4& view, const glm::mat4& viewProjection);
+
+private:
+    void detachFromParent(Index index);
+    void rebuildHierarchyOrder();
+    void updateRange(unsigned int begin, unsigned int end, bool viewChanged);
+    void composeModelMatrix(Index index);
+    void updateViewMatrices(Index index);
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<Index> parents;
+    // Children of a transform as a list through its first child and their next siblings
+    std::vector<Index> firstChildren;
+    std::vector<Index> nextSiblings;
+    std::vector<glm::mat4> modelMatrices;
+    std::vector<glm::mat4> normalMatrices;
+    std::vector<glm::mat4> modelViewMatrices;
+    std::vector<glm::mat4> modelViewProjectionMatrices;
+    std::vector<unsigned char> dirty;
+    std::vector<unsigned char> alive;
+    std::vector<unsigned char> changed;
+    std::vector<Index> freeIndices;
+
+    // Live indices sorted by hierarchy depth so that parents always come before their children.
+    // Depth d occupies order[levelOffsets[d]] .. order[levelOffsets[d + 1]].
+    std::vector<Index> order;
+    std::vector<unsigned int> levelOffsets;
+    bool hierarchyChanged;
+    std::vector<Index> changedTransforms;
+
+    glm::mat4 view;
+    glm::mat4 viewProjection;
+};
+
+} // moar
+
+#endif // TRANSFORMSYSTEM_H
@@ -49,7 +49,27 @@ SOURCES += \
     ../engine/renderer.cpp \
     ../engine/gbuffer.cpp \
     ../engine/multisamplebuffer.cpp \
-    ../engine/common/typemappings.cpp
+    ../engine/common/typemappings.cpp \
+    ../engine/jobsystem.cpp \
+    ../engine/transformsystem.cpp \
+    ../engine/staticbatcher.cpp \
+    ../engine/geometrybuffer.cpp \
+    ../engine/meshoptimizer.cpp \
+    ../engine/meshsimplifier.cpp \
+    ../engine/instancebuffer.cpp \
+    ../engine/gpuculler.cpp \
+    ../engine/occlusionculler.cpp \
+    ../engine/meshclusterer.cpp \
+    ../engine/mappedfile.cpp \
+    ../engine/meshcache.cpp \
+    ../engine/texturecooker.cpp \
+    ../engine/assetloader.cpp \
+    ../engine/textureuploader.cpp \
+    ../engine/texturestreamer.cpp \
+    ../engine/parameterblock.cpp \
+    ../engine/programcache.cpp \
+    ../engine/pipelinecache.cpp \
+    ../engine/hash.cpp
 
 HEADERS += \
     myapp.h \
@@ -80,7 +100,28 @@ HEADERS += \
     ../engine/renderer.h \
     ../engine/gbuffer.h \
     ../engine/multisamplebuffer.h \
-    ../engine/common/typemappings.h
+    ../engine/common/typemappings.h \
+    ../engine/jobsystem.h \
+    ../engine/transformsystem.h \
+    ../engine/staticbatcher.h \
+    ../engine/geometrybuffer.h \
+    ../engine/meshoptimizer.h \
+    ../engine/meshsimplifier.h \
+    ../engine/instancebuffer.h \
+    ../engine/gpuculler.h \
+    ../engine/occlusionculler.h \
+    ../engine/meshclusterer.h \
+    ../engine/mappedfile.h \
+    ../engine/meshcache.h \
+    ../engine/texturecooker.h \
+    ../engine/assetloader.h \
+    ../engine/textureuploader.h \
+    ../engine/texturestreamer.h \
+    ../engine/parameterblock.h \
+    ../engine/programcache.h \
+    ../engine/pipelinecache.h \
+    ../engine/handlepool.h \
+    ../engine/hash.h
 
 INCLUDEPATH += $$PWD/../external/glm/
 
@@ -67,7 +67,9 @@ void MyApp::start()
 //#define POSTPROC
 #ifdef POSTPROC
     offset = camera->addPostprocess("offset", engine->getResourceManager()->getShaderByName("offset")->getProgram(), 1);
-    offset->setUniform("screensize", std::bind(glUniform2f, moar::SCREEN_SIZE_LOCATION, renderSettings->windowWidth, renderSettings->windowHeight));
+    offsetParameters = offset->getParameters();
+    offsetParameters->set("screenSize", glm::vec2(renderSettings->windowWidth, renderSettings->windowHeight));
+    timeParameter = offsetParameters->getIndex("time");
     camera->addPostprocess("invert", engine->getResourceManager()->getShaderByName("invert")->getProgram(), 1);
 #endif
 }
@@ -185,7 +187,7 @@ void MyApp::update()
     }
 
 #ifdef POSTPROC
-    offset->setUniform("time", std::bind(glUniform1f, moar::TIME_LOCATION, glfwGetTime()));
+    offsetParameters->set(timeParameter, static_cast<float>(glfwGetTime()));
 #endif
 }
 
@@ -40,6 +40,8 @@ private:
     moar::RenderSettings* renderSettings = nullptr;
     moar::Time* time = nullptr;
     moar::Postprocess* offset = nullptr;
+    moar::ParameterBlock* offsetParameters = nullptr;
+    int timeParameter = -1;
 
     moar::Object* light0 = nullptr;
     moar::Object* light1 = nullptr;